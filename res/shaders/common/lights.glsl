@@ -0,0 +1,62 @@
+// Point light code shared by the lit shaders, inserted after their #version line
+
+// Clustered point lights, see light_clusters.h
+uniform mat4 view;
+uniform mat4 projection;
+uniform int numClusterLights;
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
+uniform samplerBuffer clusterLightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLightIndices;
+const ivec3 ClusterCounts = ivec3(16, 9, 24);
+
+// Point light shadows, see shadow_map.h
+uniform samplerCubeShadow shadowMap;
+uniform int shadowTaps;
+uniform float shadowFar;
+uniform float shadowTexelAngle;
+
+// The center, then the corners and edge midpoints of a cube around it
+const vec3 ShadowOffsets[21] = vec3[](
+    vec3( 0,  0,  0),
+    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
+    vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+    vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+    vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+    vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1));
+
+// Offset and count of the lights in the cluster of a world space position
+uvec2 ClusterLightRange(vec3 position)
+{
+    vec4 viewPos = view * vec4(position, 1.0);
+    vec4 clipPos = projection * viewPos;
+    ivec2 tile = ivec2((clipPos.xy / clipPos.w * 0.5 + 0.5) * vec2(ClusterCounts.xy));
+    int slice = int(log(-viewPos.z) * clusterDepthScale + clusterDepthBias);
+    ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), ClusterCounts - 1);
+    return texelFetch(clusterRanges, cluster.x + ClusterCounts.x * (cluster.y + ClusterCounts.y * cluster.z)).rg;
+}
+
+// Smooth inverse square falloff reaching zero at the light's radius
+float Attenuation(float lightDistance, float radius)
+{
+    float ratio = lightDistance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (lightDistance * lightDistance + 1.0);
+}
+
+// Fraction of the main light reaching a fragment fromLight away from it. Bias and filter radius follow
+// the size of a shadow map texel at the fragment's distance, the bias also grows where the light grazes.
+float PointShadow(vec3 fromLight, float nDotL)
+{
+    if(shadowTaps == 0)
+        return 1.0;
+
+    float lightDistance = length(fromLight);
+    float texelSize = lightDistance * shadowTexelAngle;
+    float reference = (lightDistance - texelSize * (1.5 + 3.0 * (1.0 - nDotL))) / shadowFar;
+    float lit = 0.0;
+    for(int i = 0; i < shadowTaps; i++)
+        lit += texture(shadowMap, vec4(fromLight + ShadowOffsets[i] * texelSize * 1.5, reference));
+    return lit / float(shadowTaps);
+}
\ No newline at end of file
@@ -1,12 +1,17 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
 out vec3 texCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+uniform mat4 inverseViewProjection;
 
+// One triangle covering the screen, generated from the vertex index
 void main()
 {
-	texCoords = aPos;
-	gl_Position = (projection * view * vec4(aPos, 1.0)).xyww;
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+
+	// Unproject the far plane point, the view has no translation so it's the view direction
+	vec4 direction = inverseViewProjection * vec4(position, 1.0, 1.0);
+	texCoords = direction.xyz / direction.w;
+
+	// At the far plane, so it only fills what the scene left at the cleared depth
+	gl_Position = vec4(position, 1.0, 1.0);
 }
\ No newline at end of file
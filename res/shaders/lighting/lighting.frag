@@ -1,8 +1,7 @@
 #version 330 core
 in vec2 uvs;
-in vec3 fragPos_tangentSpace;
-in vec3 lightPos_tangentSpace;
-in vec3 viewPos_tangentSpace;
+in vec3 fragPos;
+in mat3 TBN;
 
 out vec4 fragColor;
 
@@ -10,18 +9,43 @@ uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
 uniform sampler2D specularMap;
 
-void main()
+uniform vec3 pointLightPos;
+uniform vec3 cameraPos;
+
+vec3 PhongLight(vec3 normal, vec3 viewDir, vec3 lightDir, vec3 diffuseColor, float specularColor)
 {
-    vec3 normalMapTexture = 2.0 * texture(normalMap, uvs).rgb - 1.0;
-    vec3 normal = normalize(normalMapTexture);
-    vec3 lightDir = normalize(lightPos_tangentSpace - fragPos_tangentSpace);
     float diffuseStrength = max(0.0, dot(lightDir, normal));
-    vec3 diffuse = texture(diffuseMap, uvs).xyz * diffuseStrength;
-
-    vec3 viewDir = normalize(viewPos_tangentSpace - fragPos_tangentSpace);
     vec3 reflectedDir = reflect(-lightDir, normal);
     float specularStrength = pow(max(0.0, dot(viewDir, reflectedDir)), 32);
-    vec3 specular = vec3(texture(specularMap, uvs).r) * specularStrength;
+    return diffuseColor * diffuseStrength + vec3(specularColor * specularStrength);
+}
+
+void main()
+{
+    // Normal maps only store x and y, tangent space normals always point out of the surface
+    vec2 normalXY = 2.0 * texture(normalMap, uvs).rg - 1.0;
+    vec3 normalMapTexture = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+    vec3 normal = normalize(TBN * normalMapTexture);
+    vec3 viewDir = normalize(cameraPos - fragPos);
+    vec3 diffuseColor = texture(diffuseMap, uvs).xyz;
+    float specularColor = texture(specularMap, uvs).r;
+
+    vec3 lightDir = normalize(pointLightPos - fragPos);
+    vec3 color = PhongLight(normal, viewDir, lightDir, diffuseColor, specularColor) * PointShadow(fragPos - pointLightPos, max(dot(normal, lightDir), 0.0));
+
+    // Only the lights binned into this fragment's cluster are visited
+    uvec2 range = numClusterLights > 0 ? ClusterLightRange(fragPos) : uvec2(0u);
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int light = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLightData, light * 2);
+        vec3 lightColor = texelFetch(clusterLightData, light * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float lightDistance = length(toLight);
+        float attenuation = Attenuation(lightDistance, positionRadius.w);
+        if(attenuation > 0.0)
+            color += PhongLight(normal, viewDir, toLight / lightDistance, diffuseColor, specularColor) * lightColor * attenuation;
+    }
 
-    fragColor = vec4(diffuse + specular, 1.0);
+    fragColor = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#version 330 core
+in vec2 uvs;
+in vec3 fragPos;
+in mat3 TBN;
+
+out vec4 fragColor;
+
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform sampler2D specularMap; // occlusion, roughness and metalness
+
+// Image based lighting, see environment.h
+uniform vec3 irradiance[9];
+uniform samplerCube prefilteredMap;
+uniform float prefilteredMaxLod;
+uniform sampler2D brdfLookup;
+
+uniform vec3 pointLightPos;
+uniform vec3 cameraPos;
+
+const float PI = 3.14159265;
+
+vec3 Irradiance(vec3 n)
+{
+    return irradiance[0] * 0.282095
+         + irradiance[1] * 0.488603 * n.y
+         + irradiance[2] * 0.488603 * n.z
+         + irradiance[3] * 0.488603 * n.x
+         + irradiance[4] * 1.092548 * n.x * n.y
+         + irradiance[5] * 1.092548 * n.y * n.z
+         + irradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+         + irradiance[7] * 1.092548 * n.x * n.z
+         + irradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+float DistributionGGX(float nDotH, float roughness)
+{
+    float a2 = roughness * roughness * roughness * roughness;
+    float d = nDotH * nDotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+float GeometrySmith(float nDotV, float nDotL, float roughness)
+{
+    // Direct lights remap k to (roughness + 1)^2 / 8
+    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    return nDotV / (nDotV * (1.0 - k) + k) * nDotL / (nDotL * (1.0 - k) + k);
+}
+
+vec3 FresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+vec3 DirectLight(vec3 N, vec3 V, vec3 L, float nDotV, vec3 albedo, vec3 F0, float roughness, float metalness)
+{
+    vec3 H = normalize(V + L);
+    float nDotL = max(dot(N, L), 0.0);
+    vec3 F = FresnelSchlick(max(dot(H, V), 0.0), F0);
+    vec3 specular = DistributionGGX(max(dot(N, H), 0.0), roughness) * GeometrySmith(nDotV, nDotL, roughness) * F / (4.0 * nDotV * max(nDotL, 1e-4));
+    vec3 kD = (1.0 - F) * (1.0 - metalness);
+    return (kD * albedo / PI + specular) * nDotL;
+}
+
+void main()
+{
+    // Colors are stored in sRGB, lighting is done in linear space
+    vec3 albedo = pow(texture(diffuseMap, uvs).rgb, vec3(2.2));
+    vec3 occRoughMetal = texture(specularMap, uvs).rgb;
+    float occlusion = occRoughMetal.r;
+    float roughness = clamp(occRoughMetal.g, 0.04, 1.0);
+    float metalness = occRoughMetal.b;
+
+    // Normal maps only store x and y, tangent space normals always point out of the surface
+    vec2 normalXY = 2.0 * texture(normalMap, uvs).rg - 1.0;
+    vec3 N = normalize(TBN * vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
+    vec3 V = normalize(cameraPos - fragPos);
+    float nDotV = max(dot(N, V), 1e-4);
+    vec3 F0 = mix(vec3(0.04), albedo, metalness);
+
+    // Main point light, unattenuated like the Blinn-Phong shader's
+    vec3 L = normalize(pointLightPos - fragPos);
+    vec3 direct = DirectLight(N, V, L, nDotV, albedo, F0, roughness, metalness) * PointShadow(fragPos - pointLightPos, max(dot(N, L), 0.0));
+
+    // Only the lights binned into this fragment's cluster are visited
+    uvec2 range = numClusterLights > 0 ? ClusterLightRange(fragPos) : uvec2(0u);
+    for(uint i = 0u; i < range.y; i++)
+    {
+        int light = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLightData, light * 2);
+        vec3 color = texelFetch(clusterLightData, light * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float lightDistance = length(toLight);
+        float attenuation = Attenuation(lightDistance, positionRadius.w);
+        if(attenuation > 0.0)
+            direct += DirectLight(N, V, toLight / lightDistance, nDotV, albedo, F0, roughness, metalness) * color * attenuation;
+    }
+
+    // Split sum approximation of the environment's specular reflection
+    vec3 FAmbient = FresnelSchlickRoughness(nDotV, F0, roughness);
+    vec3 kDAmbient = (1.0 - FAmbient) * (1.0 - metalness);
+    vec3 R = reflect(-V, N);
+    vec3 prefiltered = textureLod(prefilteredMap, R, roughness * prefilteredMaxLod).rgb;
+    vec2 brdf = texture(brdfLookup, vec2(nDotV, roughness)).rg;
+    vec3 ambient = (kDAmbient * albedo * Irradiance(N) + prefiltered * (F0 * brdf.x + brdf.y)) * occlusion;
+
+    fragColor = vec4(pow(direct + ambient, vec3(1.0 / 2.2)), 1.0);
+}
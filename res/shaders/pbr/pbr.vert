@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aUVs;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec4 aTangent; // w holds the bitangent's handedness
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 uvs;
+out vec3 fragPos;
+out mat3 TBN;
+
+void main()
+{
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    vec3 T = normalize(normalMatrix * aTangent.xyz);
+    vec3 N = normalize(normalMatrix * aNormal);
+
+    // re-orthogonalize T with respect to N
+    T = normalize(T - dot(T, N) * N);
+    vec3 B = cross(N, T) * aTangent.w;
+
+    // Lighting happens in world space, where the environment is sampled
+    TBN = mat3(T, B, N);
+    uvs = aUVs;
+    fragPos = vec3(model * vec4(aPos, 1.0));
+
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
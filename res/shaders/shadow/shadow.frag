@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 fragPos;
+
+uniform vec3 pointLightPos;
+uniform float shadowFar;
+
+// Distance to the light rather than projected depth, so every face compares alike
+void main()
+{
+    gl_FragDepth = length(fragPos - pointLightPos) / shadowFar;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 lightViewProjection;
+
+out vec3 fragPos;
+
+void main()
+{
+    fragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = lightViewProjection * vec4(fragPos, 1.0);
+}
@@ -0,0 +1,307 @@
+#include "asset_cache.h"
+#include "../Platform/file_lock.h"
+#include "../Threading/parallel_for.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Readers and writers share the lock file, eviction holds it exclusively
+static struct
+{
+    std::once_flag started;
+    std::string directory;
+    std::string lockPath;
+    uint64_t sizeLimit = 0;
+
+    // Makes temporary file names unique across processes and writers
+    uint64_t processTag = 0;
+    std::atomic<unsigned int> counter{0};
+
+    // Size as of the last trim plus the entries this process published since, so the
+    // directory only gets scanned once that crosses the limit. Entries other processes
+    // publish aren't counted, they show up in the scan or trigger their own trims.
+    std::atomic<bool> scanned{false};
+    std::atomic<uint64_t> estimatedSize{0};
+} cache;
+
+static fs::path GetDefaultCacheDirectory()
+{
+    const char* overridden = getenv("MODEL_VIEWER_CACHE_DIR");
+    if(overridden != nullptr && *overridden != '\0')
+        return overridden;
+
+#ifdef _WIN32
+    const char* localAppData = getenv("LOCALAPPDATA");
+    if(localAppData != nullptr && *localAppData != '\0')
+        return fs::path(localAppData) / "model-viewer" / "cache";
+#else
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if(cacheHome != nullptr && *cacheHome != '\0')
+        return fs::path(cacheHome) / "model-viewer";
+    const char* home = getenv("HOME");
+    if(home != nullptr && *home != '\0')
+        return fs::path(home) / ".cache" / "model-viewer";
+#endif
+
+    std::error_code error;
+    fs::path temporary = fs::temp_directory_path(error);
+    return (error ? fs::path(".") : temporary) / "model-viewer-cache";
+}
+
+static void StartCache(const char* directory, uint64_t sizeLimit)
+{
+    fs::path path = directory != nullptr ? fs::path(directory) : GetDefaultCacheDirectory();
+    cache.sizeLimit = sizeLimit;
+    cache.processTag = ((uint64_t)std::random_device()() << 32) ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+
+    std::error_code error;
+    fs::create_directories(path, error);
+    if(error)
+    {
+        printf("Failed to create asset cache directory at path: %s, assets won't be cached\n", path.string().c_str());
+        return;
+    }
+
+    cache.directory = path.string();
+    cache.lockPath = (path / "cache.lock").string();
+    printf("Asset cache at %s (%.0f MiB limit)\n", cache.directory.c_str(), (double)sizeLimit / (1024.0 * 1024.0));
+}
+
+void InitAssetCache(const char* directory, uint64_t sizeLimit)
+{
+    std::call_once(cache.started, StartCache, directory, sizeLimit);
+}
+
+static uint64_t Rotate(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// Hashes 32 bytes per step in four independent lanes, then mixes the lanes and the tail
+static uint64_t HashBytes(const unsigned char* data, size_t size, uint64_t seed)
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t prime3 = 0x165667B19E3779F9ull;
+
+    uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32)
+    {
+        for(int lane = 0; lane < 4; lane++)
+        {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, 8);
+            lanes[lane] = Rotate(lanes[lane] + word * prime2, 31) * prime1;
+        }
+    }
+
+    uint64_t hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18) + (uint64_t)size;
+    for(; i < size; i++)
+        hash = Rotate(hash ^ (data[i] * prime3), 11) * prime1;
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+AssetCacheKey GetAssetCacheKey(const void* source, size_t size, const char* settings, unsigned int version)
+{
+    // Sources are hashed in fixed size blocks across the job system, so the
+    // key doesn't depend on the thread count. The block hashes are hashed last.
+    const size_t blockSize = 4 * 1024 * 1024;
+    const unsigned char* bytes = (const unsigned char*)source;
+    size_t numBlocks = (size + blockSize - 1) / blockSize;
+
+    std::vector<uint64_t> hashes(numBlocks + 2);
+    ParallelFor(numBlocks, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            size_t offset = i * blockSize;
+            hashes[i] = HashBytes(bytes + offset, std::min(blockSize, size - offset), i);
+        }
+    }, "Cache key hashing");
+
+    hashes[numBlocks] = HashBytes((const unsigned char*)settings, strlen(settings), version);
+    hashes[numBlocks + 1] = (uint64_t)size;
+    return { HashBytes((const unsigned char*)hashes.data(), hashes.size() * sizeof(uint64_t), version) };
+}
+
+static std::string GetEntryPath(AssetCacheKey key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)key.hash);
+    return (fs::path(cache.directory) / name).string();
+}
+
+FILE* OpenCacheEntry(AssetCacheKey key)
+{
+    InitAssetCache();
+    if(cache.directory.empty())
+        return nullptr;
+
+    FileLock lock;
+    if(!AcquireFileLock(cache.lockPath.c_str(), false, lock))
+        return nullptr;
+
+    std::string path = GetEntryPath(key);
+    FILE* file = fopen(path.c_str(), "rb");
+
+    // Modification times double as the last use for eviction
+    if(file != nullptr)
+    {
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    }
+
+    ReleaseFileLock(lock);
+    return file;
+}
+
+bool BeginCacheEntry(AssetCacheKey key, AssetCacheWriter& writer)
+{
+    InitAssetCache();
+    writer.file = nullptr;
+    if(cache.directory.empty())
+        return false;
+
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%016llx-%u.tmp", (unsigned long long)cache.processTag, cache.counter++);
+    writer.path = GetEntryPath(key);
+    writer.temporaryPath = writer.path + suffix;
+
+    writer.file = fopen(writer.temporaryPath.c_str(), "wb");
+    if(writer.file == nullptr)
+    {
+        printf("Failed to create cache entry at path: %s\n", writer.temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Evicts the least recently used entries until the cache fits its limit
+static void TrimCache()
+{
+    FileLock lock;
+    if(!AcquireFileLock(cache.lockPath.c_str(), true, lock))
+        return;
+
+    struct Entry
+    {
+        fs::path path;
+        fs::file_time_type lastUse;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+
+    std::error_code error;
+    fs::file_time_type now = fs::file_time_type::clock::now();
+    for(const fs::directory_entry& item : fs::directory_iterator(cache.directory, error))
+    {
+        std::error_code itemError;
+        Entry entry = { item.path(), item.last_write_time(itemError), 0 };
+        entry.size = item.is_regular_file(itemError) ? item.file_size(itemError) : 0;
+        if(itemError)
+            continue;
+
+        // Left behind by writers that never finished
+        if(entry.path.extension() == ".tmp")
+        {
+            if(now - entry.lastUse > std::chrono::hours(24))
+                fs::remove(entry.path, itemError);
+            continue;
+        }
+
+        if(entry.path.extension() == ".cache")
+        {
+            totalSize += entry.size;
+            entries.push_back(entry);
+        }
+    }
+
+    if(totalSize > cache.sizeLimit)
+    {
+        // Going a tenth under the limit keeps every new entry from evicting another one
+        uint64_t targetSize = cache.sizeLimit - cache.sizeLimit / 10;
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+
+        size_t evicted = 0;
+        for(const Entry& entry : entries)
+        {
+            if(totalSize <= targetSize)
+                break;
+
+            // Entries still open elsewhere can't be removed on Windows and stay for the next trim
+            std::error_code removeError;
+            if(fs::remove(entry.path, removeError))
+            {
+                totalSize -= entry.size;
+                evicted++;
+            }
+        }
+        printf("Evicted %zu asset cache entries, %.2f MiB left\n", evicted, (double)totalSize / (1024.0 * 1024.0));
+    }
+    cache.estimatedSize = totalSize;
+
+    ReleaseFileLock(lock);
+}
+
+void CommitCacheEntry(AssetCacheWriter& writer)
+{
+    bool written = fflush(writer.file) == 0 && ferror(writer.file) == 0;
+    written = fclose(writer.file) == 0 && written;
+    writer.file = nullptr;
+
+    std::error_code error;
+    if(!written)
+    {
+        printf("Failed to write cache entry at path: %s\n", writer.temporaryPath.c_str());
+        fs::remove(writer.temporaryPath, error);
+        return;
+    }
+
+    // Renaming replaces any entry another process published meanwhile, which holds the same data
+    FileLock lock;
+    bool locked = AcquireFileLock(cache.lockPath.c_str(), false, lock);
+    fs::rename(writer.temporaryPath, writer.path, error);
+    if(locked)
+        ReleaseFileLock(lock);
+
+    if(error)
+    {
+        printf("Failed to publish cache entry at path: %s\n", writer.path.c_str());
+        fs::remove(writer.temporaryPath, error);
+        return;
+    }
+
+    // The first entry of a session scans to learn the size, later ones only when it may be over
+    uint64_t size = fs::file_size(writer.path, error);
+    if(error)
+        size = 0;
+    bool firstEntry = !cache.scanned.exchange(true);
+    if(cache.estimatedSize.fetch_add(size) + size > cache.sizeLimit || firstEntry)
+        TrimCache();
+}
+
+void AbortCacheEntry(AssetCacheWriter& writer)
+{
+    if(writer.file != nullptr)
+        fclose(writer.file);
+    writer.file = nullptr;
+
+    std::error_code error;
+    fs::remove(writer.temporaryPath, error);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Imported assets are cached in a single directory under a hash of their source bytes,
+// import settings and format version. Nothing gets written next to the sources, so
+// they can live on read-only shares, and edited sources never hit stale entries.
+struct AssetCacheKey
+{
+    uint64_t hash;
+};
+
+const uint64_t DefaultAssetCacheLimit = (uint64_t)4 * 1024 * 1024 * 1024;
+
+// Null picks $MODEL_VIEWER_CACHE_DIR, or the user's cache directory without it. The least
+// recently used entries are evicted past sizeLimit bytes. Caching before this uses the defaults.
+void InitAssetCache(const char* directory = nullptr, uint64_t sizeLimit = DefaultAssetCacheLimit);
+
+// Settings describe anything besides the source bytes that changes the cached output
+AssetCacheKey GetAssetCacheKey(const void* source, size_t size, const char* settings, unsigned int version);
+
+// Opens an entry for reading and marks it as just used. Null when it isn't cached.
+FILE* OpenCacheEntry(AssetCacheKey key);
+
+// Entries are written to a temporary file and renamed into place once complete,
+// so other processes never see one half written
+struct AssetCacheWriter
+{
+    FILE* file;
+    std::string temporaryPath;
+    std::string path;
+};
+
+// Fails without a usable cache directory, in which case nothing gets cached
+bool BeginCacheEntry(AssetCacheKey key, AssetCacheWriter& writer);
+
+// Publishes the entry, then evicts old entries if the cache has grown past its limit
+void CommitCacheEntry(AssetCacheWriter& writer);
+void AbortCacheEntry(AssetCacheWriter& writer);
@@ -1,10 +1,22 @@
 #include "asset_loader.h"
+#include "asset_cache.h"
+#include "async_loader.h"
+#include "environment.h"
+#include "mesh_cache.h"
+#include "mipmap.h"
+#include "obj_parser.h"
+#include "../Memory/arena.h"
+#include "../Platform/file_mapping.h"
+#include "../Renderer/gl_state.h"
+#include "../Threading/parallel_for.h"
 #include <cstring>
 #include <glad/glad.h>
 #include <glm/vec3.hpp>
 #include <stb_image.h>
+#include <utility>
+#include <vector>
 
-Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentShaderPath)
+Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentShaderPath, const char* sharedPath)
 {
     FILE* vsRaw = fopen(vertexShaderPath, "rb");
     if(!vsRaw)
@@ -59,9 +71,38 @@ Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentSh
     fsBuffer[size] = '\0';
     rewind(fsRaw);
 
+    std::vector<char> shared;
+    if(sharedPath != nullptr)
+    {
+        FILE* sharedRaw = fopen(sharedPath, "rb");
+        if(!sharedRaw)
+        {
+            printf("Failed to open file at path: %s\n", sharedPath);
+            exit(-1);
+        }
+
+        fseek(sharedRaw, 0, SEEK_END);
+        shared.resize((size_t)ftell(sharedRaw) + 1);
+        rewind(sharedRaw);
+        readSize = fread(shared.data(), 1, shared.size() - 1, sharedRaw);
+        if(readSize != shared.size() - 1)
+            printf("Bytes needed to be read: %zu\nBytes successfully read: %zu\n", shared.size() - 1, readSize);
+        shared.back() = '\0';
+        fclose(sharedRaw);
+    }
+
     // Create fragment shader object
     GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fsBuffer, 0);
+    const char* versionEnd = strchr(fsBuffer, '\n');
+    if(sharedPath != nullptr && versionEnd != nullptr)
+    {
+        // #version has to come first, #line keeps the shader's own line numbers in compile errors
+        const char* sources[4] = { fsBuffer, shared.data(), "\n#line 2\n", versionEnd + 1 };
+        const GLint lengths[4] = { (GLint)(versionEnd + 1 - fsBuffer), -1, -1, -1 };
+        glShaderSource(fragment, 4, sources, lengths);
+    }
+    else
+        glShaderSource(fragment, 1, &fsBuffer, 0);
     glCompileShader(fragment);
 
     // Check compilation errors
@@ -127,142 +168,407 @@ Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentSh
     return { ID, uniforms };
 }
 
+// Image data lives in upload memory so cached images are read straight into it.
+// Images decoded on job threads are held in regular memory until they're staged.
 struct ImageData
 {
-    unsigned char* data;
+    StagingAllocation memory;
+    unsigned char* pixels;
     int width, height, channels;
+    unsigned int levels;
+    AssetLoadTimes times;
 };
 
-void CheckForCache(const char* path, const char* binPath, bool& stb_free, ImageData& idata)
+// Bumped whenever the cached image layout, the way mip chains are filtered or the channel repacking changes
+static const unsigned int ImageCacheVersion = 3;
+
+static AssetCacheKey GetImageCacheKey(const unsigned char* encoded, size_t encodedSize, TextureType type, bool mipmaps, bool flip)
+{
+    char settings[64];
+    snprintf(settings, sizeof(settings), "image type %d mips %d flip %d", (int)type, (int)mipmaps, (int)flip);
+    return GetAssetCacheKey(encoded, encodedSize, settings, ImageCacheVersion);
+}
+
+static bool ReadCache(AssetCacheKey key, const char* name, bool staged, ImageData& idata)
 {
-    FILE* cachedFile = fopen(binPath, "rb");
-    
-    // No cache file for texture exists. Load and save it
+    FILE* cachedFile = OpenCacheEntry(key);
     if(cachedFile == nullptr)
+        return false;
+
+    // Get image metadata. The line break is read separately, as scanf would skip pixels that look like whitespace.
+    if(fscanf(cachedFile, "MIPS %d %d %d %u", &idata.width, &idata.height, &idata.channels, &idata.levels) != 4 ||
+       fgetc(cachedFile) != '\n')
     {
-        idata.data = stbi_load(path, &idata.width, &idata.height, &idata.channels, 0);
-        if(idata.data == nullptr)
-        {
-            printf("Failed to open texture at path: %s\n", path);
-            exit(-1);
-        }
+        printf("Invalid image metadata contained in cache of: %s\n", name);
+        fclose(cachedFile);
+        return false;
+    }
+
+    // Get the image's actual data, all mip levels packed one after another
+    size_t dataSize = CalculateMipOffset(idata.width, idata.height, idata.channels, idata.levels);
+    unsigned char* data;
+    if(staged)
+    {
+        idata.memory = StagingAlloc(dataSize);
+        data = idata.memory.data;
+    }
+    else
+        data = idata.pixels = new unsigned char[dataSize];
 
-        // Write the metadata and the actual image's data to the cache
-        FILE* outFile = fopen(binPath, "wb");
-        if(outFile == nullptr)
+    if(fread(data, 1, dataSize, cachedFile) != dataSize)
+    {
+        printf("Truncated image data contained in cache of: %s\n", name);
+        if(staged)
+            StagingRelease(idata.memory);
+        else
+            delete[] idata.pixels;
+        idata.pixels = nullptr;
+        fclose(cachedFile);
+        return false;
+    }
+
+    fclose(cachedFile);
+    return true;
+}
+
+// Channels of each texture type the material shaders read. lighting.frag and pbr.frag
+// sample the diffuse map's rgb and rebuild normals from the normal map's rg, pbr.frag
+// reads occlusion, roughness and metalness from the data map's rgb.
+static int GetUsedChannels(TextureType type)
+{
+    return type == TextureType::Normal ? 2 : 3;
+}
+
+// Keeps the first channels of every texel of the chain. Each level moves towards the
+// start of the buffer, so it's repacked in place front to back.
+static void RepackChannels(ImageData& idata, int channels)
+{
+    int width = idata.width;
+    int height = idata.height;
+    for(unsigned int level = 0; level < idata.levels; level++)
+    {
+        const unsigned char* source = idata.pixels + CalculateMipOffset(idata.width, idata.height, idata.channels, level);
+        unsigned char* destination = idata.pixels + CalculateMipOffset(idata.width, idata.height, channels, level);
+        size_t numTexels = (size_t)width * height;
+        for(size_t i = 0; i < numTexels; i++)
         {
-            printf("Failed to create output binary file at path: %s\n", binPath);
-            exit(-1);
+            for(int c = 0; c < channels; c++)
+                destination[i * channels + c] = source[i * idata.channels + c];
         }
-        fprintf(outFile, "%d %d %d\n", idata.width, idata.height, idata.channels);
-        fwrite(idata.data, sizeof(unsigned char) * (size_t)idata.width * idata.height * idata.channels, 1, outFile);
 
-        // Cleanup
-        fclose(outFile);
-        stb_free = true;
-        printf("Created cache for image at path: %s\n", path);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
     }
-    // Cache file exists, load that instead
-    else 
-    {
-        // Get image metadata
-        if(fscanf(cachedFile, "%d %d %d\n", &idata.width, &idata.height, &idata.channels) == EOF)
-            printf("Invalid image metadata contained in file: %s\n", binPath);
+    idata.channels = channels;
+}
 
-        // Get the image's actual data
-        size_t dataSize = (size_t)idata.width * idata.height * idata.channels;
-        idata.data = new unsigned char[dataSize + 1];
-        fread(idata.data, sizeof(unsigned char) * dataSize, 1, cachedFile);
-        idata.data[dataSize] = '\0';
+// Drops the channels the material shaders never read, and stores colors and data that are
+// the same in every used channel as a single one the texture swizzles back out. Filtering
+// treats channels independently, so gray level 0 texels mean a gray chain.
+static void ReduceChannels(ImageData& idata, TextureType type)
+{
+    int used = GetUsedChannels(type);
+    if(type == TextureType::Normal && idata.channels < 3)
+        return;
 
-        // Cleanup
-        fclose(cachedFile);
-        stb_free = false;
+    // Fewer channels than the shaders read means gray, with or without alpha
+    int channels = idata.channels < used ? 1 : used;
+    if(channels == 3)
+    {
+        const unsigned char* texel = idata.pixels;
+        size_t numTexels = (size_t)idata.width * idata.height;
+        bool gray = true;
+        for(size_t i = 0; i < numTexels && gray; i++, texel += idata.channels)
+            gray = texel[0] == texel[1] && texel[1] == texel[2];
+        if(gray)
+            channels = 1;
     }
+
+    if(channels < idata.channels)
+        RepackChannels(idata, channels);
 }
 
-Texture LoadTextureFromFile(const char* path)
+// Decodes the image and filters its mip chain into idata.pixels, then writes them to the cache.
+// Material textures, the ones with mip chains, are reduced to the channels their shaders read.
+// Touches neither GL nor the staging ring, so it can run on any thread. Returns false, leaving
+// idata.pixels null, for images that can't be decoded.
+static bool DecodeAndCacheImage(const char* name, AssetCacheKey key, TextureType type, bool mipmaps, bool flip, ImageData& idata,
+                                const unsigned char* encoded, size_t encodedSize)
 {
-    // OpenGL textures start from lower left corner
-    stbi_set_flip_vertically_on_load(true); 
+    double start = GetLoadTimerMilliseconds();
+    stbi_set_flip_vertically_on_load_thread(flip);
+    unsigned char* pixels = stbi_load_from_memory(encoded, (int)encodedSize, &idata.width, &idata.height, &idata.channels, 0);
+    if(pixels == nullptr)
+    {
+        printf("Failed to decode texture: %s\n", name);
+        return false;
+    }
 
-    // Texture metadata
-    GLuint ID;
-    ImageData idata = {};
-    bool stb_free = false;
-    unsigned int index = Texture::GlobalTextureIndex++;
+    // Level 0 goes first, the rest of the chain is filtered down from it
+    idata.levels = mipmaps ? CalculateMipLevels(idata.width, idata.height) : 1;
+    size_t baseSize = (size_t)idata.width * idata.height * idata.channels;
+    size_t dataSize = CalculateMipOffset(idata.width, idata.height, idata.channels, idata.levels);
+    idata.pixels = new unsigned char[dataSize];
+    memcpy(idata.pixels, pixels, baseSize);
+    stbi_image_free(pixels);
+    double decoded = GetLoadTimerMilliseconds();
+    idata.times.decode = decoded - start;
+
+    // Filtering reads back earlier levels, so it runs in regular memory rather than the write-combined ring
+    GenerateMipChain(idata.pixels, idata.width, idata.height, idata.channels, idata.levels, type);
+    if(mipmaps)
+    {
+        ReduceChannels(idata, type);
+        dataSize = CalculateMipOffset(idata.width, idata.height, idata.channels, idata.levels);
+    }
+    idata.times.build = GetLoadTimerMilliseconds() - decoded;
+
+    // Write the metadata and the actual image's data to the cache
+    AssetCacheWriter writer;
+    if(!BeginCacheEntry(key, writer))
+        return true;
+    fprintf(writer.file, "MIPS %d %d %d %u\n", idata.width, idata.height, idata.channels, idata.levels);
+    fwrite(idata.pixels, 1, dataSize, writer.file);
+    CommitCacheEntry(writer);
+    printf("Created cache for image: %s\n", name);
+    return true;
+}
 
-    // The cached version's path
-    std::string binPath(path);
-    binPath = binPath.substr(0, binPath.find_last_of('.')) + ".bin";
-    
-    CheckForCache(path, binPath.c_str(), stb_free, idata);
+// Moves an image decoded into regular memory over to upload memory
+static void StageImage(ImageData& idata)
+{
+    size_t dataSize = CalculateMipOffset(idata.width, idata.height, idata.channels, idata.levels);
+    idata.memory = StagingAlloc(dataSize);
+    memcpy(idata.memory.data, idata.pixels, dataSize);
+    delete[] idata.pixels;
+    idata.pixels = nullptr;
+}
 
-    // Generate texture from loaded data
-    glGenTextures(1, &ID);
+// Loads the encoded image from the cache, or decodes and caches it. Returns false if it can't be decoded.
+static bool CheckForCache(const char* name, TextureType type, bool mipmaps, bool flip, ImageData& idata,
+                          const unsigned char* encoded, size_t encodedSize)
+{
+    // Hashing the encoded image for its key counts as reading it
+    double start = GetLoadTimerMilliseconds();
+    AssetCacheKey key = GetImageCacheKey(encoded, encodedSize, type, mipmaps, flip);
+    idata.times.cached = ReadCache(key, name, true, idata);
+    idata.times.read += GetLoadTimerMilliseconds() - start;
+    if(idata.times.cached)
+        return true;
+
+    if(!DecodeAndCacheImage(name, key, type, mipmaps, flip, idata, encoded, encodedSize))
+        return false;
+    StageImage(idata);
+    return true;
+}
 
-    glActiveTexture(GL_TEXTURE0 + index);
-    glBindTexture(GL_TEXTURE_2D, ID);
+// Job side of CheckForCache for image files, leaving the image in idata.pixels
+static void DecodeImage(const char* path, TextureType type, bool mipmaps, bool flip, ImageData& idata)
+{
+    double start = GetLoadTimerMilliseconds();
+    MappedFile file;
+    if(!MapFile(path, file))
+    {
+        printf("Failed to open texture at path: %s\n", path);
+        exit(-1);
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    AssetCacheKey key = GetImageCacheKey(file.data, file.size, type, mipmaps, flip);
+    idata.times.cached = ReadCache(key, path, false, idata);
+    idata.times.read = GetLoadTimerMilliseconds() - start;
+    if(!idata.times.cached)
+        DecodeAndCacheImage(path, key, type, mipmaps, flip, idata, file.data, file.size);
+    UnmapFile(file);
+}
+
+static void SetTextureFiltering(unsigned int levels)
+{
+    // Trilinear filtering across the whole chain
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)levels - 1);
 
+    // Anisotropic filtering is an extension on GL 3.3, use the highest level supported up to 16x
+    if(GLAD_GL_EXT_texture_filter_anisotropic || GLAD_GL_ARB_texture_filter_anisotropic)
+    {
+        float maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy < 16.0f ? maxAnisotropy : 16.0f);
+    }
+}
+
+// Uploads an image and its mip chain from upload memory into a new texture
+static Texture CreateTextureFromImage(ImageData& idata, const char* name)
+{
+    double start = GetLoadTimerMilliseconds();
+    GLuint ID;
+
+    GLenum internalFormat, format;
     if(idata.channels == 1)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, idata.width, idata.height, 0, GL_RED, GL_UNSIGNED_BYTE, idata.data);
+    {
+        internalFormat = GL_R8;
+        format = GL_RED;
+    }
     else if(idata.channels == 2)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, idata.width, idata.height, 0, GL_RG, GL_UNSIGNED_BYTE, idata.data);
+    {
+        internalFormat = GL_RG8;
+        format = GL_RG;
+    }
     else if(idata.channels == 3)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, idata.width, idata.height, 0, GL_RGB, GL_UNSIGNED_BYTE, idata.data);
+    {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+    }
     else if(idata.channels == 4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, idata.width, idata.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, idata.data);
+    {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+    }
     else
     {
-        printf("Image loaded isn't in any of the supported formats!\n(Supported: RGB, RGBA)\n");
-        stbi_image_free(idata.data);
-
-        glDeleteTextures(1, &ID);
+        printf("Image loaded isn't in any of the supported formats!\n(Supported: R, RG, RGB, RGBA)\n");
+        StagingRelease(idata.memory);
         exit(-1);
     }
 
-    glGenerateMipmap(ID);
+    // Generate texture from loaded data
+    ID = GenTexture();
+    BindTexture(0, GL_TEXTURE_2D, ID);
+
+    SetTextureFiltering(idata.levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    if(idata.data != nullptr)
+    // Single channel images are gray, spread back out to the rgb the shaders read
+    if(idata.channels == 1)
     {
-        if(stb_free)
-            stbi_image_free(idata.data);
-        else
-            delete[] idata.data;
+        GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
     }
 
-    printf("Loaded texture file at: %s\n", path);
-    return { (unsigned int)idata.width, (unsigned int)idata.height, (unsigned int)idata.channels, ID, index, String("") };
+    // Smaller mip levels of RGB images have rows that aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    int width = idata.width;
+    int height = idata.height;
+    for(unsigned int level = 0; level < idata.levels; level++)
+    {
+        size_t offset = CalculateMipOffset(idata.width, idata.height, idata.channels, level);
+        StagingUploadTexture(idata.memory, offset, GL_TEXTURE_2D, (int)level, (int)internalFormat, width, height, format, GL_UNSIGNED_BYTE);
+
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    size_t memorySize = CalculateMipOffset(idata.width, idata.height, idata.channels, idata.levels);
+    StagingRelease(idata.memory);
+    idata.times.upload = GetLoadTimerMilliseconds() - start;
+
+    printf("Loaded texture: %s (%dx%d, %d channels, %u mips, %.2f MiB)\n", name, idata.width, idata.height, idata.channels, idata.levels,
+           (double)memorySize / (1024.0 * 1024.0));
+    return { (unsigned int)idata.width, (unsigned int)idata.height, (unsigned int)idata.channels, ID, idata.levels, memorySize, String(name), idata.times };
 }
 
-Texture LoadCubemapFromFiles(const char* folderPath)
+Texture LoadTextureFromFile(const char* path, TextureType type)
+{
+    double start = GetLoadTimerMilliseconds();
+    MappedFile file;
+    if(!MapFile(path, file))
+    {
+        printf("Failed to open texture at path: %s\n", path);
+        exit(-1);
+    }
+
+    // OpenGL textures start from lower left corner
+    ImageData idata = {};
+    idata.times.read = GetLoadTimerMilliseconds() - start;
+    bool decoded = CheckForCache(path, type, true, true, idata, file.data, file.size);
+    UnmapFile(file);
+    if(!decoded)
+        exit(-1);
+    return CreateTextureFromImage(idata, path);
+}
+
+void LoadTexturesFromFiles(const TextureRequest* requests, size_t count, Texture* textures)
 {
-    stbi_set_flip_vertically_on_load(false);
+    std::vector<ImageData> images(count, ImageData{});
+    ParallelFor(count, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+            DecodeImage(requests[i].path, requests[i].type, true, true, images[i]);
+    }, "Image decode");
 
-    std::string path;
+    // Staging and uploads stay on this thread, in request order
+    for(size_t i = 0; i < count; i++)
+    {
+        if(images[i].pixels == nullptr)
+            exit(-1);
+        StageImage(images[i]);
+        textures[i] = CreateTextureFromImage(images[i], requests[i].path);
+    }
+}
+
+Texture LoadTextureFromMemory(const unsigned char* data, size_t size, const char* name, TextureType type)
+{
+    // Embedded images keep their top left origin, their meshes' UVs already account for it.
+    // They come from user files, so ones that can't be decoded come back without a texture.
     ImageData idata = {};
-    bool stb_free = false;
-    unsigned int index = Texture::GlobalTextureIndex++;
+    if(!CheckForCache(name, type, true, false, idata, data, size))
+        return {};
+    return CreateTextureFromImage(idata, name);
+}
 
-    std::string paths[]
+Texture CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, const char* name)
+{
+    ImageData idata = { StagingAlloc(3), nullptr, 1, 1, 3, 1, {} };
+    idata.memory.data[0] = r;
+    idata.memory.data[1] = g;
+    idata.memory.data[2] = b;
+    return CreateTextureFromImage(idata, name);
+}
+
+static const char* CubemapFaceNames[6] = { "posx", "negx", "posy", "negy", "posz", "negz" };
+
+// The faces are decoded in parallel, leaving them in regular memory
+static void DecodeCubemapFaces(const char* folderPath, ImageData faces[6])
+{
+    ParallelFor(6, 1, [&](size_t begin, size_t end)
     {
-        "posx",
-        "negx",
-        "posy",
-        "negy",
-        "posz",
-        "negz"
-    };
+        for(size_t i = begin; i < end; i++)
+        {
+            std::string path = std::string(folderPath) + "/" + CubemapFaceNames[i] + ".jpg";
+            DecodeImage(path.c_str(), TextureType::Color, false, false, faces[i]);
+        }
+    }, "Image decode");
 
-    GLuint ID;
-    glGenTextures(1, &ID);
-    glActiveTexture(GL_TEXTURE0 + index);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
+    for(unsigned int i = 0; i < 6; i++)
+    {
+        if(faces[i].pixels == nullptr)
+        {
+            printf("Failed to load part of cubemap at path: %s/%s.jpg\n", folderPath, CubemapFaceNames[i]);
+            exit(-1);
+        }
+    }
+}
+
+// Uploads the decoded faces in order, freeing them as it goes
+static Texture CreateCubemapFromFaces(const char* folderPath, ImageData faces[6])
+{
+    // The faces were decoded in parallel, their times add up to the work done
+    AssetLoadTimes times = {};
+    times.cached = true;
+    for(unsigned int i = 0; i < 6; i++)
+    {
+        times.read += faces[i].times.read;
+        times.decode += faces[i].times.decode;
+        times.build += faces[i].times.build;
+        times.cached = times.cached && faces[i].times.cached;
+    }
+
+    double start = GetLoadTimerMilliseconds();
+    GLuint ID = GenTexture();
+    BindTexture(0, GL_TEXTURE_CUBE_MAP, ID);
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -272,171 +578,235 @@ Texture LoadCubemapFromFiles(const char* folderPath)
 
     for(unsigned int i = 0; i < 6; i++)
     {
-        // The cached version's path
-        path = std::string(folderPath) + "/" + paths[i] + ".jpg";
-        std::string binPath = std::string(folderPath) + "/" + paths[i] + ".bin";
-        
-        CheckForCache(path.c_str(), binPath.c_str(), stb_free, idata);
+        ImageData& idata = faces[i];
+        StageImage(idata);
+        StagingUploadTexture(idata.memory, 0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, idata.width, idata.height, GL_RGB, GL_UNSIGNED_BYTE);
+        StagingRelease(idata.memory);
+    }
+
+    times.upload = GetLoadTimerMilliseconds() - start;
+
+    const ImageData& idata = faces[0];
+    size_t memorySize = 6 * (size_t)idata.width * idata.height * idata.channels;
+    printf("Loaded cubemap from folder: %s\n", folderPath);
+    return { (unsigned)idata.width, (unsigned)idata.height, (unsigned)idata.channels, ID, 1, memorySize, String(folderPath), times };
+}
+
+Texture LoadCubemapFromFiles(const char* folderPath)
+{
+    ImageData faces[6] = {};
+    DecodeCubemapFaces(folderPath, faces);
+    return CreateCubemapFromFaces(folderPath, faces);
+}
+
+// Uploads the prefiltered levels as half floats, sampled with trilinear filtering across levels
+static Texture CreateSpecularCubemap(const EnvironmentLighting& lighting, const char* name)
+{
+    GLuint ID = GenTexture();
+    BindTexture(0, GL_TEXTURE_CUBE_MAP, ID);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (int)lighting.specularLevels - 1);
+
+    StagingAllocation memory = StagingAlloc(lighting.specular.size() * sizeof(float));
+    memcpy(memory.data, lighting.specular.data(), lighting.specular.size() * sizeof(float));
 
-        if(idata.data == nullptr)
+    size_t offset = 0;
+    size_t memorySize = 0;
+    for(unsigned int level = 0; level < lighting.specularLevels; level++)
+    {
+        int size = lighting.specularSize >> level;
+        size_t faceSize = (size_t)size * size * 3 * sizeof(float);
+        for(unsigned int face = 0; face < 6; face++)
         {
-            printf("Failed to load part of cubemap at path: %s\n", path.c_str());
-            exit(-1);
+            StagingUploadTexture(memory, offset, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (int)level, GL_RGB16F, size, size, GL_RGB, GL_FLOAT);
+            offset += faceSize;
         }
+        memorySize += (size_t)6 * size * size * 3 * 2;
+    }
+    StagingRelease(memory);
 
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, idata.width, idata.height, 0, GL_RGB, GL_UNSIGNED_BYTE, idata.data);
+    std::string specularName = std::string(name) + " (specular)";
+    return { (unsigned)lighting.specularSize, (unsigned)lighting.specularSize, 3, ID, lighting.specularLevels, memorySize, String(specularName.c_str()), {} };
+}
 
-        if(idata.data != nullptr)
+Environment LoadEnvironmentFromFiles(const char* folderPath)
+{
+    ImageData faces[6] = {};
+    DecodeCubemapFaces(folderPath, faces);
+
+    const unsigned char* pixels[6];
+    for(unsigned int i = 0; i < 6; i++)
+    {
+        if(faces[i].width != faces[0].width || faces[i].height != faces[0].width || faces[i].channels != faces[0].channels)
         {
-            if(stb_free)
-                stbi_image_free(idata.data);
-            else
-                delete[] idata.data;
+            printf("Cubemap faces at path: %s aren't squares of the same size\n", folderPath);
+            exit(-1);
         }
+        pixels[i] = faces[i].pixels;
     }
 
-    printf("Loaded cubemap from folder: %s\n", folderPath);
-    return { (unsigned)idata.width, (unsigned)idata.height, (unsigned)idata.channels, ID, index, String(folderPath) };
+    // The lighting is derived before the faces are handed over to upload memory
+    EnvironmentLighting lighting;
+    LoadEnvironmentLighting(pixels, faces[0].width, faces[0].channels, folderPath, lighting);
+
+    Environment result;
+    result.skybox = CreateCubemapFromFaces(folderPath, faces);
+    result.specular = CreateSpecularCubemap(lighting, folderPath);
+    for(int i = 0; i < 9; i++)
+        result.irradiance[i] = lighting.irradiance[i];
+    return result;
+}
+
+Texture CreateBRDFLookupTexture(int size)
+{
+    std::vector<float> lookup;
+    LoadBRDFLookup(size, lookup);
+
+    GLuint ID = GenTexture();
+    BindTexture(0, GL_TEXTURE_2D, ID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    StagingAllocation memory = StagingAlloc(lookup.size() * sizeof(float));
+    memcpy(memory.data, lookup.data(), lookup.size() * sizeof(float));
+    StagingUploadTexture(memory, 0, GL_TEXTURE_2D, 0, GL_RG16F, size, size, GL_RG, GL_FLOAT);
+    StagingRelease(memory);
+
+    size_t memorySize = (size_t)size * size * 2 * 2;
+    return { (unsigned)size, (unsigned)size, 2, ID, 1, memorySize, String("BRDF lookup"), {} };
+}
+
+// Files whose parse would need more memory than this are imported in streaming windows
+static size_t meshMemoryBudget = (size_t)2 * 1024 * 1024 * 1024;
+
+void SetMeshMemoryBudget(size_t bytes)
+{
+    meshMemoryBudget = bytes;
 }
 
 Mesh LoadMeshFromOBJ(const char* path)
 {
-    FILE* objRaw = fopen(path, "r");
+    // Files come from users, failures come back as a mesh without buffers instead of exiting
+    double start = GetLoadTimerMilliseconds();
+    FILE* objRaw = fopen(path, "rb");
     if(!objRaw)
     {
         printf("Failed to open OBJ file at path: %s\n", path);
-        exit(-1);
+        return {};
     }
 
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-
-    std::vector<unsigned int> vertexIndices;
-    std::vector<unsigned int> textureIndices;
-    std::vector<unsigned int> normalIndices;
+    fseek(objRaw, 0, SEEK_END);
+    size_t fileSize = (size_t)ftell(objRaw);
+    rewind(objRaw);
 
-    char buffer[100];
-    while(fscanf(objRaw, "%s ", buffer) != EOF)
+    // The file itself, the parsed arrays and the welding, tangent and upload
+    // memory add up to around eight times the size of the text
+    if(fileSize > meshMemoryBudget / 8)
     {
-        buffer[strlen(buffer)] = '\0';
-        if(!strcmp(buffer, "v"))
-        {
-            float x, y, z;
-            if(fscanf(objRaw, "%f %f %f\n", &x, &y, &z) == EOF)
-                printf("Invalid format detected in OBJ file!\n");
+        fclose(objRaw);
+        return LoadMeshFromOBJStreaming(path, meshMemoryBudget);
+    }
 
-            vertices.emplace_back(x, y, z);
-        }
-        else if(!strcmp(buffer, "vt"))
-        {
-            float u, v;
-            if(fscanf(objRaw, "%f %f\n", &u, &v) == EOF)
-                printf("Invalid format detected in OBJ file!\n");
+    // All parse temporaries come from one arena. Indices, welded vertices, tangent and
+    // cluster scratch take up at most about five times the size of the text they were
+    // parsed from, so together with the file itself a single block almost always suffices.
+    Arena arena = CreateArena(fileSize * 6 + 4096);
 
-            uvs.emplace_back(u, v);
-        }
-        else if(!strcmp(buffer, "vn"))
-        {
-            float x, y, z;
-            if(fscanf(objRaw, "%f %f %f\n", &x, &y, &z) == EOF)
-                printf("Invalid format detected in OBJ file!\n");
-
-            normals.emplace_back(x, y, z);
-        }
-        else if(!strcmp(buffer, "f"))
-        {
-            int v1, v2, v3, t1, t2, t3, n1, n2, n3;
-            if(fscanf(objRaw, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &v1, &t1, &n1, &v2, &t2, &n2, &v3, &t3, &n3) == EOF)
-                printf("Invalid format detected in OBJ file!\n");
+    char* text = ArenaPushArray<char>(arena, fileSize + 1);
+    size_t readSize = fread(text, 1, fileSize, objRaw);
+    if(readSize != fileSize)
+        printf("Bytes needed to be read: %zu\nBytes successfully read: %zu\n", fileSize, readSize);
+    text[readSize] = '\0';
+    fclose(objRaw);
 
-            vertexIndices.push_back(v1 - 1);
-            vertexIndices.push_back(v2 - 1);
-            vertexIndices.push_back(v3 - 1);
+    // Meshes are cached with their clusters, skipping parsing and building entirely
+    AssetCacheKey cacheKey = GetMeshCacheKey(text, readSize);
+    AssetLoadTimes times = {};
+    double read = GetLoadTimerMilliseconds();
+    times.read = read - start;
+    Mesh result;
+    if(ReadMeshCache(cacheKey, path, result))
+    {
+        DestroyArena(arena);
+        printf("Loaded cached mesh for .obj file at: %s (%zu clusters)\n", path, result.clusters.meshlets.size());
+        times.upload = GetLoadTimerMilliseconds() - read;
+        times.cached = true;
+        result.name = path;
+        result.loadTimes = times;
+        return result;
+    }
 
-            textureIndices.push_back(t1 - 1);
-            textureIndices.push_back(t2 - 1);
-            textureIndices.push_back(t3 - 1);
+    // Background loads can be cancelled between stages
+    ReportLoadProgress(0.2f);
+    if(IsLoadCancelled())
+    {
+        DestroyArena(arena);
+        return {};
+    }
 
-            normalIndices.push_back(n1 - 1);
-            normalIndices.push_back(n2 - 1);
-            normalIndices.push_back(n3 - 1);
-        }
+    OBJData data = ParseOBJText(text, text + readSize, {}, arena);
+    double parsed = GetLoadTimerMilliseconds();
+    times.decode = parsed - read;
+    PrintOBJErrors(data, path);
+    size_t numCorners = data.counts.triangles * 3;
+    if(numCorners == 0)
+    {
+        printf("No valid faces in OBJ file at path: %s\n", path);
+        DestroyArena(arena);
+        return {};
     }
 
-    fclose(objRaw);
+    ReportLoadProgress(0.5f);
+    if(IsLoadCancelled())
+    {
+        DestroyArena(arena);
+        return {};
+    }
 
-    // A big thank you to this answer for the algorithm.
-    // https://stackoverflow.com/a/23356738
-    std::vector<glm::vec3> finalVertices;
-    std::vector<glm::vec2> finalUVs;
-    std::vector<glm::vec3> finalNormals;
-    std::vector<unsigned int> finalIndices;
-
-    for(size_t i = 0; i < vertexIndices.size(); i++)
-    {
-        int vindex = vertexIndices[i];
-        int uvindex = textureIndices[i];
-        int nindex = normalIndices[i];
-        
-        finalVertices.push_back(vertices[vindex]);
-        finalUVs.push_back(uvs[uvindex]);
-        finalNormals.push_back(normals[nindex]);
-    }
-
-    std::vector<glm::vec3> tangents;
-    std::vector<glm::vec3> bitangents;
-    for(size_t i = 0; i < finalVertices.size() - 2; i += 3)
-    {
-        glm::vec3& P1 = finalVertices[i];
-        glm::vec3& P2 = finalVertices[i + 1];
-        glm::vec3& P3 = finalVertices[i + 2];
-
-        // Calculate tangent and bitangent vectors
-        glm::vec2& uv1 = finalUVs[i + 0];
-        glm::vec2& uv2 = finalUVs[i + 1];
-        glm::vec2& uv3 = finalUVs[i + 2];
-
-        glm::vec3 edge1 = P2 - P1;
-        glm::vec3 edge2 = P3 - P1;
-        glm::vec2 deltaUV1 = uv2 - uv1;
-        glm::vec2 deltaUV2 = uv3 - uv1;
-
-        /*  Resolve the following:
-                Q1 = uv1.x * T + uv1.y * B
-                Q2 = uv2.x * T + uv2.y * B
-
-            Rewrite as a matrix multiplication:
-                | Q1.x Q1.y Q1.z |   | uv1.x uv1.y |   | T.x T.y T.z |
-                | Q2.x Q2.y Q2.z | = | uv2.x uv2.y | * | B.x B.y B.z |
-
-            Multiply both sides with inverse uv matrix
-                | T.x T.y T.z |       | uv2.y -uv1.y |   | Q1.x Q1.y Q1.z |
-                | B.x B.y B.z | = f * | -uv2.x uv1.x | * | Q2.x Q2.y Q2.z |
-            for f = 1 / (uv1.x * uv2.y - uv2.x * uv1.y)
-        */
-
-        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        glm::vec3 tangent, bitangent;
-        tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
-    }
-
-    printf("Loaded indexed mesh from .obj file at: %s\n", path);
-
-    Mesh result = GenerateMesh(finalVertices, finalUVs, finalNormals, tangents, bitangents);
-    strncpy(result.name, path, 127);
+    // The vertices and indices go straight into upload memory, the BVH and cache are built from the arena's copies
+    MeshClusters clusters;
+    OBJMesh mesh = BuildOBJMesh(data.vertices, data.uvs, data.normals, data.corners, numCorners, 0, 0, clusters, arena);
+    const float* px = mesh.components;
+    const float* py = px + mesh.numVertices;
+    const float* pz = py + mesh.numVertices;
+    const unsigned int* localIndices = mesh.localIndices;
+    size_t numTriangles = mesh.numIndices / 3;
+
+    MeshBVH bvh;
+    BeginMeshBVH(bvh, numTriangles);
+    ParallelFor(numTriangles, 4096, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            unsigned int a = localIndices[i * 3], b = localIndices[i * 3 + 1], c = localIndices[i * 3 + 2];
+            SetBVHTriangle(bvh, i, glm::vec3(px[a], py[a], pz[a]), glm::vec3(px[b], py[b], pz[b]), glm::vec3(px[c], py[c], pz[c]));
+        }
+    }, "OBJ BVH triangles");
+    BuildMeshBVH(bvh);
+    WriteMeshCache(cacheKey, path, mesh.components, mesh.tangents, mesh.numVertices, localIndices, mesh.numIndices, clusters, bvh);
+    ReportLoadProgress(0.9f);
+    double built = GetLoadTimerMilliseconds();
+    times.build = built - parsed;
+
+    printf("Loaded indexed mesh from .obj file at: %s (%zu vertices, %zu clusters)\n", path, mesh.numVertices, clusters.meshlets.size());
+    printf("OBJ scratch memory: %.2f MiB peak in %u block(s)\n", (double)arena.peak / (1024.0 * 1024.0), arena.numBlocks);
+    DestroyArena(arena);
+
+    result = EndMeshUpload(mesh.upload);
+    CreateMeshIndices(result, (unsigned int)mesh.numIndices);
+    UploadMeshIndexRange(result, mesh.indices, 0, (unsigned int)mesh.numIndices);
+    result.clusters = std::move(clusters);
+    result.bvh = std::move(bvh);
+    result.name = path;
+    times.upload = GetLoadTimerMilliseconds() - built;
+    result.loadTimes = times;
     return result;
-}
\ No newline at end of file
+}
@@ -1,18 +1,32 @@
 #pragma once
-#include "shader.h"
-#include "texture.h"
-#include "../Mesh/mesh.h"
+#include "environment.h"
+#include "model.h"
+#include <cstddef>
 
-struct Model
+// The shared source, if any, goes into the fragment shader right after its #version line
+struct Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentShaderPath, const char* sharedPath = nullptr);
+Texture LoadTextureFromFile(const char* path, TextureType type = TextureType::Color);
+
+struct TextureRequest
 {
-    Mesh mesh;
-    Texture diffuse;
-    Texture normal;
-    Texture specular;
+    const char* path;
+    TextureType type;
 };
 
-struct Shader LoadShadersFromFiles(const char* vertexShaderPath, const char* fragmentShaderPath);
-Texture LoadTextureFromFile(const char* path);
+// Decodes the images across the job system, then uploads them in request order
+void LoadTexturesFromFiles(const TextureRequest* requests, size_t count, Texture* textures);
+Texture LoadTextureFromMemory(const unsigned char* data, size_t size, const char* name, TextureType type);
+Texture CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, const char* name);
 Texture LoadCubemapFromFiles(const char* folderPath);
+
+// Loads a cubemap as a skybox along with the image based lighting derived from it
+Environment LoadEnvironmentFromFiles(const char* folderPath);
+
+// Split sum lookup texture shared by every environment's specular lighting
+Texture CreateBRDFLookupTexture(int size = 128);
 Mesh LoadMeshFromOBJ(const char* path);
-MeshIndexed LoadMeshIndexedFromOBJ(const char* path);
\ No newline at end of file
+void SetMeshMemoryBudget(size_t bytes);
+MeshIndexed LoadMeshIndexedFromOBJ(const char* path);
+
+// Loads a binary .glb or a .gltf file with its materials and node hierarchy
+Model LoadModelFromGLTF(const char* path);
\ No newline at end of file
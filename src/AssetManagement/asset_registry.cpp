@@ -0,0 +1,305 @@
+#include "asset_registry.h"
+#include "asset_loader.h"
+#include "asset_stats.h"
+#include "../Renderer/gl_state.h"
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template<typename T>
+struct AssetSlot
+{
+    T asset;
+    String key;
+    unsigned int generation;
+    unsigned int references;
+};
+
+// Slots live in a deque so assets keep their address while others are added
+template<typename T>
+struct AssetPool
+{
+    std::deque<AssetSlot<T>> slots;
+    std::vector<unsigned int> freeSlots;
+    std::unordered_map<String, unsigned int> keys;
+};
+
+// One lock for everything, the loader thread registers while the render thread resolves handles
+static struct
+{
+    std::mutex mutex;
+    AssetPool<Texture> textures;
+    AssetPool<Mesh> meshes;
+} registry;
+
+static void DeleteAsset(Texture& texture)
+{
+    DeleteTextures(1, &texture.ID);
+}
+
+static void DeleteAsset(Mesh& mesh)
+{
+    DeleteMesh(mesh);
+}
+
+template<typename T>
+static AssetSlot<T>* GetSlot(AssetPool<T>& pool, unsigned int index, unsigned int generation)
+{
+    if(index >= pool.slots.size())
+        return nullptr;
+
+    AssetSlot<T>& slot = pool.slots[index];
+    return slot.generation == generation && slot.references > 0 ? &slot : nullptr;
+}
+
+template<typename Handle, typename T>
+static Handle Find(AssetPool<T>& pool, const String& key)
+{
+    auto found = pool.keys.find(key);
+    if(found == pool.keys.end())
+        return { 0, 0 };
+
+    AssetSlot<T>& slot = pool.slots[found->second];
+    slot.references++;
+    return { found->second, slot.generation };
+}
+
+template<typename Handle, typename T>
+static Handle Register(AssetPool<T>& pool, const String& key, T&& asset)
+{
+    Handle existing = Find<Handle>(pool, key);
+    if(existing.generation != 0)
+    {
+        DeleteAsset(asset);
+        return existing;
+    }
+
+    unsigned int index;
+    if(!pool.freeSlots.empty())
+    {
+        index = pool.freeSlots.back();
+        pool.freeSlots.pop_back();
+    }
+    else
+    {
+        index = (unsigned int)pool.slots.size();
+        pool.slots.push_back({ T(), String(), 0, 0 });
+    }
+
+    // Generations start at 1, leaving the zero handle invalid
+    AssetSlot<T>& slot = pool.slots[index];
+    slot.asset = std::move(asset);
+    slot.key = key;
+    slot.generation++;
+    slot.references = 1;
+    pool.keys.emplace(key, index);
+    return { index, slot.generation };
+}
+
+template<typename T>
+static void Retain(AssetPool<T>& pool, unsigned int index, unsigned int generation)
+{
+    AssetSlot<T>* slot = GetSlot(pool, index, generation);
+    if(slot != nullptr)
+        slot->references++;
+}
+
+template<typename T>
+static void Release(AssetPool<T>& pool, unsigned int index, unsigned int generation)
+{
+    AssetSlot<T>* slot = GetSlot(pool, index, generation);
+    if(slot == nullptr || --slot->references > 0)
+        return;
+
+    DeleteAsset(slot->asset);
+    pool.keys.erase(slot->key);
+    slot->asset = T();
+    slot->key = String();
+    pool.freeSlots.push_back(index);
+}
+
+TextureHandle FindTexture(const String& key)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return Find<TextureHandle>(registry.textures, key);
+}
+
+MeshHandle FindMesh(const String& key)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return Find<MeshHandle>(registry.meshes, key);
+}
+
+TextureHandle RegisterTexture(const String& key, const Texture& texture)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return Register<TextureHandle>(registry.textures, key, Texture(texture));
+}
+
+MeshHandle RegisterMesh(const String& key, Mesh mesh)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return Register<MeshHandle>(registry.meshes, key, std::move(mesh));
+}
+
+void RetainTexture(TextureHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Retain(registry.textures, handle.index, handle.generation);
+}
+
+void RetainMesh(MeshHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Retain(registry.meshes, handle.index, handle.generation);
+}
+
+void ReleaseTexture(TextureHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Release(registry.textures, handle.index, handle.generation);
+}
+
+void ReleaseMesh(MeshHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Release(registry.meshes, handle.index, handle.generation);
+}
+
+Texture* GetTexture(TextureHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    AssetSlot<Texture>* slot = GetSlot(registry.textures, handle.index, handle.generation);
+    return slot != nullptr ? &slot->asset : nullptr;
+}
+
+Mesh* GetMesh(MeshHandle handle)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    AssetSlot<Mesh>* slot = GetSlot(registry.meshes, handle.index, handle.generation);
+    return slot != nullptr ? &slot->asset : nullptr;
+}
+
+AssetRegistryStats GetAssetRegistryStats()
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    AssetRegistryStats result = { registry.textures.keys.size(), registry.meshes.keys.size(), 0 };
+    for(auto& slot : registry.textures.slots)
+        result.references += slot.references;
+    for(auto& slot : registry.meshes.slots)
+        result.references += slot.references;
+    return result;
+}
+
+AssetStats CollectAssetStats()
+{
+    AssetStats result = {};
+    {
+        // Assets are named by their registry keys, which tell glTF primitives and texture types apart
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for(auto& slot : registry.textures.slots)
+        {
+            if(slot.references == 0)
+                continue;
+            TextureStats stats = GetTextureStats(slot.asset);
+            stats.name = slot.key;
+            stats.references = slot.references;
+            result.textures.push_back(std::move(stats));
+        }
+        for(auto& slot : registry.meshes.slots)
+        {
+            if(slot.references == 0)
+                continue;
+            MeshStats stats = GetMeshStats(slot.asset);
+            stats.name = slot.key;
+            stats.references = slot.references;
+            result.meshes.push_back(std::move(stats));
+        }
+    }
+
+    for(auto& texture : result.textures)
+        result.textureMemory += texture.memory;
+    for(auto& mesh : result.meshes)
+    {
+        result.meshGPUMemory += mesh.vertexMemory + mesh.indexMemory;
+        result.meshCPUMemory += mesh.clusterMemory + mesh.bvhMemory;
+    }
+
+    // Largest first, so the assets worth budgeting show at the top
+    std::sort(result.textures.begin(), result.textures.end(), [](const TextureStats& a, const TextureStats& b) { return a.memory > b.memory; });
+    std::sort(result.meshes.begin(), result.meshes.end(), [](const MeshStats& a, const MeshStats& b)
+    {
+        return a.vertexMemory + a.indexMemory + a.clusterMemory + a.bvhMemory > b.vertexMemory + b.indexMemory + b.clusterMemory + b.bvhMemory;
+    });
+    return result;
+}
+
+static String GetTextureKey(const char* path, TextureType type)
+{
+    const char* typeNames[3] = { "color", "normal", "data" };
+    std::string key = std::string(path) + " (" + typeNames[(int)type] + ")";
+    return String(key.c_str(), key.size());
+}
+
+TextureHandle LoadTextureAsset(const char* path, TextureType type)
+{
+    String key = GetTextureKey(path, type);
+    TextureHandle handle = FindTexture(key);
+    if(handle.generation != 0)
+        return handle;
+
+    return RegisterTexture(key, LoadTextureFromFile(path, type));
+}
+
+void LoadTextureAssets(const TextureRequest* requests, size_t count, TextureHandle* handles)
+{
+    // Only the textures that aren't registered yet go into the batch
+    std::vector<TextureRequest> missing;
+    std::vector<size_t> missingIndices;
+    for(size_t i = 0; i < count; i++)
+    {
+        handles[i] = FindTexture(GetTextureKey(requests[i].path, requests[i].type));
+        if(handles[i].generation == 0)
+        {
+            missing.push_back(requests[i]);
+            missingIndices.push_back(i);
+        }
+    }
+
+    // Repeated requests register the first copy, the others get deleted
+    std::vector<Texture> textures(missing.size());
+    LoadTexturesFromFiles(missing.data(), missing.size(), textures.data());
+    for(size_t i = 0; i < missing.size(); i++)
+        handles[missingIndices[i]] = RegisterTexture(GetTextureKey(missing[i].path, missing[i].type), textures[i]);
+}
+
+TextureHandle LoadSolidTextureAsset(unsigned char r, unsigned char g, unsigned char b)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "solid color #%02x%02x%02x", r, g, b);
+    TextureHandle handle = FindTexture(name);
+    if(handle.generation != 0)
+        return handle;
+
+    return RegisterTexture(name, CreateSolidTexture(r, g, b, name));
+}
+
+MeshHandle LoadMeshAsset(const char* path)
+{
+    MeshHandle handle = FindMesh(path);
+    if(handle.generation != 0)
+        return handle;
+
+    // Cancelled loads come back without buffers
+    Mesh mesh = LoadMeshFromOBJ(path);
+    if(mesh.VBO[0] == 0)
+        return { 0, 0 };
+    return RegisterMesh(path, std::move(mesh));
+}
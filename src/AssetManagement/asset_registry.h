@@ -0,0 +1,61 @@
+#pragma once
+#include "texture.h"
+#include "../Mesh/mesh.h"
+#include "../String/string.h"
+#include <cstddef>
+
+// Handles name a registry slot and the generation it was handed out in. A freed
+// asset's slot moves on to the next generation, so stale handles resolve to null
+// rather than to whatever reuses the slot. The zero handle is never valid.
+struct TextureHandle
+{
+    unsigned int index;
+    unsigned int generation;
+};
+
+struct MeshHandle
+{
+    unsigned int index;
+    unsigned int generation;
+};
+
+// Loaded textures and meshes are shared by key, usually their path and import settings, and
+// reference counted. The last release deletes their GL objects. Vertex arrays belong to the
+// context drawing the mesh, so anything that may have been drawn is released on that context.
+
+// Returns the asset registered under key with a new reference, or a null handle
+TextureHandle FindTexture(const String& key);
+MeshHandle FindMesh(const String& key);
+
+// Takes over a loaded asset with one reference. If another thread registered
+// the same key first, the new asset is deleted and the registered one returned.
+TextureHandle RegisterTexture(const String& key, const Texture& texture);
+MeshHandle RegisterMesh(const String& key, Mesh mesh);
+
+void RetainTexture(TextureHandle handle);
+void RetainMesh(MeshHandle handle);
+void ReleaseTexture(TextureHandle handle);
+void ReleaseMesh(MeshHandle handle);
+
+// Null for stale handles. The pointers stay valid until the asset's last release.
+Texture* GetTexture(TextureHandle handle);
+Mesh* GetMesh(MeshHandle handle);
+
+struct AssetRegistryStats
+{
+    size_t textures;
+    size_t meshes;
+    size_t references;
+};
+AssetRegistryStats GetAssetRegistryStats();
+
+// Memory and load stats of every registered asset, see asset_stats.h
+struct AssetStats;
+AssetStats CollectAssetStats();
+
+// Registered versions of the asset loaders, only loading what isn't registered yet
+struct TextureRequest;
+TextureHandle LoadTextureAsset(const char* path, TextureType type = TextureType::Color);
+void LoadTextureAssets(const TextureRequest* requests, size_t count, TextureHandle* handles);
+TextureHandle LoadSolidTextureAsset(unsigned char r, unsigned char g, unsigned char b);
+MeshHandle LoadMeshAsset(const char* path);
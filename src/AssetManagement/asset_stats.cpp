@@ -0,0 +1,160 @@
+#include "asset_stats.h"
+#include "texture.h"
+#include "../Mesh/mesh.h"
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+
+double GetLoadTimerMilliseconds()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MeshStats GetMeshStats(const Mesh& mesh)
+{
+    MeshStats result = {};
+    result.name = mesh.name;
+    result.numVertices = mesh.numVertices;
+    result.numIndices = mesh.numIndices;
+    result.vertexMemory = mesh.vertexMemory;
+    result.indexMemory = mesh.indexMemory;
+    result.clusterMemory = GetMeshClustersMemory(mesh.clusters);
+    result.bvhMemory = GetMeshBVHMemory(mesh.bvh);
+
+    if(mesh.numIndices > mesh.numVertices)
+        result.duplicateVertexRatio = 1.0f - (float)mesh.numVertices / (float)mesh.numIndices;
+
+    // The root node bounds every triangle. Streamed meshes have no BVH, so
+    // their cluster spheres stand in, a little looser.
+    const MeshClusters& clusters = mesh.clusters;
+    if(!mesh.bvh.nodes.empty())
+    {
+        result.hasBounds = true;
+        result.boundsMin = mesh.bvh.nodes[0].min;
+        result.boundsMax = mesh.bvh.nodes[0].max;
+    }
+    else if(!clusters.meshlets.empty())
+    {
+        result.hasBounds = true;
+        result.boundsMin = glm::vec3(FLT_MAX);
+        result.boundsMax = glm::vec3(-FLT_MAX);
+        for(size_t i = 0; i < clusters.meshlets.size(); i++)
+        {
+            glm::vec3 center(clusters.centerX[i], clusters.centerY[i], clusters.centerZ[i]);
+            glm::vec3 radius(clusters.radius[i]);
+            result.boundsMin = glm::min(result.boundsMin, center - radius);
+            result.boundsMax = glm::max(result.boundsMax, center + radius);
+        }
+    }
+
+    result.loadTimes = mesh.loadTimes;
+    return result;
+}
+
+TextureStats GetTextureStats(const Texture& texture)
+{
+    TextureStats result = {};
+    result.name = texture.path;
+    result.width = texture.width;
+    result.height = texture.height;
+    result.channels = texture.channels;
+    result.levels = texture.levels;
+    result.memory = texture.memorySize;
+    result.loadTimes = texture.loadTimes;
+
+    // Every level stores the same bytes per texel, so the memory splits by texel count
+    std::vector<size_t> texels(texture.levels);
+    size_t totalTexels = 0;
+    size_t width = texture.width, height = texture.height;
+    for(unsigned int level = 0; level < texture.levels; level++)
+    {
+        texels[level] = width * height;
+        totalTexels += texels[level];
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    result.levelMemory.resize(texture.levels);
+    for(unsigned int level = 0; level < texture.levels; level++)
+        result.levelMemory[level] = totalTexels > 0 ? texture.memorySize * texels[level] / totalTexels : 0;
+    return result;
+}
+
+// Asset names are paths, which may hold backslashes or anything else a file system allows
+static void WriteJSONString(FILE* file, const String& string)
+{
+    fputc('"', file);
+    for(const char* c = string.C_Str(); *c != '\0'; c++)
+    {
+        if(*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if((unsigned char)*c < 0x20)
+            fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void WriteLoadTimes(FILE* file, const AssetLoadTimes& times)
+{
+    fprintf(file, "\"loadMs\": { \"read\": %.3f, \"decode\": %.3f, \"build\": %.3f, \"upload\": %.3f }, \"cached\": %s",
+            times.read, times.decode, times.build, times.upload, times.cached ? "true" : "false");
+}
+
+bool WriteAssetStats(const AssetStats& stats, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr)
+    {
+        printf("Failed to write asset stats to path: %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"textureMemory\": %zu,\n  \"meshGPUMemory\": %zu,\n  \"meshCPUMemory\": %zu,\n",
+            stats.textureMemory, stats.meshGPUMemory, stats.meshCPUMemory);
+
+    fprintf(file, "  \"textures\": [");
+    for(size_t i = 0; i < stats.textures.size(); i++)
+    {
+        const TextureStats& texture = stats.textures[i];
+        fprintf(file, "%s\n    { \"name\": ", i > 0 ? "," : "");
+        WriteJSONString(file, texture.name);
+        fprintf(file, ", \"references\": %u, \"width\": %u, \"height\": %u, \"channels\": %u, \"memory\": %zu, \"levelMemory\": [",
+                texture.references, texture.width, texture.height, texture.channels, texture.memory);
+        for(size_t level = 0; level < texture.levelMemory.size(); level++)
+            fprintf(file, "%s%zu", level > 0 ? ", " : "", texture.levelMemory[level]);
+        fprintf(file, "], ");
+        WriteLoadTimes(file, texture.loadTimes);
+        fprintf(file, " }");
+    }
+    fprintf(file, "\n  ],\n");
+
+    fprintf(file, "  \"meshes\": [");
+    for(size_t i = 0; i < stats.meshes.size(); i++)
+    {
+        const MeshStats& mesh = stats.meshes[i];
+        fprintf(file, "%s\n    { \"name\": ", i > 0 ? "," : "");
+        WriteJSONString(file, mesh.name);
+        fprintf(file, ", \"references\": %u, \"vertices\": %u, \"indices\": %u, \"vertexMemory\": %zu, \"indexMemory\": %zu, "
+                      "\"clusterMemory\": %zu, \"bvhMemory\": %zu, \"duplicateVertexRatio\": %.4f, ",
+                mesh.references, mesh.numVertices, mesh.numIndices, mesh.vertexMemory, mesh.indexMemory,
+                mesh.clusterMemory, mesh.bvhMemory, mesh.duplicateVertexRatio);
+        if(mesh.hasBounds)
+        {
+            fprintf(file, "\"bounds\": { \"min\": [%g, %g, %g], \"max\": [%g, %g, %g] }, ",
+                    mesh.boundsMin.x, mesh.boundsMin.y, mesh.boundsMin.z, mesh.boundsMax.x, mesh.boundsMax.y, mesh.boundsMax.z);
+        }
+        WriteLoadTimes(file, mesh.loadTimes);
+        fprintf(file, " }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    bool written = ferror(file) == 0;
+    if(fclose(file) != 0 || !written)
+    {
+        printf("Failed to write asset stats to path: %s\n", path);
+        return false;
+    }
+    return true;
+}
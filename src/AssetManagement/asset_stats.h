@@ -0,0 +1,69 @@
+#pragma once
+#include "../String/string.h"
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <vector>
+
+struct Mesh;
+struct Texture;
+
+// Milliseconds an asset spent in each stage of its load, zero for stages it skipped
+struct AssetLoadTimes
+{
+    double read;   // Reading or mapping the file
+    double decode; // Parsing the text or decoding the image, shared by all primitives of a glTF file
+    double build;  // Welding, tangents, clusters and BVH, or filtering the mip chain
+    double upload; // Copying to GPU buffers and textures
+    bool cached;   // Built from the asset cache rather than the source file
+};
+
+// Milliseconds on a steady clock, for timing load stages
+double GetLoadTimerMilliseconds();
+
+struct MeshStats
+{
+    String name;
+    unsigned int references;
+    unsigned int numVertices, numIndices;
+
+    // GPU buffers, then what's kept on the CPU for culling and picking
+    size_t vertexMemory, indexMemory;
+    size_t clusterMemory, bvhMemory;
+
+    // Share of the index buffer's corners reusing a vertex of an earlier corner, 0 for unindexed meshes
+    float duplicateVertexRatio;
+
+    // Object space bounds, from the BVH or else the cluster spheres
+    bool hasBounds;
+    glm::vec3 boundsMin, boundsMax;
+
+    AssetLoadTimes loadTimes;
+};
+
+struct TextureStats
+{
+    String name;
+    unsigned int references;
+    unsigned int width, height, channels, levels;
+    size_t memory;
+
+    // GPU memory of each mip level, across all faces of cubemaps
+    std::vector<size_t> levelMemory;
+
+    AssetLoadTimes loadTimes;
+};
+
+MeshStats GetMeshStats(const Mesh& mesh);
+TextureStats GetTextureStats(const Texture& texture);
+
+// Every registered asset, largest first, with the totals
+struct AssetStats
+{
+    std::vector<TextureStats> textures;
+    std::vector<MeshStats> meshes;
+    size_t textureMemory;
+    size_t meshGPUMemory, meshCPUMemory;
+};
+
+// Writes the stats as JSON for budget tooling, returns false if the file can't be written
+bool WriteAssetStats(const AssetStats& stats, const char* path);
@@ -0,0 +1,257 @@
+#include "async_loader.h"
+#include "asset_loader.h"
+#include "../Display/display.h"
+#include "../Renderer/render_thread.h"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Loads run one at a time on their own thread and GL context, so a slow
+// file never holds up the main or render thread
+static struct
+{
+    std::thread thread;
+    GLFWwindow* context = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+    std::deque<AsyncLoad*> queue;
+    std::vector<std::unique_ptr<AsyncLoad>> loads;
+
+    Model placeholder;
+} loader;
+
+// The load the loader thread is working on, null on every other thread
+static thread_local AsyncLoad* currentLoad = nullptr;
+
+// A unit cube with face normals, lit like any other model
+static Mesh GeneratePlaceholderCube()
+{
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec4> tangents;
+
+    const glm::vec2 corners[6] = { {0, 0}, {1, 0}, {1, 1}, {1, 1}, {0, 1}, {0, 0} };
+    for(int axis = 0; axis < 3; axis++)
+    {
+        for(float side : { -1.0f, 1.0f })
+        {
+            glm::vec3 normal(0.0f), u(0.0f), v(0.0f);
+            normal[axis] = side;
+            u[(axis + 1) % 3] = side;
+            v[(axis + 2) % 3] = 1.0f;
+
+            for(const glm::vec2& corner : corners)
+            {
+                vertices.push_back(normal + u * (corner.x * 2.0f - 1.0f) + v * (corner.y * 2.0f - 1.0f));
+                uvs.push_back(corner);
+                normals.push_back(normal);
+                tangents.push_back(glm::vec4(u, 1.0f));
+            }
+        }
+    }
+
+    Mesh result = GenerateMesh(vertices, uvs, normals, tangents);
+    result.name = "Loading...";
+    return result;
+}
+
+static bool HasExtension(const char* path, const char* extension)
+{
+    size_t pathLength = strlen(path);
+    size_t extensionLength = strlen(extension);
+    if(pathLength < extensionLength)
+        return false;
+
+    const char* suffix = path + pathLength - extensionLength;
+    for(size_t i = 0; i < extensionLength; i++)
+    {
+        if(tolower((unsigned char)suffix[i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+static void RunLoad(AsyncLoad& load)
+{
+    const char* path = load.path.C_Str();
+    bool isOBJ = HasExtension(path, ".obj");
+    bool isGLTF = HasExtension(path, ".gltf") || HasExtension(path, ".glb");
+
+    // The path belongs to the load, which the main thread may free as soon as it sees the
+    // load end, so everything is printed before the state is published
+    if(!isOBJ && !isGLTF)
+    {
+        printf("Can't load model at path: %s\n", path);
+        load.state = AsyncLoadState::Failed;
+        return;
+    }
+
+    Model model = {};
+    if(isOBJ)
+    {
+        // OBJ files come without textures, they share the placeholder's
+        model.name = path;
+        model.mesh = LoadMeshAsset(path);
+        model.diffuse = loader.placeholder.diffuse;
+        model.normal = loader.placeholder.normal;
+        model.specular = loader.placeholder.specular;
+        RetainTexture(model.diffuse);
+        RetainTexture(model.normal);
+        RetainTexture(model.specular);
+    }
+    else
+        model = LoadModelFromGLTF(path);
+
+    if(IsLoadCancelled())
+    {
+        // Assets shared with drawn models stay alive, so nothing released here was drawn on this context
+        ReleaseModel(model);
+        printf("Cancelled loading %s\n", path);
+        load.state = AsyncLoadState::Cancelled;
+        return;
+    }
+
+    // Files that can't be opened or parsed come back without any meshes
+    if(model.mesh.generation == 0 && model.children.empty())
+    {
+        ReleaseModel(model);
+        printf("Can't load model at path: %s\n", path);
+        load.state = AsyncLoadState::Failed;
+        return;
+    }
+
+    // Everything has to reach the GPU before another context draws with it. Vertex
+    // arrays are made by the drawing context the first time it binds the meshes.
+    glFinish();
+
+    load.model = std::move(model);
+    load.progress = 1.0f;
+    load.state = AsyncLoadState::Ready;
+}
+
+static void LoaderThreadMain()
+{
+    glfwMakeContextCurrent(loader.context);
+
+    while(true)
+    {
+        AsyncLoad* load;
+        {
+            std::unique_lock<std::mutex> lock(loader.mutex);
+            loader.wake.wait(lock, [] { return !loader.running || !loader.queue.empty(); });
+            if(!loader.running)
+                break;
+            load = loader.queue.front();
+            loader.queue.pop_front();
+        }
+
+        if(load->cancelRequested)
+            load->state = AsyncLoadState::Cancelled;
+        else
+        {
+            load->state = AsyncLoadState::Loading;
+            currentLoad = load;
+            RunLoad(*load);
+            currentLoad = nullptr;
+        }
+
+        // The main thread may be idling until something changes
+        glfwPostEmptyEvent();
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+void StartAsyncLoader(Display& display)
+{
+    // Made on the display's context, where it's drawn from
+    loader.placeholder.name = "Loading...";
+    loader.placeholder.mesh = RegisterMesh("placeholder cube", GeneratePlaceholderCube());
+    loader.placeholder.diffuse = LoadSolidTextureAsset(255, 255, 255);
+    loader.placeholder.normal = LoadSolidTextureAsset(128, 128, 255);
+    loader.placeholder.specular = LoadSolidTextureAsset(255, 128, 0);
+
+    loader.context = CreateSharedContext(display);
+    loader.running = true;
+    loader.thread = std::thread(LoaderThreadMain);
+}
+
+void StopAsyncLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        for(auto& load : loader.loads)
+            load->cancelRequested = true;
+        loader.running = false;
+    }
+    loader.wake.notify_all();
+    loader.thread.join();
+
+    glfwDestroyWindow(loader.context);
+    loader.context = nullptr;
+    loader.queue.clear();
+    loader.loads.clear();
+}
+
+AsyncLoad* QueueModelLoad(const char* path)
+{
+    AsyncLoad* load = new AsyncLoad();
+    load->path = path;
+
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.loads.emplace_back(load);
+        loader.queue.push_back(load);
+    }
+    loader.wake.notify_all();
+    return load;
+}
+
+void CancelLoad(AsyncLoad* load)
+{
+    load->cancelRequested = true;
+}
+
+void FreeLoad(AsyncLoad* load)
+{
+    if(load == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(loader.mutex);
+    for(size_t i = 0; i < loader.loads.size(); i++)
+    {
+        if(loader.loads[i].get() == load)
+        {
+            loader.loads[i] = std::move(loader.loads.back());
+            loader.loads.pop_back();
+            return;
+        }
+    }
+}
+
+Model* GetPlaceholderModel()
+{
+    return &loader.placeholder;
+}
+
+void ReportLoadProgress(float progress)
+{
+    if(currentLoad != nullptr)
+        currentLoad->progress = progress;
+}
+
+bool IsLoadCancelled()
+{
+    return currentLoad != nullptr && currentLoad->cancelRequested;
+}
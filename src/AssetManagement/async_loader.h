@@ -0,0 +1,48 @@
+#pragma once
+#include "model.h"
+#include "../String/string.h"
+#include <atomic>
+
+struct Display;
+
+enum class AsyncLoadState
+{
+    Queued,
+    Loading,
+    Ready,     // model can be drawn by the render thread
+    Failed,
+    Cancelled
+};
+
+struct AsyncLoad
+{
+    String path;
+    std::atomic<AsyncLoadState> state{AsyncLoadState::Queued};
+    std::atomic<float> progress{0.0f};
+    std::atomic<bool> cancelRequested{false};
+
+    // Only touched by the loader until the state turns Ready
+    Model model;
+};
+
+// Starts the loader thread on a hidden context sharing objects with the display's.
+// Loads go through the staging ring, so the calling thread must be done with it.
+void StartAsyncLoader(Display& display);
+void StopAsyncLoader();
+
+// Queues an .obj, .gltf or .glb file. OBJ files get the placeholder's flat materials.
+// Loads stay owned by the loader until FreeLoad or StopAsyncLoader.
+AsyncLoad* QueueModelLoad(const char* path);
+void CancelLoad(AsyncLoad* load);
+
+// Frees a load that has ended, along with its model. A ready model's assets have to be
+// released first. Does nothing for null.
+void FreeLoad(AsyncLoad* load);
+
+// Shown in place of a model while it loads
+Model* GetPlaceholderModel();
+
+// Loaders report their progress in [0, 1] and poll for cancellation at stage boundaries.
+// Both do nothing outside the loader thread.
+void ReportLoadProgress(float progress);
+bool IsLoadCancelled();
@@ -0,0 +1,3 @@
+#define CGLTF_IMPLEMENTATION
+
+#include "cgltf.h"
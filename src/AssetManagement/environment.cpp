@@ -0,0 +1,588 @@
+#include "environment.h"
+#include "asset_cache.h"
+#include "../Mesh/simd_ops.h"
+#include "../Threading/parallel_for.h"
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+// Bumped whenever the cached layout or the way the lighting is filtered changes
+static const unsigned int EnvironmentCacheVersion = 1;
+static const unsigned int LookupCacheVersion = 1;
+
+// Faces are box filtered down to this size first, lighting needs no more detail
+static const int SourceSize = 256;
+static const int SpecularSize = 128;
+static const int SpecularMinSize = 4;
+static const unsigned int SpecularSamples = 256;
+static const unsigned int LookupSamples = 512;
+
+static const float Pi = 3.14159265f;
+
+// Linear radiance with one plane per channel and face, so rows load straight into SIMD registers
+struct CubeLevel
+{
+    int size;
+    std::vector<float> texels;
+};
+
+static float* GetPlane(CubeLevel& level, int face, int channel)
+{
+    return level.texels.data() + ((size_t)face * 3 + channel) * level.size * level.size;
+}
+
+static const float* GetPlane(const CubeLevel& level, int face, int channel)
+{
+    return level.texels.data() + ((size_t)face * 3 + channel) * level.size * level.size;
+}
+
+// The s axis, t axis and normal of each face, so that a face's texel at (s, t) in [-1, 1]
+// points along s * sAxis + t * tAxis + normal. Faces are in GL's order, +x -x +y -y +z -z.
+static const float FaceAxes[6][3][3] =
+{
+    { { 0, 0, -1 }, { 0, -1, 0 }, { 1, 0, 0 } },
+    { { 0, 0, 1 }, { 0, -1, 0 }, { -1, 0, 0 } },
+    { { 1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+    { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } },
+    { { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 } },
+    { { -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 } }
+};
+
+// Unnormalized directions through Ops::Width texel centers of a row, starting at x
+template<typename Ops>
+static Vec3<Ops> GetTexelDirections(int face, int size, int x, int y)
+{
+    float texel = 2.0f / (float)size;
+    float t = ((float)y + 0.5f) * texel - 1.0f;
+    float lanes[Ops::Width];
+    for(int i = 0; i < Ops::Width; i++)
+        lanes[i] = ((float)(x + i) + 0.5f) * texel - 1.0f;
+    typename Ops::V s = Ops::Load(lanes);
+
+    const float (*axes)[3] = FaceAxes[face];
+    return
+    {
+        Ops::Add(Ops::Mul(Ops::Set(axes[0][0]), s), Ops::Set(axes[1][0] * t + axes[2][0])),
+        Ops::Add(Ops::Mul(Ops::Set(axes[0][1]), s), Ops::Set(axes[1][1] * t + axes[2][1])),
+        Ops::Add(Ops::Mul(Ops::Set(axes[0][2]), s), Ops::Set(axes[1][2] * t + axes[2][2]))
+    };
+}
+
+// Bilinear lookup of a direction, clamped to the edges of the face it hits
+static void SampleCube(const CubeLevel& level, float x, float y, float z, float* rgb)
+{
+    float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+    int face;
+    float major, s, t;
+    if(ax >= ay && ax >= az)
+    {
+        face = x > 0.0f ? 0 : 1;
+        major = ax;
+        s = x > 0.0f ? -z : z;
+        t = -y;
+    }
+    else if(ay >= az)
+    {
+        face = y > 0.0f ? 2 : 3;
+        major = ay;
+        s = x;
+        t = y > 0.0f ? z : -z;
+    }
+    else
+    {
+        face = z > 0.0f ? 4 : 5;
+        major = az;
+        s = z > 0.0f ? x : -x;
+        t = -y;
+    }
+
+    int size = level.size;
+    float u = (s / major * 0.5f + 0.5f) * (float)size - 0.5f;
+    float v = (t / major * 0.5f + 0.5f) * (float)size - 0.5f;
+    u = u < 0.0f ? 0.0f : (u > (float)(size - 1) ? (float)(size - 1) : u);
+    v = v < 0.0f ? 0.0f : (v > (float)(size - 1) ? (float)(size - 1) : v);
+
+    int x0 = (int)u, y0 = (int)v;
+    int x1 = x0 + 1 < size ? x0 + 1 : x0;
+    int y1 = y0 + 1 < size ? y0 + 1 : y0;
+    float fx = u - (float)x0, fy = v - (float)y0;
+    for(int c = 0; c < 3; c++)
+    {
+        const float* plane = GetPlane(level, face, c);
+        float top = plane[y0 * size + x0] + (plane[y0 * size + x1] - plane[y0 * size + x0]) * fx;
+        float bottom = plane[y1 * size + x0] + (plane[y1 * size + x1] - plane[y1 * size + x0]) * fx;
+        rgb[c] = top + (bottom - top) * fy;
+    }
+}
+
+// Decodes the faces into linear radiance at SourceSize or below, followed by a box filtered mip chain
+static void BuildSourceChain(const unsigned char* const faces[6], int faceSize, int channels, std::vector<CubeLevel>& chain)
+{
+    float srgbToLinear[256];
+    for(int i = 0; i < 256; i++)
+    {
+        float c = (float)i / 255.0f;
+        srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    int size = faceSize < SourceSize ? faceSize : SourceSize;
+    int factor = faceSize / size;
+    chain.push_back({ size, std::vector<float>((size_t)6 * 3 * size * size) });
+    CubeLevel& base = chain.back();
+
+    ParallelFor((size_t)6 * size, 8, [&](size_t begin, size_t end)
+    {
+        for(size_t row = begin; row < end; row++)
+        {
+            int face = (int)(row / size), y = (int)(row % size);
+            for(int x = 0; x < size; x++)
+            {
+                for(int c = 0; c < 3; c++)
+                {
+                    // Grayscale faces fill every channel
+                    int channel = channels >= 3 ? c : 0;
+                    float sum = 0.0f;
+                    for(int j = 0; j < factor; j++)
+                    {
+                        const unsigned char* source = faces[face] + ((size_t)(y * factor + j) * faceSize + (size_t)x * factor) * channels;
+                        for(int i = 0; i < factor; i++)
+                            sum += srgbToLinear[source[i * channels + channel]];
+                    }
+                    GetPlane(base, face, c)[y * size + x] = sum / (float)(factor * factor);
+                }
+            }
+        }
+    }, "Environment decode");
+
+    while(size > 1)
+    {
+        const CubeLevel& source = chain.back();
+        int half = size / 2;
+        CubeLevel level = { half, std::vector<float>((size_t)6 * 3 * half * half) };
+        for(int plane = 0; plane < 18; plane++)
+        {
+            const float* src = source.texels.data() + (size_t)plane * size * size;
+            float* dst = level.texels.data() + (size_t)plane * half * half;
+            for(int y = 0; y < half; y++)
+            {
+                for(int x = 0; x < half; x++)
+                {
+                    const float* texel = src + (size_t)y * 2 * size + x * 2;
+                    dst[y * half + x] = 0.25f * (texel[0] + texel[1] + texel[size] + texel[size + 1]);
+                }
+            }
+        }
+        chain.push_back(std::move(level));
+        size = half;
+    }
+}
+
+// Adds Ops::Width texels of a row, starting at x, to the nine coefficients of each channel
+template<typename Ops>
+static void ProjectTexels(const CubeLevel& level, int face, int x, int y, float sums[27])
+{
+    typedef typename Ops::V V;
+    float texel = 2.0f / (float)level.size;
+    Vec3<Ops> d = GetTexelDirections<Ops>(face, level.size, x, y);
+
+    // Texels cover (2 / size)^2 / (1 + s^2 + t^2)^(3/2) steradians, the squared length being 1 + s^2 + t^2
+    V inverseLength = Ops::Div(Ops::Set(1.0f), Ops::Sqrt(Dot(d, d)));
+    V solidAngle = Ops::Mul(Ops::Set(texel * texel), Ops::Mul(inverseLength, Ops::Mul(inverseLength, inverseLength)));
+    d = Scale(d, inverseLength);
+
+    const V basis[9] =
+    {
+        Ops::Set(0.282095f),
+        Ops::Mul(Ops::Set(0.488603f), d.y),
+        Ops::Mul(Ops::Set(0.488603f), d.z),
+        Ops::Mul(Ops::Set(0.488603f), d.x),
+        Ops::Mul(Ops::Set(1.092548f), Ops::Mul(d.x, d.y)),
+        Ops::Mul(Ops::Set(1.092548f), Ops::Mul(d.y, d.z)),
+        Ops::Mul(Ops::Set(0.315392f), Ops::Sub(Ops::Mul(Ops::Set(3.0f), Ops::Mul(d.z, d.z)), Ops::Set(1.0f))),
+        Ops::Mul(Ops::Set(1.092548f), Ops::Mul(d.x, d.z)),
+        Ops::Mul(Ops::Set(0.546274f), Ops::Sub(Ops::Mul(d.x, d.x), Ops::Mul(d.y, d.y)))
+    };
+
+    size_t offset = (size_t)y * level.size + x;
+    for(int c = 0; c < 3; c++)
+    {
+        V radiance = Ops::Mul(Ops::Load(GetPlane(level, face, c) + offset), solidAngle);
+        for(int k = 0; k < 9; k++)
+        {
+            float lanes[Ops::Width];
+            Ops::Store(lanes, Ops::Mul(radiance, basis[k]));
+            for(int i = 0; i < Ops::Width; i++)
+                sums[k * 3 + c] += lanes[i];
+        }
+    }
+}
+
+static void ComputeIrradiance(const CubeLevel& level, glm::vec3 irradiance[9])
+{
+    // Rows are summed separately and then in order, so results don't depend on the thread count
+    int size = level.size;
+    std::vector<float> rowSums((size_t)6 * size * 27, 0.0f);
+    ParallelFor((size_t)6 * size, 16, [&](size_t begin, size_t end)
+    {
+        for(size_t row = begin; row < end; row++)
+        {
+            int face = (int)(row / size), y = (int)(row % size);
+            float* sums = rowSums.data() + row * 27;
+            int x = 0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+            for(; x + WideOps::Width <= size; x += WideOps::Width)
+                ProjectTexels<WideOps>(level, face, x, y, sums);
+#endif
+            for(; x < size; x++)
+                ProjectTexels<ScalarOps>(level, face, x, y, sums);
+        }
+    }, "Irradiance projection");
+
+    double totals[27] = {};
+    for(size_t row = 0; row < (size_t)6 * size; row++)
+    {
+        for(int k = 0; k < 27; k++)
+            totals[k] += rowSums[row * 27 + k];
+    }
+
+    // Convolving with the clamped cosine scales each band by pi, 2pi / 3 and pi / 4,
+    // and the division by pi leaves the Lambert BRDF to the albedo
+    const float bands[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for(int k = 0; k < 9; k++)
+        irradiance[k] = glm::vec3((float)totals[k * 3], (float)totals[k * 3 + 1], (float)totals[k * 3 + 2]) * bands[k];
+}
+
+static float RadicalInverse(unsigned int bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float)bits * 2.3283064365386963e-10f;
+}
+
+// GGX distributed half vector in tangent space, z along the normal
+static glm::vec3 SampleGGX(unsigned int i, unsigned int count, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0f * Pi * ((float)i + 0.5f) / (float)count;
+    float e = RadicalInverse(i);
+    float cosTheta = sqrtf((1.0f - e) / (1.0f + (a * a - 1.0f) * e));
+    float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+    return glm::vec3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+}
+
+// A light direction in tangent space with the source level it's read from
+struct SpecularSample
+{
+    float x, y, z;
+    float level;
+};
+
+// With the view and normal both along the reflection, the samples are the same for every texel
+static std::vector<SpecularSample> GetSpecularSamples(float roughness, int sourceSize, size_t numLevels, float& totalWeight)
+{
+    std::vector<SpecularSample> samples;
+    totalWeight = 0.0f;
+    float a2 = roughness * roughness * roughness * roughness;
+    float texelAngle = 4.0f * Pi / (6.0f * (float)sourceSize * (float)sourceSize);
+    for(unsigned int i = 0; i < SpecularSamples; i++)
+    {
+        glm::vec3 h = SampleGGX(i, SpecularSamples, roughness);
+        glm::vec3 l = glm::vec3(2.0f * h.z * h.x, 2.0f * h.z * h.y, 2.0f * h.z * h.z - 1.0f);
+        if(l.z <= 0.0f)
+            continue;
+
+        // Each sample reads the source level whose texels are about the size of its share of the
+        // lobe, which keeps bright spots in the environment from turning into fireflies
+        float denominator = h.z * h.z * (a2 - 1.0f) + 1.0f;
+        float pdf = a2 / (Pi * denominator * denominator) * 0.25f;
+        float sampleAngle = 1.0f / ((float)SpecularSamples * pdf);
+        float level = 0.5f * log2f(sampleAngle / texelAngle) + 1.0f;
+        level = level < 0.0f ? 0.0f : (level > (float)(numLevels - 1) ? (float)(numLevels - 1) : level);
+
+        samples.push_back({ l.x, l.y, l.z, level });
+        totalWeight += l.z;
+    }
+    return samples;
+}
+
+// Filters Ops::Width texels of a row of one prefiltered face, starting at x
+template<typename Ops>
+static void PrefilterTexels(const std::vector<CubeLevel>& source, const std::vector<SpecularSample>& samples, float totalWeight,
+                            int face, int size, int x, int y, float* out)
+{
+    typedef typename Ops::V V;
+    Vec3<Ops> n = SafeNormalize(GetTexelDirections<Ops>(face, size, x, y));
+
+    // Tangent frame around each normal, crossed with z unless the normal is too close to it
+    V useZ = Ops::Greater(Ops::Set(0.999f), Ops::Abs(n.z));
+    V zero = Ops::Set(0.0f);
+    Vec3<Ops> tangent = SafeNormalize(Vec3<Ops>
+    {
+        Ops::Select(useZ, Ops::Sub(zero, n.y), zero),
+        Ops::Select(useZ, n.x, Ops::Sub(zero, n.z)),
+        Ops::Select(useZ, zero, n.y)
+    });
+    Vec3<Ops> bitangent =
+    {
+        Ops::Sub(Ops::Mul(n.y, tangent.z), Ops::Mul(n.z, tangent.y)),
+        Ops::Sub(Ops::Mul(n.z, tangent.x), Ops::Mul(n.x, tangent.z)),
+        Ops::Sub(Ops::Mul(n.x, tangent.y), Ops::Mul(n.y, tangent.x))
+    };
+
+    float sums[Ops::Width][3] = {};
+    for(const SpecularSample& sample : samples)
+    {
+        V sx = Ops::Set(sample.x), sy = Ops::Set(sample.y), sz = Ops::Set(sample.z);
+        float lx[Ops::Width], ly[Ops::Width], lz[Ops::Width];
+        Ops::Store(lx, Ops::Add(Ops::Add(Ops::Mul(tangent.x, sx), Ops::Mul(bitangent.x, sy)), Ops::Mul(n.x, sz)));
+        Ops::Store(ly, Ops::Add(Ops::Add(Ops::Mul(tangent.y, sx), Ops::Mul(bitangent.y, sy)), Ops::Mul(n.y, sz)));
+        Ops::Store(lz, Ops::Add(Ops::Add(Ops::Mul(tangent.z, sx), Ops::Mul(bitangent.z, sy)), Ops::Mul(n.z, sz)));
+
+        // Trilinear, blending the bilinear lookups of the two closest levels
+        int level0 = (int)sample.level;
+        int level1 = level0 + 1 < (int)source.size() ? level0 + 1 : level0;
+        float blend = sample.level - (float)level0;
+        for(int i = 0; i < Ops::Width; i++)
+        {
+            float a[3], b[3];
+            SampleCube(source[level0], lx[i], ly[i], lz[i], a);
+            SampleCube(source[level1], lx[i], ly[i], lz[i], b);
+            for(int c = 0; c < 3; c++)
+                sums[i][c] += (a[c] + (b[c] - a[c]) * blend) * sample.z;
+        }
+    }
+
+    for(int i = 0; i < Ops::Width; i++)
+    {
+        for(int c = 0; c < 3; c++)
+            out[((size_t)y * size + x + i) * 3 + c] = sums[i][c] / totalWeight;
+    }
+}
+
+static void PrefilterSpecular(const std::vector<CubeLevel>& source, EnvironmentLighting& result)
+{
+    // The unfiltered level is the source level of the same size
+    int sourceSize = source[0].size;
+    int size = sourceSize < SpecularSize ? sourceSize : SpecularSize;
+    unsigned int levels = 1;
+    for(int s = size; s > SpecularMinSize; s /= 2)
+        levels++;
+
+    result.specularSize = size;
+    result.specularLevels = levels;
+    size_t total = 0;
+    for(unsigned int level = 0; level < levels; level++)
+    {
+        int levelSize = size >> level;
+        total += (size_t)6 * levelSize * levelSize * 3;
+    }
+    result.specular.assign(total, 0.0f);
+
+    const CubeLevel* top = &source[0];
+    for(const CubeLevel& level : source)
+    {
+        if(level.size == size)
+            top = &level;
+    }
+
+    float* out = result.specular.data();
+    for(int face = 0; face < 6; face++)
+    {
+        for(int c = 0; c < 3; c++)
+        {
+            const float* plane = GetPlane(*top, face, c);
+            for(int i = 0; i < size * size; i++)
+                out[((size_t)face * size * size + i) * 3 + c] = plane[i];
+        }
+    }
+    out += (size_t)6 * size * size * 3;
+
+    for(unsigned int level = 1; level < levels; level++)
+    {
+        int levelSize = size >> level;
+        float totalWeight;
+        std::vector<SpecularSample> samples = GetSpecularSamples((float)level / (float)(levels - 1), sourceSize, source.size(), totalWeight);
+
+        ParallelFor((size_t)6 * levelSize, 1, [&](size_t begin, size_t end)
+        {
+            for(size_t row = begin; row < end; row++)
+            {
+                int face = (int)(row / levelSize), y = (int)(row % levelSize);
+                float* faceOut = out + (size_t)face * levelSize * levelSize * 3;
+                int x = 0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+                for(; x + WideOps::Width <= levelSize; x += WideOps::Width)
+                    PrefilterTexels<WideOps>(source, samples, totalWeight, face, levelSize, x, y, faceOut);
+#endif
+                for(; x < levelSize; x++)
+                    PrefilterTexels<ScalarOps>(source, samples, totalWeight, face, levelSize, x, y, faceOut);
+            }
+        }, "Specular prefiltering");
+
+        out += (size_t)6 * levelSize * levelSize * 3;
+    }
+}
+
+static bool ReadEnvironmentCache(AssetCacheKey key, const char* name, EnvironmentLighting& result)
+{
+    FILE* cachedFile = OpenCacheEntry(key);
+    if(cachedFile == nullptr)
+        return false;
+
+    // The header's line break is read separately, as scanf would skip binary data that looks like whitespace
+    unsigned int version = 0;
+    if(fscanf(cachedFile, "IBL %u %d %u", &version, &result.specularSize, &result.specularLevels) != 3 ||
+       fgetc(cachedFile) != '\n' || version != EnvironmentCacheVersion || result.specularLevels > 16)
+    {
+        printf("Invalid environment metadata contained in cache of: %s\n", name);
+        fclose(cachedFile);
+        return false;
+    }
+
+    size_t total = 0;
+    for(unsigned int level = 0; level < result.specularLevels; level++)
+    {
+        int levelSize = result.specularSize >> level;
+        total += (size_t)6 * levelSize * levelSize * 3;
+    }
+    result.specular.resize(total);
+
+    bool complete = fread(result.irradiance, sizeof(glm::vec3), 9, cachedFile) == 9 &&
+                    fread(result.specular.data(), sizeof(float), total, cachedFile) == total;
+    fclose(cachedFile);
+    if(!complete)
+    {
+        printf("Truncated environment data contained in cache of: %s\n", name);
+        return false;
+    }
+    return true;
+}
+
+void LoadEnvironmentLighting(const unsigned char* const faces[6], int faceSize, int channels, const char* name, EnvironmentLighting& result)
+{
+    // Keyed by the decoded faces, hashed one at a time
+    AssetCacheKey faceKeys[6];
+    size_t faceBytes = (size_t)faceSize * faceSize * channels;
+    for(int i = 0; i < 6; i++)
+        faceKeys[i] = GetAssetCacheKey(faces[i], faceBytes, "environment face", EnvironmentCacheVersion);
+
+    char settings[128];
+    snprintf(settings, sizeof(settings), "environment source %d specular %d down to %d samples %u", SourceSize, SpecularSize, SpecularMinSize, SpecularSamples);
+    AssetCacheKey key = GetAssetCacheKey(faceKeys, sizeof(faceKeys), settings, EnvironmentCacheVersion);
+    if(ReadEnvironmentCache(key, name, result))
+        return;
+
+    std::vector<CubeLevel> source;
+    BuildSourceChain(faces, faceSize, channels, source);
+    ComputeIrradiance(source[0], result.irradiance);
+    PrefilterSpecular(source, result);
+
+    AssetCacheWriter writer;
+    if(!BeginCacheEntry(key, writer))
+        return;
+    fprintf(writer.file, "IBL %u %d %u\n", EnvironmentCacheVersion, result.specularSize, result.specularLevels);
+    fwrite(result.irradiance, sizeof(glm::vec3), 9, writer.file);
+    fwrite(result.specular.data(), sizeof(float), result.specular.size(), writer.file);
+    CommitCacheEntry(writer);
+    printf("Created cache for environment: %s\n", name);
+}
+
+// Integrates Ops::Width texels of a lookup row, starting at x. The view direction lies in the
+// xz plane, so only the x and z of the half vectors are needed.
+template<typename Ops>
+static void IntegrateLookupTexels(const std::vector<glm::vec3>& halfVectors, float k, int size, int x, int y, float* out)
+{
+    typedef typename Ops::V V;
+    float lanes[Ops::Width];
+    for(int i = 0; i < Ops::Width; i++)
+        lanes[i] = ((float)(x + i) + 0.5f) / (float)size;
+    V nDotV = Ops::Load(lanes);
+    V sinV = Ops::Sqrt(Ops::Sub(Ops::Set(1.0f), Ops::Mul(nDotV, nDotV)));
+    V zero = Ops::Set(0.0f), one = Ops::Set(1.0f);
+
+    // Smith's geometry term for the view side, shared by every sample
+    V g1V = Ops::Div(nDotV, Ops::Add(Ops::Mul(nDotV, Ops::Set(1.0f - k)), Ops::Set(k)));
+
+    V scale = zero, bias = zero;
+    for(const glm::vec3& h : halfVectors)
+    {
+        V hx = Ops::Set(h.x), hz = Ops::Set(h.z);
+        V vDotH = Ops::Max(Ops::Add(Ops::Mul(sinV, hx), Ops::Mul(nDotV, hz)), zero);
+        V nDotL = Ops::Sub(Ops::Mul(Ops::Mul(Ops::Set(2.0f), vDotH), hz), nDotV);
+        V valid = Ops::Greater(nDotL, zero);
+        nDotL = Ops::Max(nDotL, zero);
+
+        V g1L = Ops::Div(nDotL, Ops::Add(Ops::Mul(nDotL, Ops::Set(1.0f - k)), Ops::Set(k)));
+        V visibility = Ops::Div(Ops::Mul(Ops::Mul(g1V, g1L), vDotH), Ops::Mul(hz, nDotV));
+        visibility = Ops::Select(valid, visibility, zero);
+
+        V f = Ops::Sub(one, vDotH);
+        V f2 = Ops::Mul(f, f);
+        V fresnel = Ops::Mul(Ops::Mul(f2, f2), f);
+        scale = Ops::Add(scale, Ops::Mul(Ops::Sub(one, fresnel), visibility));
+        bias = Ops::Add(bias, Ops::Mul(fresnel, visibility));
+    }
+
+    float scales[Ops::Width], biases[Ops::Width];
+    Ops::Store(scales, scale);
+    Ops::Store(biases, bias);
+    for(int i = 0; i < Ops::Width; i++)
+    {
+        out[((size_t)y * size + x + i) * 2] = scales[i] / (float)halfVectors.size();
+        out[((size_t)y * size + x + i) * 2 + 1] = biases[i] / (float)halfVectors.size();
+    }
+}
+
+void LoadBRDFLookup(int size, std::vector<float>& result)
+{
+    char settings[64];
+    snprintf(settings, sizeof(settings), "brdf lookup size %d samples %u", size, LookupSamples);
+    AssetCacheKey key = GetAssetCacheKey(nullptr, 0, settings, LookupCacheVersion);
+
+    result.resize((size_t)size * size * 2);
+    FILE* cachedFile = OpenCacheEntry(key);
+    if(cachedFile != nullptr)
+    {
+        unsigned int version = 0;
+        int cachedSize = 0;
+        bool complete = fscanf(cachedFile, "BRDF %u %d", &version, &cachedSize) == 2 && fgetc(cachedFile) == '\n' &&
+                        version == LookupCacheVersion && cachedSize == size &&
+                        fread(result.data(), sizeof(float), result.size(), cachedFile) == result.size();
+        fclose(cachedFile);
+        if(complete)
+            return;
+        printf("Invalid BRDF lookup contained in cache\n");
+    }
+
+    ParallelFor((size_t)size, 4, [&](size_t begin, size_t end)
+    {
+        std::vector<glm::vec3> halfVectors(LookupSamples);
+        for(size_t y = begin; y < end; y++)
+        {
+            float roughness = ((float)y + 0.5f) / (float)size;
+            for(unsigned int i = 0; i < LookupSamples; i++)
+                halfVectors[i] = SampleGGX(i, LookupSamples, roughness);
+
+            // Image based lighting remaps k to roughness^2 / 2
+            float k = roughness * roughness * 0.5f;
+            int x = 0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+            for(; x + WideOps::Width <= size; x += WideOps::Width)
+                IntegrateLookupTexels<WideOps>(halfVectors, k, size, x, (int)y, result.data());
+#endif
+            for(; x < size; x++)
+                IntegrateLookupTexels<ScalarOps>(halfVectors, k, size, x, (int)y, result.data());
+        }
+    }, "BRDF lookup");
+
+    AssetCacheWriter writer;
+    if(!BeginCacheEntry(key, writer))
+        return;
+    fprintf(writer.file, "BRDF %u %d\n", LookupCacheVersion, size);
+    fwrite(result.data(), sizeof(float), result.size(), writer.file);
+    CommitCacheEntry(writer);
+    printf("Created cache for BRDF lookup\n");
+}
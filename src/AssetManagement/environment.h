@@ -0,0 +1,34 @@
+#pragma once
+#include "texture.h"
+#include <glm/vec3.hpp>
+#include <vector>
+
+// Image based lighting precomputed on the CPU from a cubemap's faces
+struct EnvironmentLighting
+{
+    // L2 spherical harmonics of the diffuse irradiance, convolved with the cosine
+    // lobe and divided by pi, so they give the lighting of a white Lambert surface
+    glm::vec3 irradiance[9];
+
+    // GGX prefiltered radiance, level i filtered for roughness i / (levels - 1).
+    // RGB floats with each level's six faces back to back, in GL's face order.
+    int specularSize;
+    unsigned int specularLevels;
+    std::vector<float> specular;
+};
+
+// A skybox with the lighting derived from it
+struct Environment
+{
+    Texture skybox;
+    Texture specular;
+    glm::vec3 irradiance[9];
+};
+
+// Reads the lighting of six square sRGB faces from the asset cache, or computes and caches
+// it. The convolutions run across the job system and only once per set of faces.
+void LoadEnvironmentLighting(const unsigned char* const faces[6], int faceSize, int channels, const char* name, EnvironmentLighting& result);
+
+// Split sum lookup of the GGX specular BRDF, indexed by n.v along x and roughness along y.
+// Two floats per texel: the scale and bias applied to F0. Cached like the environments.
+void LoadBRDFLookup(int size, std::vector<float>& result);
@@ -0,0 +1,499 @@
+#include "asset_loader.h"
+#include "async_loader.h"
+#include "../Memory/arena.h"
+#include "../Mesh/tangents.h"
+#include "../Platform/file_mapping.h"
+#include "../Renderer/gl_state.h"
+#include <cgltf.h>
+#include <cstring>
+#include <glad/glad.h>
+#include <glm/geometric.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// State shared by everything imported from one file
+struct GLTFImport
+{
+    cgltf_data* data;
+    Arena arena;
+
+    // Textures are named after the model, image URIs are relative to it
+    std::string path;
+    std::string directory;
+
+    // Textures are keyed by glTF texture and type, solid fallbacks by color. The
+    // import holds a reference to each until the node tree has taken its own.
+    std::unordered_map<size_t, TextureHandle> textures;
+    std::unordered_map<unsigned int, TextureHandle> solids;
+
+    // Primitives of each glTF mesh, shared by all nodes instancing it
+    std::vector<std::vector<Model>> meshes;
+
+    // Mapping and parsing the file, shared by its primitives
+    AssetLoadTimes fileTimes;
+};
+
+static const cgltf_accessor* FindAttribute(const cgltf_primitive& primitive, cgltf_attribute_type type, cgltf_type expected)
+{
+    for(size_t i = 0; i < primitive.attributes_count; i++)
+    {
+        const cgltf_attribute& attribute = primitive.attributes[i];
+        if(attribute.type != type || attribute.index != 0)
+            continue;
+
+        if(attribute.data->type == expected)
+            return attribute.data;
+        printf("Ignoring %s attribute of unexpected type\n", attribute.name);
+    }
+    return nullptr;
+}
+
+// Returns an accessor's elements as tightly packed floats. When the layout in the file
+// already matches, this points straight into the mapped file and nothing gets copied.
+static const float* GetFloats(const cgltf_accessor* accessor, size_t components, Arena& arena)
+{
+    const unsigned char* view = accessor->buffer_view ? cgltf_buffer_view_data(accessor->buffer_view) : nullptr;
+    if(view != nullptr && !accessor->is_sparse && accessor->component_type == cgltf_component_type_r_32f &&
+       !accessor->normalized && accessor->stride == components * sizeof(float))
+        return (const float*)(view + accessor->offset);
+
+    // Interleaved, quantized or sparse data is unpacked into scratch memory
+    size_t count = accessor->count * components;
+    float* result = ArenaPushArray<float>(arena, count);
+    memset(result, 0, count * sizeof(float));
+    cgltf_accessor_unpack_floats(accessor, result, count);
+    return result;
+}
+
+// Area weighted vertex normals for primitives that come without them
+static const float* GenerateNormals(const float* positions, const unsigned int* indices, size_t numVertices, size_t numTriangles, Arena& arena)
+{
+    const glm::vec3* p = (const glm::vec3*)positions;
+    glm::vec3* normals = ArenaPushArray<glm::vec3>(arena, numVertices);
+    for(size_t i = 0; i < numVertices; i++)
+        normals[i] = glm::vec3(0.0f);
+
+    for(size_t i = 0; i < numTriangles; i++)
+    {
+        unsigned int a = indices[i * 3], b = indices[i * 3 + 1], c = indices[i * 3 + 2];
+        glm::vec3 normal = glm::cross(p[b] - p[a], p[c] - p[a]);
+        normals[a] += normal;
+        normals[b] += normal;
+        normals[c] += normal;
+    }
+
+    for(size_t i = 0; i < numVertices; i++)
+    {
+        float length = glm::length(normals[i]);
+        normals[i] = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+    return (const float*)normals;
+}
+
+static const float* GenerateGLTFTangents(const float* positions, const float* uvs, const float* normals,
+                                         const unsigned int* indices, size_t numVertices, size_t numTriangles, Arena& arena)
+{
+    float* soa = ArenaPushArray<float>(arena, numVertices * 8);
+    float* px = soa;
+    float* py = px + numVertices;
+    float* pz = py + numVertices;
+    float* u = pz + numVertices;
+    float* v = u + numVertices;
+    float* nx = v + numVertices;
+    float* ny = nx + numVertices;
+    float* nz = ny + numVertices;
+    for(size_t i = 0; i < numVertices; i++)
+    {
+        px[i] = positions[i * 3];
+        py[i] = positions[i * 3 + 1];
+        pz[i] = positions[i * 3 + 2];
+
+        // glTF's UV origin is the top left. Tangents are generated with it at the bottom left,
+        // so bitangents point up the normal map like the spec and exporters expect.
+        u[i] = uvs[i * 2];
+        v[i] = 1.0f - uvs[i * 2 + 1];
+        nx[i] = normals[i * 3];
+        ny[i] = normals[i * 3 + 1];
+        nz[i] = normals[i * 3 + 2];
+    }
+
+    float* tangents = ArenaPushArray<float>(arena, numVertices * 4);
+    TangentInput input = { px, py, pz, u, v, nx, ny, nz, indices, numVertices, numTriangles };
+    GenerateTangents(input, tangents, arena);
+    return tangents;
+}
+
+static bool ImportPrimitive(GLTFImport& import, const cgltf_primitive& primitive, Mesh& result)
+{
+    if(primitive.type != cgltf_primitive_type_triangles)
+    {
+        printf("Skipping glTF primitive that isn't made of triangles\n");
+        return false;
+    }
+
+    const cgltf_accessor* position = FindAttribute(primitive, cgltf_attribute_type_position, cgltf_type_vec3);
+    const cgltf_accessor* normal = FindAttribute(primitive, cgltf_attribute_type_normal, cgltf_type_vec3);
+    const cgltf_accessor* uv = FindAttribute(primitive, cgltf_attribute_type_texcoord, cgltf_type_vec2);
+    const cgltf_accessor* tangent = FindAttribute(primitive, cgltf_attribute_type_tangent, cgltf_type_vec4);
+    if(position == nullptr || position->count == 0)
+    {
+        printf("Skipping glTF primitive without positions\n");
+        return false;
+    }
+
+    double start = GetLoadTimerMilliseconds();
+    Arena& arena = import.arena;
+    ArenaMarker marker = ArenaGetMarker(arena);
+    size_t numVertices = position->count;
+    result = CreateMesh((unsigned int)numVertices);
+
+    const float* positions = GetFloats(position, 3, arena);
+    const float* normals = normal ? GetFloats(normal, 3, arena) : nullptr;
+    const float* tangents = tangent ? GetFloats(tangent, 4, arena) : nullptr;
+    const float* uvs = nullptr;
+    if(uv != nullptr)
+        uvs = GetFloats(uv, 2, arena);
+    else
+    {
+        float* zeros = ArenaPushArray<float>(arena, numVertices * 2);
+        memset(zeros, 0, numVertices * 2 * sizeof(float));
+        uvs = zeros;
+    }
+
+    // Primitives larger than a single cluster are split up for culling, which reorders their
+    // indices. Otherwise 16 and 32 bit indices are uploaded straight from the file, and widened
+    // copies are only made for 8 bit indices or when missing attributes have to be generated.
+    const cgltf_accessor* indexAccessor = primitive.indices;
+    size_t numIndices = indexAccessor ? indexAccessor->count : numVertices;
+    bool cluster = numIndices / 3 > MaxMeshletTriangles;
+    bool generate = normals == nullptr || tangents == nullptr;
+    bool direct = false;
+    unsigned int* indices = nullptr;
+    if(indexAccessor != nullptr)
+    {
+        const unsigned char* view = indexAccessor->buffer_view ? cgltf_buffer_view_data(indexAccessor->buffer_view) : nullptr;
+        bool packed16 = indexAccessor->component_type == cgltf_component_type_r_16u && indexAccessor->stride == 2;
+        bool packed32 = indexAccessor->component_type == cgltf_component_type_r_32u && indexAccessor->stride == 4;
+        direct = !cluster && view != nullptr && !indexAccessor->is_sparse && (packed16 || packed32);
+        if(direct)
+            UploadMeshIndices(result, view + indexAccessor->offset, (unsigned int)numIndices, packed16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+
+        if(generate || !direct)
+        {
+            indices = ArenaPushArray<unsigned int>(arena, numIndices);
+            for(size_t i = 0; i < numIndices; i++)
+                indices[i] = (unsigned int)cgltf_accessor_read_index(indexAccessor, i);
+        }
+    }
+    else if(generate || cluster)
+    {
+        indices = ArenaPushArray<unsigned int>(arena, numIndices);
+        for(size_t i = 0; i < numIndices; i++)
+            indices[i] = (unsigned int)i;
+    }
+
+    size_t numTriangles = numIndices / 3;
+    if(normals == nullptr)
+        normals = GenerateNormals(positions, indices, numVertices, numTriangles, arena);
+    if(tangents == nullptr)
+        tangents = GenerateGLTFTangents(positions, uvs, normals, indices, numVertices, numTriangles, arena);
+
+    if(cluster)
+    {
+        float* soa = ArenaPushArray<float>(arena, numVertices * 3);
+        for(size_t i = 0; i < numVertices; i++)
+        {
+            soa[i] = positions[i * 3];
+            soa[numVertices + i] = positions[i * 3 + 1];
+            soa[2 * numVertices + i] = positions[i * 3 + 2];
+        }
+        BuildMeshlets(soa, soa + numVertices, soa + 2 * numVertices, numVertices, indices, numIndices, 0, result.clusters, arena);
+    }
+    double built = GetLoadTimerMilliseconds();
+    if(indices != nullptr && !direct && (indexAccessor != nullptr || cluster))
+        UploadMeshIndices(result, indices, (unsigned int)numIndices, GL_UNSIGNED_INT);
+
+    UploadMeshStream(result, 0, positions);
+    UploadMeshStream(result, 1, uvs);
+    UploadMeshStream(result, 2, normals);
+    UploadMeshStream(result, 3, tangents);
+    double uploaded = GetLoadTimerMilliseconds();
+
+    // Indices uploaded straight from the file are read once more for the picking BVH
+    const unsigned int* triangles = indices;
+    if(triangles == nullptr && indexAccessor != nullptr)
+    {
+        unsigned int* read = ArenaPushArray<unsigned int>(arena, numIndices);
+        for(size_t i = 0; i < numIndices; i++)
+            read[i] = (unsigned int)cgltf_accessor_read_index(indexAccessor, i);
+        triangles = read;
+    }
+    BuildMeshBVH(positions, triangles, numTriangles, result.bvh);
+
+    result.loadTimes = import.fileTimes;
+    result.loadTimes.upload = uploaded - built;
+    result.loadTimes.build = GetLoadTimerMilliseconds() - start - result.loadTimes.upload;
+    ArenaPopToMarker(arena, marker);
+    return true;
+}
+
+static TextureHandle GetSolidTexture(GLTFImport& import, const float* color)
+{
+    unsigned char rgb[3];
+    for(int i = 0; i < 3; i++)
+    {
+        float c = color[i] < 0.0f ? 0.0f : (color[i] > 1.0f ? 1.0f : color[i]);
+        rgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+
+    unsigned int key = (unsigned int)rgb[0] << 16 | (unsigned int)rgb[1] << 8 | rgb[2];
+    auto cached = import.solids.find(key);
+    if(cached != import.solids.end())
+        return cached->second;
+
+    TextureHandle result = LoadSolidTextureAsset(rgb[0], rgb[1], rgb[2]);
+    import.solids.emplace(key, result);
+    return result;
+}
+
+static bool ImportTexture(GLTFImport& import, const cgltf_texture_view& view, TextureType type, TextureHandle& result)
+{
+    if(view.texture == nullptr || view.texture->image == nullptr)
+        return false;
+
+    size_t key = (size_t)(view.texture - import.data->textures) * 3 + (size_t)type;
+    auto cached = import.textures.find(key);
+    if(cached != import.textures.end())
+    {
+        result = cached->second;
+        return true;
+    }
+
+    // Every type of use of an image gets its own mip chain and cache entry
+    const char* typeNames[3] = { "color", "normal", "data" };
+    const cgltf_image* image = view.texture->image;
+    size_t imageIndex = (size_t)(image - import.data->images);
+    std::string name = import.path + " image " + std::to_string(imageIndex) + " (" + typeNames[(int)type] + ")";
+
+    // Reloading a file shares the textures of the copy that's still loaded
+    result = FindTexture(String(name.c_str(), name.size()));
+    if(result.generation != 0)
+    {
+        import.textures.emplace(key, result);
+        return true;
+    }
+
+    Texture texture;
+    if(image->buffer_view != nullptr)
+    {
+        const unsigned char* data = cgltf_buffer_view_data(image->buffer_view);
+        texture = LoadTextureFromMemory(data, image->buffer_view->size, name.c_str(), type);
+    }
+    else if(image->uri != nullptr && strncmp(image->uri, "data:", 5) != 0)
+    {
+        std::string imagePath = import.directory + image->uri;
+        MappedFile file;
+        if(!MapFile(imagePath.c_str(), file))
+            return false;
+        texture = LoadTextureFromMemory(file.data, file.size, name.c_str(), type);
+        UnmapFile(file);
+    }
+    else
+    {
+        printf("Unsupported glTF image source, using a solid color instead\n");
+        return false;
+    }
+
+    // Images that fail to decode get a solid color too
+    if(texture.ID == 0)
+        return false;
+
+    // glTF samplers repeat by default
+    const cgltf_sampler* sampler = view.texture->sampler;
+    const cgltf_int repeat = GL_REPEAT;
+    BindTexture(0, GL_TEXTURE_2D, texture.ID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler && sampler->wrap_s ? sampler->wrap_s : repeat);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler && sampler->wrap_t ? sampler->wrap_t : repeat);
+
+    result = RegisterTexture(String(name.c_str(), name.size()), texture);
+    import.textures.emplace(key, result);
+    return true;
+}
+
+// Material factors only stand in for missing textures, they aren't multiplied with them.
+// The textures are shared with the import, the model gets its own references.
+static void ImportMaterial(GLTFImport& import, const cgltf_material* material, Model& result)
+{
+    float baseColor[3] = { 1.0f, 1.0f, 1.0f };
+    float metallic = 1.0f, roughness = 1.0f;
+    const cgltf_pbr_metallic_roughness* pbr = nullptr;
+    if(material != nullptr && material->has_pbr_metallic_roughness)
+    {
+        pbr = &material->pbr_metallic_roughness;
+        memcpy(baseColor, pbr->base_color_factor, sizeof(baseColor));
+        metallic = pbr->metallic_factor;
+        roughness = pbr->roughness_factor;
+    }
+
+    if(pbr == nullptr || !ImportTexture(import, pbr->base_color_texture, TextureType::Color, result.diffuse))
+        result.diffuse = GetSolidTexture(import, baseColor);
+
+    const float flatNormal[3] = { 0.5f, 0.5f, 1.0f };
+    if(material == nullptr || !ImportTexture(import, material->normal_texture, TextureType::Normal, result.normal))
+        result.normal = GetSolidTexture(import, flatNormal);
+
+    // glTF packs roughness and metalness into green and blue like the OBJ models' occlusion-roughness-metal maps
+    const float occRoughMetal[3] = { 1.0f, roughness, metallic };
+    if(pbr == nullptr || !ImportTexture(import, pbr->metallic_roughness_texture, TextureType::Data, result.specular))
+        result.specular = GetSolidTexture(import, occRoughMetal);
+
+    RetainTexture(result.diffuse);
+    RetainTexture(result.normal);
+    RetainTexture(result.specular);
+}
+
+static Model ImportNode(GLTFImport& import, const cgltf_node* node)
+{
+    Model result = {};
+    float transform[16];
+    cgltf_node_transform_local(node, transform);
+    result.transform = glm::make_mat4(transform);
+
+    if(node->mesh != nullptr)
+    {
+        // Single primitive meshes are drawn by the node itself, others become its children
+        const std::vector<Model>& parts = import.meshes[node->mesh - import.data->meshes];
+        if(parts.size() == 1)
+        {
+            result.mesh = parts[0].mesh;
+            result.diffuse = parts[0].diffuse;
+            result.normal = parts[0].normal;
+            result.specular = parts[0].specular;
+        }
+        else
+            result.children = parts;
+    }
+    result.name = node->name ? node->name : "node";
+    RetainModel(result);
+
+    for(size_t i = 0; i < node->children_count; i++)
+        result.children.push_back(ImportNode(import, node->children[i]));
+    return result;
+}
+
+// Drops the import's own references. Assets the node tree doesn't use get deleted.
+static void ReleaseImport(GLTFImport& import)
+{
+    for(auto& primitives : import.meshes)
+    {
+        for(auto& part : primitives)
+            ReleaseModel(part);
+    }
+    for(auto& texture : import.textures)
+        ReleaseTexture(texture.second);
+    for(auto& texture : import.solids)
+        ReleaseTexture(texture.second);
+}
+
+Model LoadModelFromGLTF(const char* path)
+{
+    // The whole file is mapped, so a .glb's binary chunk is used in place
+    double start = GetLoadTimerMilliseconds();
+    MappedFile file;
+    if(!MapFile(path, file))
+    {
+        printf("Failed to open glTF file at path: %s\n", path);
+        return {};
+    }
+
+    double mapped = GetLoadTimerMilliseconds();
+    cgltf_options options = {};
+    cgltf_data* data = nullptr;
+    cgltf_result parsed = cgltf_parse(&options, file.data, file.size, &data);
+    if(parsed == cgltf_result_success)
+        parsed = cgltf_load_buffers(&options, data, path);
+    if(parsed == cgltf_result_success)
+        parsed = cgltf_validate(data);
+    if(parsed != cgltf_result_success)
+    {
+        printf("Failed to parse glTF file at path: %s (error %d)\n", path, (int)parsed);
+        cgltf_free(data);
+        UnmapFile(file);
+        return {};
+    }
+
+    GLTFImport import = { data, CreateArena(file.size + 4096), "", "", {}, {}, {}, {} };
+    import.fileTimes.read = mapped - start;
+    import.fileTimes.decode = GetLoadTimerMilliseconds() - mapped;
+    std::string pathString(path);
+    import.path = pathString;
+    size_t slash = pathString.find_last_of("/\\");
+    import.directory = slash == std::string::npos ? "" : pathString.substr(0, slash + 1);
+
+    size_t numPrimitives = 0;
+    import.meshes.resize(data->meshes_count);
+    for(size_t i = 0; i < data->meshes_count; i++)
+    {
+        const cgltf_mesh& mesh = data->meshes[i];
+        for(size_t j = 0; j < mesh.primitives_count; j++)
+        {
+            // Primitives are keyed by their place in the file, reloads share the loaded ones
+            std::string key = pathString + "#mesh " + std::to_string(i) + "/" + std::to_string(j);
+            Model part = {};
+            part.mesh = FindMesh(String(key.c_str(), key.size()));
+            if(part.mesh.generation == 0)
+            {
+                Mesh primitive = {};
+                if(!ImportPrimitive(import, mesh.primitives[j], primitive))
+                    continue;
+                primitive.name = mesh.name ? mesh.name : path;
+                part.mesh = RegisterMesh(String(key.c_str(), key.size()), std::move(primitive));
+            }
+
+            ImportMaterial(import, mesh.primitives[j].material, part);
+            part.name = mesh.name ? mesh.name : path;
+            import.meshes[i].push_back(part);
+            numPrimitives++;
+        }
+
+        // Background loads can be cancelled between meshes
+        ReportLoadProgress(0.1f + 0.9f * (float)(i + 1) / (float)data->meshes_count);
+        if(IsLoadCancelled())
+        {
+            ReleaseImport(import);
+            DestroyArena(import.arena);
+            cgltf_free(data);
+            UnmapFile(file);
+            return {};
+        }
+    }
+
+    // Files without a default scene show the first one, or every root node if there are no scenes
+    Model result = {};
+    const cgltf_scene* scene = data->scene ? data->scene : (data->scenes_count > 0 ? &data->scenes[0] : nullptr);
+    if(scene != nullptr)
+    {
+        for(size_t i = 0; i < scene->nodes_count; i++)
+            result.children.push_back(ImportNode(import, scene->nodes[i]));
+    }
+    else
+    {
+        for(size_t i = 0; i < data->nodes_count; i++)
+        {
+            if(data->nodes[i].parent == nullptr)
+                result.children.push_back(ImportNode(import, &data->nodes[i]));
+        }
+    }
+    result.name = path;
+
+    printf("Loaded glTF model at: %s (%zu primitives, %zu textures)\n", path, numPrimitives, import.textures.size() + import.solids.size());
+    printf("glTF scratch memory: %.2f MiB peak in %u block(s)\n", (double)import.arena.peak / (1024.0 * 1024.0), import.arena.numBlocks);
+
+    ReleaseImport(import);
+    DestroyArena(import.arena);
+    cgltf_free(data);
+    UnmapFile(file);
+    return result;
+}
@@ -0,0 +1,123 @@
+#include "mesh_cache.h"
+#include <cstdio>
+#include <utility>
+
+// Bumped whenever the layout or the way meshes are built changes
+static const unsigned int MeshCacheVersion = 3;
+
+AssetCacheKey GetMeshCacheKey(const void* source, size_t size)
+{
+    return GetAssetCacheKey(source, size, "mesh", MeshCacheVersion);
+}
+
+bool ReadMeshCache(AssetCacheKey key, const char* name, Mesh& result)
+{
+    FILE* cachedFile = OpenCacheEntry(key);
+    if(cachedFile == nullptr)
+        return false;
+
+    // The header's line break is read separately, as scanf would skip binary data that looks like whitespace
+    unsigned int version = 0;
+    size_t numVertices = 0, numIndices = 0, numMeshlets = 0, numNodes = 0, numTriangles = 0;
+    if(fscanf(cachedFile, "MESH %u %zu %zu %zu %zu %zu", &version, &numVertices, &numIndices, &numMeshlets, &numNodes, &numTriangles) != 6 ||
+       fgetc(cachedFile) != '\n' || version != MeshCacheVersion)
+    {
+        printf("Invalid mesh metadata contained in cache of: %s\n", name);
+        fclose(cachedFile);
+        return false;
+    }
+
+    // Vertex streams and indices are read straight into upload memory
+    MeshUpload upload = BeginMeshUpload((unsigned int)numVertices);
+    StagingAllocation indices = StagingAlloc(numIndices * sizeof(unsigned int));
+    bool complete = fread(upload.memory.data, MeshVertexSize, numVertices, cachedFile) == numVertices &&
+                    fread(indices.data, sizeof(unsigned int), numIndices, cachedFile) == numIndices;
+
+    MeshClusters clusters;
+    clusters.meshlets.resize(numMeshlets);
+    complete = complete && fread(clusters.meshlets.data(), sizeof(Meshlet), numMeshlets, cachedFile) == numMeshlets;
+
+    std::vector<float>* bounds[8] = { &clusters.centerX, &clusters.centerY, &clusters.centerZ, &clusters.radius,
+                                      &clusters.axisX, &clusters.axisY, &clusters.axisZ, &clusters.cutoff };
+    for(int i = 0; i < 8 && complete; i++)
+    {
+        bounds[i]->resize(numMeshlets);
+        complete = fread(bounds[i]->data(), sizeof(float), numMeshlets, cachedFile) == numMeshlets;
+    }
+
+    // The BVH's triangles are stored too, rather than rebuilt from vertices in write combined upload memory
+    MeshBVH bvh;
+    bvh.numTriangles = numTriangles;
+    bvh.nodes.resize(numNodes);
+    bvh.triangles.resize(numTriangles * 9);
+    bvh.triangleIds.resize(numTriangles);
+    complete = complete && fread(bvh.nodes.data(), sizeof(BVHNode), numNodes, cachedFile) == numNodes &&
+               fread(bvh.triangles.data(), sizeof(float), numTriangles * 9, cachedFile) == numTriangles * 9 &&
+               fread(bvh.triangleIds.data(), sizeof(unsigned int), numTriangles, cachedFile) == numTriangles;
+    fclose(cachedFile);
+
+    if(!complete)
+    {
+        printf("Truncated mesh data contained in cache of: %s\n", name);
+        StagingRelease(upload.memory);
+        StagingRelease(indices);
+        return false;
+    }
+
+    result = EndMeshUpload(upload);
+    CreateMeshIndices(result, (unsigned int)numIndices);
+    UploadMeshIndexRange(result, indices, 0, (unsigned int)numIndices);
+    result.clusters = std::move(clusters);
+    result.bvh = std::move(bvh);
+    return true;
+}
+
+// Interleaves the components of a stream a block at a time, as the cache stores vectors
+static void WriteStream(FILE* file, const float* const* components, unsigned int numComponents, size_t numVertices)
+{
+    float block[1024 * 4];
+    size_t blockVertices = 1024;
+    for(size_t first = 0; first < numVertices; first += blockVertices)
+    {
+        size_t count = numVertices - first < blockVertices ? numVertices - first : blockVertices;
+        for(size_t i = 0; i < count; i++)
+        {
+            for(unsigned int k = 0; k < numComponents; k++)
+                block[i * numComponents + k] = components[k][first + i];
+        }
+        fwrite(block, sizeof(float) * numComponents, count, file);
+    }
+}
+
+void WriteMeshCache(AssetCacheKey key, const char* name, const float* components, const float* tangents, size_t numVertices,
+                    const unsigned int* indices, size_t numIndices, const MeshClusters& clusters, const MeshBVH& bvh)
+{
+    AssetCacheWriter writer;
+    if(!BeginCacheEntry(key, writer))
+        return;
+    FILE* outFile = writer.file;
+
+    size_t numMeshlets = clusters.meshlets.size();
+    fprintf(outFile, "MESH %u %zu %zu %zu %zu %zu\n", MeshCacheVersion, numVertices, numIndices, numMeshlets, bvh.nodes.size(), bvh.numTriangles);
+    const float* streams[8];
+    for(int i = 0; i < 8; i++)
+        streams[i] = components + i * numVertices;
+    WriteStream(outFile, streams, 3, numVertices);
+    WriteStream(outFile, streams + 3, 2, numVertices);
+    WriteStream(outFile, streams + 5, 3, numVertices);
+    fwrite(tangents, sizeof(float) * 4, numVertices, outFile);
+    fwrite(indices, sizeof(unsigned int), numIndices, outFile);
+    fwrite(clusters.meshlets.data(), sizeof(Meshlet), numMeshlets, outFile);
+
+    const std::vector<float>* bounds[8] = { &clusters.centerX, &clusters.centerY, &clusters.centerZ, &clusters.radius,
+                                            &clusters.axisX, &clusters.axisY, &clusters.axisZ, &clusters.cutoff };
+    for(int i = 0; i < 8; i++)
+        fwrite(bounds[i]->data(), sizeof(float), numMeshlets, outFile);
+
+    fwrite(bvh.nodes.data(), sizeof(BVHNode), bvh.nodes.size(), outFile);
+    fwrite(bvh.triangles.data(), sizeof(float), bvh.triangles.size(), outFile);
+    fwrite(bvh.triangleIds.data(), sizeof(unsigned int), bvh.triangleIds.size(), outFile);
+
+    CommitCacheEntry(writer);
+    printf("Created cache for mesh: %s\n", name);
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "asset_cache.h"
+#include "../Mesh/mesh.h"
+#include <cstddef>
+
+// Key of the mesh built from a source file's contents
+AssetCacheKey GetMeshCacheKey(const void* source, size_t size);
+
+// Binary cache of a loaded mesh: its vertex streams, cluster ordered indices, cluster
+// bounds and picking BVH. Reading fails when the cache is missing or truncated.
+bool ReadMeshCache(AssetCacheKey key, const char* name, Mesh& result);
+
+// Vertices come as the loaders build them: eight arrays holding one component each of the
+// positions, texture coordinates and normals, then xyzw tangents. They're written in the
+// MeshUpload layout, so reading the cache fills upload memory directly.
+void WriteMeshCache(AssetCacheKey key, const char* name, const float* components, const float* tangents, size_t numVertices,
+                    const unsigned int* indices, size_t numIndices, const MeshClusters& clusters, const MeshBVH& bvh);
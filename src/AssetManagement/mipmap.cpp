@@ -0,0 +1,203 @@
+#include "mipmap.h"
+#include "../Threading/parallel_for.h"
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2
+#endif
+
+// Lookup tables for sRGB <-> linear conversion
+static float srgbToLinear[256];
+static unsigned char linearToSrgb[4096];
+
+static bool InitConversionTables()
+{
+    for(int i = 0; i < 256; i++)
+    {
+        float c = (float)i / 255.0f;
+        srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for(int i = 0; i < 4096; i++)
+    {
+        float l = (float)i / 4095.0f;
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+        linearToSrgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+
+    return true;
+}
+
+unsigned int CalculateMipLevels(int width, int height)
+{
+    unsigned int levels = 1;
+    while(width > 1 || height > 1)
+    {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        levels++;
+    }
+    return levels;
+}
+
+size_t CalculateMipOffset(int width, int height, int channels, unsigned int level)
+{
+    size_t offset = 0;
+    for(unsigned int i = 0; i < level; i++)
+    {
+        offset += (size_t)width * height * channels;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return offset;
+}
+
+// Expands a row of texels into 4 floats per texel, decoding them according to the texture type
+static void DecodeRow(const unsigned char* src, float* dst, int width, int channels, TextureType type)
+{
+    for(int x = 0; x < width; x++)
+    {
+        const unsigned char* texel = src + (size_t)x * channels;
+        float* out = dst + (size_t)x * 4;
+        out[0] = out[1] = out[2] = 0.0f;
+        out[3] = 1.0f;
+
+        for(int c = 0; c < channels; c++)
+        {
+            if(type == TextureType::Color && c < 3)
+                out[c] = srgbToLinear[texel[c]];
+            else if(type == TextureType::Normal && c < 3)
+                out[c] = (float)texel[c] * (2.0f / 255.0f) - 1.0f;
+            else
+                out[c] = (float)texel[c] * (1.0f / 255.0f);
+        }
+    }
+}
+
+static void EncodeRow(const float* src, unsigned char* dst, int width, int channels, TextureType type)
+{
+    for(int x = 0; x < width; x++)
+    {
+        const float* texel = src + (size_t)x * 4;
+        unsigned char* out = dst + (size_t)x * channels;
+
+        for(int c = 0; c < channels; c++)
+        {
+            float v = texel[c];
+            if(type == TextureType::Normal && c < 3)
+                v = v * 0.5f + 0.5f;
+            v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+
+            if(type == TextureType::Color && c < 3)
+                out[c] = linearToSrgb[(int)(v * 4095.0f + 0.5f)];
+            else
+                out[c] = (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Averages 2x2 blocks of decoded texels from two source rows into one destination row
+static void FilterRows(const float* row0, const float* row1, float* dst, int srcWidth, int dstWidth, bool renormalize)
+{
+    for(int x = 0; x < dstWidth; x++)
+    {
+        int x0 = x * 2;
+        int x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+
+#ifdef MIPMAP_SSE2
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0 * 4), _mm_loadu_ps(row0 + x1 * 4)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x0 * 4), _mm_loadu_ps(row1 + x1 * 4)));
+        __m128 avg = _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+
+        if(renormalize)
+        {
+            // Dot product of xyz, w is masked out so it keeps its filtered value
+            __m128 xyz = _mm_and_ps(avg, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+            __m128 sq = _mm_mul_ps(xyz, xyz);
+            __m128 dot = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+            dot = _mm_add_ps(dot, _mm_shuffle_ps(dot, dot, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            float lengthSq = _mm_cvtss_f32(dot);
+            if(lengthSq > 1e-12f)
+            {
+                __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot));
+                avg = _mm_or_ps(_mm_mul_ps(xyz, scale), _mm_andnot_ps(_mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)), avg));
+            }
+            else
+                avg = _mm_set_ps(_mm_cvtss_f32(_mm_shuffle_ps(avg, avg, _MM_SHUFFLE(3, 3, 3, 3))), 1.0f, 0.0f, 0.0f);
+        }
+
+        _mm_storeu_ps(dst + x * 4, avg);
+#else
+        float* out = dst + x * 4;
+        for(int c = 0; c < 4; c++)
+            out[c] = 0.25f * (row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c]);
+
+        if(renormalize)
+        {
+            float length = sqrtf(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+            if(length > 1e-6f)
+            {
+                out[0] /= length;
+                out[1] /= length;
+                out[2] /= length;
+            }
+            else
+            {
+                out[0] = out[1] = 0.0f;
+                out[2] = 1.0f;
+            }
+        }
+#endif
+    }
+}
+
+void GenerateMipChain(unsigned char* chain, int width, int height, int channels, unsigned int levels, TextureType type)
+{
+    // Function local static so concurrent loads initialize the tables only once
+    static const bool tablesInitialized = InitConversionTables();
+    (void)tablesInitialized;
+
+    // Normals need at least the xyz channels, otherwise filter them as plain data
+    if(type == TextureType::Normal && channels < 3)
+        type = TextureType::Data;
+    bool renormalize = type == TextureType::Normal;
+
+    unsigned char* src = chain;
+    int srcWidth = width;
+    int srcHeight = height;
+
+    for(unsigned int level = 1; level < levels; level++)
+    {
+        int dstWidth = srcWidth > 1 ? srcWidth / 2 : 1;
+        int dstHeight = srcHeight > 1 ? srcHeight / 2 : 1;
+        unsigned char* dst = src + (size_t)srcWidth * srcHeight * channels;
+
+        // Each level depends on the previous one, so only the rows within a level run in parallel
+        size_t grain = (size_t)(16384 / (dstWidth + 1)) + 1;
+        ParallelFor((size_t)dstHeight, grain, [&](size_t begin, size_t end)
+        {
+            std::vector<float> decoded((size_t)srcWidth * 4 * 3);
+            float* row0 = decoded.data();
+            float* row1 = row0 + srcWidth * 4;
+            float* result = row1 + srcWidth * 4;
+
+            for(size_t y = begin; y < end; y++)
+            {
+                int y0 = (int)y * 2;
+                int y1 = y0 + 1 < srcHeight ? y0 + 1 : y0;
+
+                DecodeRow(src + (size_t)y0 * srcWidth * channels, row0, srcWidth, channels, type);
+                DecodeRow(src + (size_t)y1 * srcWidth * channels, row1, srcWidth, channels, type);
+                FilterRows(row0, row1, result, srcWidth, dstWidth, renormalize);
+                EncodeRow(result, dst + y * dstWidth * channels, dstWidth, channels, type);
+            }
+        }, "Mip filtering");
+
+        src = dst;
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "texture.h"
+#include <cstddef>
+
+// Number of levels in a full mip chain down to 1x1
+unsigned int CalculateMipLevels(int width, int height);
+
+// Byte offset of the given level within a tightly packed mip chain.
+// Passing levels as the level gives the total size of the chain.
+size_t CalculateMipOffset(int width, int height, int channels, unsigned int level);
+
+// Fills levels 1..levels-1 of a tightly packed mip chain from level 0, which
+// must already be at the start of chain. Colors are filtered in linear space,
+// normals are renormalized after filtering.
+void GenerateMipChain(unsigned char* chain, int width, int height, int channels, unsigned int levels, TextureType type);
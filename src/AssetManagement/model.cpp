@@ -0,0 +1,160 @@
+#include "model.h"
+#include "../Renderer/gl_state.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+void DrawModel(const Model& model, Shader& shader, const glm::mat4& parentTransform, ModelDrawContext& context)
+{
+    glm::mat4 transform = parentTransform * model.transform;
+
+    Mesh* mesh = GetMesh(model.mesh);
+    if(mesh != nullptr && mesh->numVertices > 0)
+    {
+        UniformMat4(shader, "model", transform);
+        UniformInt(shader, "diffuseMap", 0);
+        UniformInt(shader, "normalMap", 1);
+        UniformInt(shader, "specularMap", 2);
+
+        // Binding per mesh keeps the unit count fixed no matter how many textures are loaded
+        const TextureHandle material[3] = { model.diffuse, model.normal, model.specular };
+        for(int i = 0; i < 3; i++)
+        {
+            Texture* texture = GetTexture(material[i]);
+            BindTexture(i, GL_TEXTURE_2D, texture != nullptr ? texture->ID : 0);
+        }
+
+        // Clusters are culled in object space, where their bounds and normal cones were built
+        if(context.cullClusters && !mesh->clusters.meshlets.empty())
+        {
+            glm::vec3 camera = glm::vec3(glm::inverse(transform) * glm::vec4(context.cameraPosition, 1.0f));
+            DrawMeshClusters(*mesh, context.viewProjection * transform, camera, context.stats);
+        }
+        else
+            Draw(*mesh);
+    }
+
+    for(auto& child : model.children)
+        DrawModel(child, shader, transform, context);
+}
+
+bool GetModelBounds(const Model& model, const glm::mat4& parentTransform, glm::vec3& min, glm::vec3& max)
+{
+    glm::mat4 transform = parentTransform * model.transform;
+    bool result = false;
+
+    Mesh* mesh = GetMesh(model.mesh);
+    if(mesh != nullptr)
+    {
+        // Spheres stay spheres under the largest axis scale
+        float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+        const MeshClusters& clusters = mesh->clusters;
+        for(size_t i = 0; i < clusters.meshlets.size(); i++)
+        {
+            glm::vec3 center = glm::vec3(transform * glm::vec4(clusters.centerX[i], clusters.centerY[i], clusters.centerZ[i], 1.0f));
+            glm::vec3 radius(clusters.radius[i] * scale);
+            min = glm::min(min, center - radius);
+            max = glm::max(max, center + radius);
+            result = true;
+        }
+    }
+
+    for(auto& child : model.children)
+        result |= GetModelBounds(child, transform, min, max);
+    return result;
+}
+
+bool PickModel(const Model& model, const glm::mat4& parentTransform, const glm::vec3& origin, const glm::vec3& direction, ModelPick& pick)
+{
+    glm::mat4 transform = parentTransform * model.transform;
+    bool result = false;
+
+    // The ray goes into object space unnormalized, so distances along it stay in world units
+    Mesh* mesh = GetMesh(model.mesh);
+    if(mesh != nullptr && !mesh->bvh.nodes.empty())
+    {
+        glm::mat4 inverse = glm::inverse(transform);
+        glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(inverse * glm::vec4(direction, 0.0f));
+
+        BVHHit hit;
+        if(IntersectMeshBVH(mesh->bvh, localOrigin, localDirection, pick.distance, hit))
+        {
+            glm::vec3 normal = glm::normalize(glm::transpose(glm::mat3(inverse)) * hit.normal);
+            pick = { hit.distance, origin + direction * hit.distance, glm::dot(normal, direction) > 0.0f ? -normal : normal, &model };
+            result = true;
+        }
+    }
+
+    for(auto& child : model.children)
+        result |= PickModel(child, transform, origin, direction, pick);
+    return result;
+}
+
+bool HasStreamedMeshes(const Model& model)
+{
+    Mesh* mesh = GetMesh(model.mesh);
+    if(mesh != nullptr && mesh->streamed)
+        return true;
+
+    for(auto& child : model.children)
+    {
+        if(HasStreamedMeshes(child))
+            return true;
+    }
+    return false;
+}
+
+static void CollectTextures(const Model& model, std::vector<TextureHandle>& textures)
+{
+    const TextureHandle material[3] = { model.diffuse, model.normal, model.specular };
+    for(TextureHandle texture : material)
+    {
+        // Materials share textures, only count each one once
+        bool seen = std::any_of(textures.begin(), textures.end(), [&](TextureHandle t) { return t.index == texture.index; });
+        if(texture.generation != 0 && !seen)
+            textures.push_back(texture);
+    }
+
+    for(auto& child : model.children)
+        CollectTextures(child, textures);
+}
+
+size_t GetModelTextureMemory(const Model& model)
+{
+    std::vector<TextureHandle> textures;
+    CollectTextures(model, textures);
+
+    size_t result = 0;
+    for(TextureHandle handle : textures)
+    {
+        Texture* texture = GetTexture(handle);
+        if(texture != nullptr)
+            result += texture->memorySize;
+    }
+    return result;
+}
+
+void RetainModel(const Model& model)
+{
+    RetainMesh(model.mesh);
+    RetainTexture(model.diffuse);
+    RetainTexture(model.normal);
+    RetainTexture(model.specular);
+
+    for(auto& child : model.children)
+        RetainModel(child);
+}
+
+void ReleaseModel(Model& model)
+{
+    ReleaseMesh(model.mesh);
+    ReleaseTexture(model.diffuse);
+    ReleaseTexture(model.normal);
+    ReleaseTexture(model.specular);
+
+    for(auto& child : model.children)
+        ReleaseModel(child);
+    model = {};
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "asset_registry.h"
+#include "shader.h"
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+// A mesh with its material. glTF files are imported as a tree of models
+// following their node hierarchy, OBJ files as a single model.
+// Group nodes without geometry have a null mesh handle.
+struct Model
+{
+    String name;
+    MeshHandle mesh;
+    TextureHandle diffuse;
+    TextureHandle normal;
+    TextureHandle specular;
+
+    // Relative to the parent model
+    glm::mat4 transform = glm::mat4(1.0f);
+    std::vector<Model> children;
+};
+
+// Per frame inputs of DrawModel. Clustered meshes are culled against the camera
+// when cullClusters is set, accumulating into stats.
+struct ModelDrawContext
+{
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    bool cullClusters;
+    ClusterCullingStats stats;
+};
+
+// Draws a model and its children with the lighting shader's material uniforms.
+// Material textures are bound to units 0 to 2 for each mesh.
+void DrawModel(const Model& model, Shader& shader, const glm::mat4& parentTransform, ModelDrawContext& context);
+
+// Grows min and max to hold a model and its children, from their clusters' bounding
+// spheres. Returns false if none of its meshes have clusters.
+bool GetModelBounds(const Model& model, const glm::mat4& parentTransform, glm::vec3& min, glm::vec3& max);
+
+// Nearest point of a ray cast against models
+struct ModelPick
+{
+    float distance;
+    glm::vec3 position;
+    glm::vec3 normal;
+    const Model* model;
+};
+
+// Casts a ray against the triangles of a model and its children through their BVHs, replacing
+// pick with any hit nearer than pick.distance. The direction must be normalized for distances.
+bool PickModel(const Model& model, const glm::mat4& parentTransform, const glm::vec3& origin, const glm::vec3& direction, ModelPick& pick);
+
+// Whether a model or its children have streamed meshes, which picking passes through
+bool HasStreamedMeshes(const Model& model);
+
+// GPU memory taken up by the distinct textures of a model and its children
+size_t GetModelTextureMemory(const Model& model);
+
+// Adds or drops a reference to every asset of a model and its children. Models that
+// may have been drawn are released on the drawing context, which owns their vertex arrays.
+void RetainModel(const Model& model);
+void ReleaseModel(Model& model);
@@ -0,0 +1,547 @@
+#include "obj_parser.h"
+#include "../Memory/arena.h"
+#include "../Mesh/mesh.h"
+#include "../Mesh/tangents.h"
+#include "../Threading/parallel_for.h"
+#include <glm/geometric.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char* SkipBlanks(const char* p, const char* lineEnd)
+{
+    while(p < lineEnd && IsBlank(*p))
+        p++;
+    return p;
+}
+
+// Tokens end at blanks, or at a comment running to the end of the line
+static const char* TokenEnd(const char* p, const char* lineEnd)
+{
+    while(p < lineEnd && !IsBlank(*p) && *p != '#')
+        p++;
+    return p;
+}
+
+static const char* LineEnd(const char* p, const char* end)
+{
+    const char* newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+    return newline != nullptr ? newline : end;
+}
+
+static const char* SkipLine(const char* p, const char* end)
+{
+    const char* lineEnd = LineEnd(p, end);
+    return lineEnd < end ? lineEnd + 1 : end;
+}
+
+enum class OBJStatement
+{
+    Vertex,
+    UV,
+    Normal,
+    Face,
+    Other,
+};
+
+// Reads the keyword a line starts with, leaving p after it
+static OBJStatement ReadStatement(const char*& p, const char* lineEnd)
+{
+    const char* keyword = SkipBlanks(p, lineEnd);
+    p = TokenEnd(keyword, lineEnd);
+    size_t length = (size_t)(p - keyword);
+    if(length == 1 && keyword[0] == 'v')
+        return OBJStatement::Vertex;
+    if(length == 1 && keyword[0] == 'f')
+        return OBJStatement::Face;
+    if(length == 2 && keyword[0] == 'v' && keyword[1] == 't')
+        return OBJStatement::UV;
+    if(length == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+        return OBJStatement::Normal;
+    return OBJStatement::Other;
+}
+
+static size_t CountTokens(const char* p, const char* lineEnd)
+{
+    size_t count = 0;
+    while(true)
+    {
+        p = SkipBlanks(p, lineEnd);
+        if(p == lineEnd || *p == '#')
+            return count;
+        p = TokenEnd(p, lineEnd);
+        count++;
+    }
+}
+
+OBJCounts CountOBJStatements(const char* p, const char* end)
+{
+    OBJCounts counts = {};
+    while(p < end)
+    {
+        const char* lineEnd = LineEnd(p, end);
+        OBJStatement statement = ReadStatement(p, lineEnd);
+        if(statement == OBJStatement::Vertex)
+            counts.vertices++;
+        else if(statement == OBJStatement::UV)
+            counts.uvs++;
+        else if(statement == OBJStatement::Normal)
+            counts.normals++;
+        else if(statement == OBJStatement::Face)
+        {
+            // Polygons become fans, faces with fewer corners are dropped
+            size_t corners = CountTokens(p, lineEnd);
+            if(corners >= 3)
+                counts.triangles += corners - 2;
+        }
+
+        counts.lines++;
+        p = SkipLine(lineEnd, end);
+    }
+    return counts;
+}
+
+// Parses at least required and at most count floats, anything after them is ignored.
+// Tokens are copied out first, strtof could otherwise read past the end of the text.
+static bool ParseFloats(const char* p, const char* lineEnd, float* out, int required, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        p = SkipBlanks(p, lineEnd);
+        const char* tokenEnd = TokenEnd(p, lineEnd);
+        size_t length = (size_t)(tokenEnd - p);
+        if(length == 0)
+            return i >= required;
+
+        char token[64];
+        if(length >= sizeof(token))
+            return false;
+        memcpy(token, p, length);
+        token[length] = '\0';
+
+        char* next;
+        out[i] = strtof(token, &next);
+        if(next != token + length || !std::isfinite(out[i]))
+            return false;
+        p = tokenEnd;
+    }
+    return true;
+}
+
+// Parses an optionally negative integer, which has to fit in 32 bits
+static bool ParseIndex(const char*& p, const char* tokenEnd, long long& out)
+{
+    bool negative = p < tokenEnd && *p == '-';
+    if(negative)
+        p++;
+
+    const char* digits = p;
+    long long value = 0;
+    while(p < tokenEnd && *p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p - '0');
+        if(value > 0xffffffffll)
+            return false;
+        p++;
+    }
+    out = negative ? -value : value;
+    return p > digits;
+}
+
+// Turns a one based, or negative relative, OBJ index into a zero based one among the elements defined so far
+static bool ResolveIndex(long long index, size_t defined, unsigned int& out)
+{
+    long long resolved = index > 0 ? index - 1 : (long long)defined + index;
+    if(index == 0 || resolved < 0 || resolved >= (long long)defined || resolved >= (long long)OBJMissingIndex)
+        return false;
+    out = (unsigned int)resolved;
+    return true;
+}
+
+// Parses a v, v/t, v//n or v/t/n corner, returning what's wrong with it if anything
+static const char* ParseCorner(const char* p, const char* tokenEnd, const size_t defined[3], OBJCorner& corner)
+{
+    corner = { OBJMissingIndex, OBJMissingIndex, OBJMissingIndex };
+    unsigned int* indices[3] = { &corner.vertex, &corner.uv, &corner.normal };
+    for(int i = 0; i < 3; i++)
+    {
+        // Texture coordinates and normals can be left out, positions can't
+        if(p < tokenEnd && *p != '/')
+        {
+            long long index;
+            if(!ParseIndex(p, tokenEnd, index))
+                return "malformed face corner, face skipped";
+            if(!ResolveIndex(index, defined[i], *indices[i]))
+                return "face index out of range, face skipped";
+        }
+        else if(i == 0)
+            return "face corner without a position, face skipped";
+
+        if(p == tokenEnd)
+            return nullptr;
+        if(*p != '/' || i == 2)
+            return "malformed face corner, face skipped";
+        p++;
+    }
+    return nullptr;
+}
+
+// Unique v/t/n triplets of an OBJ file and the triangle indices referencing them
+struct WeldedVertices
+{
+    unsigned int* vertexIndices;
+    unsigned int* textureIndices;
+    unsigned int* normalIndices;
+    unsigned int* indices;
+    size_t numUnique;
+};
+
+static WeldedVertices WeldOBJVertices(const OBJCorner* corners, size_t numIndices, Arena& arena)
+{
+    WeldedVertices result;
+    result.vertexIndices = ArenaPushArray<unsigned int>(arena, numIndices);
+    result.textureIndices = ArenaPushArray<unsigned int>(arena, numIndices);
+    result.normalIndices = ArenaPushArray<unsigned int>(arena, numIndices);
+    result.indices = ArenaPushArray<unsigned int>(arena, numIndices);
+    result.numUnique = 0;
+
+    // Open addressing hash table of unique vertex indices, at most half full
+    size_t capacity = 16;
+    while(capacity < numIndices * 2)
+        capacity *= 2;
+
+    ArenaMarker marker = ArenaGetMarker(arena);
+    unsigned int* table = ArenaPushArray<unsigned int>(arena, capacity);
+    for(size_t i = 0; i < capacity; i++)
+        table[i] = ~0u;
+
+    for(size_t i = 0; i < numIndices; i++)
+    {
+        unsigned int vi = corners[i].vertex, ti = corners[i].uv, ni = corners[i].normal;
+        size_t hash = ((size_t)vi * 73856093u) ^ ((size_t)ti * 19349663u) ^ ((size_t)ni * 83492791u);
+
+        size_t slot = hash & (capacity - 1);
+        while(true)
+        {
+            unsigned int unique = table[slot];
+            if(unique == ~0u)
+            {
+                unique = (unsigned int)result.numUnique++;
+                result.vertexIndices[unique] = vi;
+                result.textureIndices[unique] = ti;
+                result.normalIndices[unique] = ni;
+                table[slot] = unique;
+                result.indices[i] = unique;
+                break;
+            }
+            if(result.vertexIndices[unique] == vi && result.textureIndices[unique] == ti && result.normalIndices[unique] == ni)
+            {
+                result.indices[i] = unique;
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+    }
+
+    ArenaPopToMarker(arena, marker);
+    return result;
+}
+
+// A run of complete lines parsed by one job
+struct OBJChunk
+{
+    const char* begin;
+    const char* end;
+
+    // Where the chunk's statements go in the parse arrays, and its first line in the text
+    OBJCounts offsets;
+
+    // Triangles written from offsets.triangles on, dropped faces leave the slots after them unused
+    size_t triangles;
+    OBJError errors[MaxOBJErrors];
+    size_t numErrors;
+};
+
+static void AddError(OBJError* errors, size_t& numErrors, size_t line, const char* message)
+{
+    if(numErrors < MaxOBJErrors)
+        errors[numErrors] = { line, message };
+    numErrors++;
+}
+
+static void ParseOBJStatements(OBJChunk& chunk, OBJData& result, const OBJCounts& preceding)
+{
+    size_t numVertices = chunk.offsets.vertices, numUVs = chunk.offsets.uvs, numNormals = chunk.offsets.normals;
+    size_t numCorners = chunk.offsets.triangles * 3;
+    size_t line = preceding.lines + chunk.offsets.lines;
+    OBJCorner* corners = result.corners;
+
+    for(const char* p = chunk.begin; p < chunk.end;)
+    {
+        const char* lineEnd = LineEnd(p, chunk.end);
+        line++;
+
+        // Broken attributes still take up their slot, so later faces reference the right ones
+        OBJStatement statement = ReadStatement(p, lineEnd);
+        if(statement == OBJStatement::Vertex)
+        {
+            glm::vec3& vertex = result.vertices[numVertices++];
+            if(!ParseFloats(p, lineEnd, &vertex.x, 3, 3))
+            {
+                vertex = glm::vec3(0.0f);
+                AddError(chunk.errors, chunk.numErrors, line, "malformed vertex position, using zero");
+            }
+        }
+        else if(statement == OBJStatement::UV)
+        {
+            glm::vec2& uv = result.uvs[numUVs++];
+            uv = glm::vec2(0.0f);
+            if(!ParseFloats(p, lineEnd, &uv.x, 1, 2))
+            {
+                uv = glm::vec2(0.0f);
+                AddError(chunk.errors, chunk.numErrors, line, "malformed texture coordinate, using zero");
+            }
+        }
+        else if(statement == OBJStatement::Normal)
+        {
+            glm::vec3& normal = result.normals[numNormals++];
+            if(!ParseFloats(p, lineEnd, &normal.x, 3, 3))
+            {
+                normal = glm::vec3(0.0f);
+                AddError(chunk.errors, chunk.numErrors, line, "malformed normal, using zero");
+            }
+        }
+        else if(statement == OBJStatement::Face)
+        {
+            // Faces can only reference what the file defined before them
+            size_t defined[3] = { preceding.vertices + numVertices, preceding.uvs + numUVs, preceding.normals + numNormals };
+
+            size_t firstCorner = numCorners;
+            size_t numFaceCorners = 0;
+            OBJCorner first = {}, previous = {};
+            const char* error = nullptr;
+            while(error == nullptr)
+            {
+                p = SkipBlanks(p, lineEnd);
+                if(p == lineEnd || *p == '#')
+                    break;
+
+                const char* tokenEnd = TokenEnd(p, lineEnd);
+                OBJCorner corner;
+                error = ParseCorner(p, tokenEnd, defined, corner);
+                p = tokenEnd;
+
+                // Fans around the first corner, the count pass reserved a triangle per corner after the second
+                if(numFaceCorners == 0)
+                    first = corner;
+                else if(numFaceCorners >= 2)
+                {
+                    corners[numCorners++] = first;
+                    corners[numCorners++] = previous;
+                    corners[numCorners++] = corner;
+                }
+                previous = corner;
+                numFaceCorners++;
+            }
+
+            if(error == nullptr && numFaceCorners < 3)
+                error = "face with fewer than three corners, face skipped";
+            if(error != nullptr)
+            {
+                numCorners = firstCorner;
+                AddError(chunk.errors, chunk.numErrors, line, error);
+            }
+        }
+
+        p = SkipLine(lineEnd, chunk.end);
+    }
+
+    chunk.triangles = numCorners / 3 - chunk.offsets.triangles;
+}
+
+// Text below this size per chunk isn't worth a job of its own
+static const size_t OBJ_CHUNK_SIZE = 1024 * 1024;
+
+OBJData ParseOBJText(const char* text, const char* end, const OBJCounts& preceding, Arena& arena)
+{
+    // Split the text into chunks at line starts. Face indices are absolute, so
+    // chunks parse independently once each knows how many statements precede it.
+    size_t size = (size_t)(end - text);
+    size_t numChunks = size / OBJ_CHUNK_SIZE + 1;
+    size_t maxChunks = (size_t)GetWorkerCount() * 4;
+    if(numChunks > maxChunks)
+        numChunks = maxChunks;
+
+    std::vector<OBJChunk> chunks(numChunks);
+    chunks[0].begin = text;
+    chunks[numChunks - 1].end = end;
+    for(size_t i = 1; i < numChunks; i++)
+    {
+        const char* split = text + size / numChunks * i;
+        chunks[i].begin = split > chunks[i - 1].begin ? SkipLine(split - 1, end) : chunks[i - 1].begin;
+        chunks[i - 1].end = chunks[i].begin;
+    }
+
+    ParallelFor(numChunks, 1, [&](size_t begin, size_t last)
+    {
+        for(size_t i = begin; i < last; i++)
+            chunks[i].offsets = CountOBJStatements(chunks[i].begin, chunks[i].end);
+    }, "OBJ count");
+
+    // Exclusive prefix sums become each chunk's write offsets
+    OBJData result;
+    OBJCounts& counts = result.counts;
+    counts = {};
+    for(auto& chunk : chunks)
+    {
+        OBJCounts offsets = counts;
+        counts.vertices += chunk.offsets.vertices;
+        counts.uvs += chunk.offsets.uvs;
+        counts.normals += chunk.offsets.normals;
+        counts.triangles += chunk.offsets.triangles;
+        counts.lines += chunk.offsets.lines;
+        chunk.offsets = offsets;
+        chunk.numErrors = 0;
+    }
+
+    result.vertices = ArenaPushArray<glm::vec3>(arena, counts.vertices);
+    result.uvs = ArenaPushArray<glm::vec2>(arena, counts.uvs);
+    result.normals = ArenaPushArray<glm::vec3>(arena, counts.normals);
+    result.corners = ArenaPushArray<OBJCorner>(arena, counts.triangles * 3);
+
+    ParallelFor(numChunks, 1, [&](size_t begin, size_t last)
+    {
+        for(size_t i = begin; i < last; i++)
+            ParseOBJStatements(chunks[i], result, preceding);
+    }, "OBJ parse");
+
+    // Close the gaps dropped faces left, and gather the errors in file order
+    counts.triangles = 0;
+    result.numErrors = 0;
+    for(auto& chunk : chunks)
+    {
+        if(chunk.offsets.triangles != counts.triangles)
+            memmove(result.corners + counts.triangles * 3, result.corners + chunk.offsets.triangles * 3, chunk.triangles * 3 * sizeof(OBJCorner));
+        counts.triangles += chunk.triangles;
+
+        for(size_t i = 0; i < chunk.numErrors && i < MaxOBJErrors && result.numErrors + i < MaxOBJErrors; i++)
+            result.errors[result.numErrors + i] = chunk.errors[i];
+        result.numErrors += chunk.numErrors;
+    }
+
+    return result;
+}
+
+void PrintOBJErrors(const OBJData& data, const char* path)
+{
+    size_t shown = data.numErrors < MaxOBJErrors ? data.numErrors : MaxOBJErrors;
+    for(size_t i = 0; i < shown; i++)
+        printf("%s:%zu: %s\n", path, data.errors[i].line, data.errors[i].message);
+    if(data.numErrors > shown)
+        printf("%s: %zu more invalid lines\n", path, data.numErrors - shown);
+}
+
+OBJMesh BuildOBJMesh(const glm::vec3* vertices, const glm::vec2* uvs, const glm::vec3* normals, const OBJCorner* corners,
+                     size_t numCorners, unsigned int vertexBase, unsigned int indexBase, MeshClusters& clusters, Arena& arena)
+{
+    // Weld identical v/t/n triplets so tangents can be averaged across the triangles sharing a vertex
+    WeldedVertices welded = WeldOBJVertices(corners, numCorners, arena);
+
+    size_t numUnique = welded.numUnique;
+    OBJMesh result;
+    result.numVertices = numUnique;
+    result.numIndices = numCorners;
+    result.localIndices = welded.indices;
+
+    // Unique vertices as a structure of arrays for the tangent and cluster builders
+    float* soa = ArenaPushArray<float>(arena, numUnique * 8);
+    float* px = soa;
+    float* py = px + numUnique;
+    float* pz = py + numUnique;
+    float* u = pz + numUnique;
+    float* v = u + numUnique;
+    float* nx = v + numUnique;
+    float* ny = nx + numUnique;
+    float* nz = ny + numUnique;
+    bool missingNormals = false;
+    for(size_t i = 0; i < numUnique; i++)
+    {
+        unsigned int uvIndex = welded.textureIndices[i], normalIndex = welded.normalIndices[i];
+        const glm::vec3& position = vertices[welded.vertexIndices[i]];
+        glm::vec2 uv = uvIndex != OBJMissingIndex ? uvs[uvIndex] : glm::vec2(0.0f);
+        glm::vec3 normal = normalIndex != OBJMissingIndex ? normals[normalIndex] : glm::vec3(0.0f);
+        missingNormals |= normalIndex == OBJMissingIndex;
+        px[i] = position.x;
+        py[i] = position.y;
+        pz[i] = position.z;
+        u[i] = uv.x;
+        v[i] = uv.y;
+        nx[i] = normal.x;
+        ny[i] = normal.y;
+        nz[i] = normal.z;
+    }
+
+    // Corners without normals were welded by position and texture coordinate alone, so
+    // summing the area weighted normals of their faces smooths over shared positions
+    if(missingNormals)
+    {
+        const unsigned int* indices = welded.indices;
+        for(size_t i = 0; i + 2 < numCorners; i += 3)
+        {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            glm::vec3 pa(px[a], py[a], pz[a]), pb(px[b], py[b], pz[b]), pc(px[c], py[c], pz[c]);
+            glm::vec3 face = glm::cross(pb - pa, pc - pa);
+            for(unsigned int corner : { a, b, c })
+            {
+                if(welded.normalIndices[corner] != OBJMissingIndex)
+                    continue;
+                nx[corner] += face.x;
+                ny[corner] += face.y;
+                nz[corner] += face.z;
+            }
+        }
+        for(size_t i = 0; i < numUnique; i++)
+        {
+            if(welded.normalIndices[i] != OBJMissingIndex)
+                continue;
+            glm::vec3 normal(nx[i], ny[i], nz[i]);
+            float length = glm::length(normal);
+            normal = length > 1e-20f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            nx[i] = normal.x;
+            ny[i] = normal.y;
+            nz[i] = normal.z;
+        }
+    }
+
+    float* tangents = ArenaPushArray<float>(arena, numUnique * 4);
+    TangentInput tangentInput = { px, py, pz, u, v, nx, ny, nz, welded.indices, numUnique, numCorners / 3 };
+    GenerateTangents(tangentInput, tangents, arena);
+
+    BuildMeshlets(px, py, pz, numUnique, welded.indices, numCorners, indexBase, clusters, arena);
+    result.components = soa;
+    result.tangents = tangents;
+
+    // Written in order, without reading back, as the GPU copies them
+    result.upload = BeginMeshUpload((unsigned int)numUnique);
+    for(size_t i = 0; i < numUnique; i++)
+    {
+        const float* tangent = tangents + i * 4;
+        result.upload.vertices[i] = glm::vec3(px[i], py[i], pz[i]);
+        result.upload.uvs[i] = glm::vec2(u[i], v[i]);
+        result.upload.normals[i] = glm::vec3(nx[i], ny[i], nz[i]);
+        result.upload.tangents[i] = glm::vec4(tangent[0], tangent[1], tangent[2], tangent[3]);
+    }
+
+    result.indices = StagingAlloc(numCorners * sizeof(unsigned int));
+    unsigned int* indices = (unsigned int*)result.indices.data;
+    for(size_t i = 0; i < numCorners; i++)
+        indices[i] = welded.indices[i] + vertexBase;
+    return result;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "../Mesh/mesh.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <cstddef>
+
+struct Arena;
+
+// Face corners without a texture coordinate or normal use this index for it
+static const unsigned int OBJMissingIndex = ~0u;
+
+// Zero based attribute indices of one face corner
+struct OBJCorner
+{
+    unsigned int vertex, uv, normal;
+};
+
+// Counts of each kind of OBJ statement, used to size the parse arrays exactly.
+// Polygons count as the triangles of their fans.
+struct OBJCounts
+{
+    size_t vertices, uvs, normals, triangles, lines;
+};
+
+// A line that was skipped, or whose attribute was zeroed, with its one based number in the file
+struct OBJError
+{
+    size_t line;
+    const char* message;
+};
+
+static const size_t MaxOBJErrors = 8;
+
+// Parsed contents of a block of OBJ text, allocated from an arena. Only the first
+// errors are kept, numErrors counts all of them.
+struct OBJData
+{
+    glm::vec3* vertices;
+    glm::vec2* uvs;
+    glm::vec3* normals;
+    OBJCorner* corners;
+    OBJCounts counts;
+    OBJError errors[MaxOBJErrors];
+    size_t numErrors;
+};
+
+OBJCounts CountOBJStatements(const char* text, const char* end);
+
+// Parses complete lines between text and end, given what the file defined before text.
+// Polygons are split into fans and face indices are resolved to absolute ones, negative
+// indices counting back from the last element defined. Faces referencing elements not
+// defined yet, or with malformed corners, are dropped, and malformed attributes are
+// zeroed so the ones after them keep their indices. Parsing never reads past end.
+OBJData ParseOBJText(const char* text, const char* end, const OBJCounts& preceding, Arena& arena);
+
+// Prints the errors a parse recovered from
+void PrintOBJErrors(const OBJData& data, const char* path);
+
+// Welded, indexed triangles of a run of OBJ faces. The vertex streams and the indices, offset by
+// vertexBase, are written straight into upload memory, allocated vertices first.
+struct OBJMesh
+{
+    MeshUpload upload;
+    StagingAllocation indices;
+    size_t numVertices;
+    size_t numIndices;
+
+    // Upload memory may be write-combined, so the BVH and cache read these arena copies
+    // instead: positions, texture coordinates and normals as eight arrays of one component,
+    // xyzw tangents and the indices counting from zero
+    const float* components;
+    const float* tangents;
+    const unsigned int* localIndices;
+};
+
+// Welds the corners of a run of triangles, generates their tangents and partitions them into
+// clusters, whose first indices are offset by indexBase. Missing texture coordinates are zero,
+// and missing normals are smoothed from the faces. Needs a current GL context for the upload memory.
+OBJMesh BuildOBJMesh(const glm::vec3* vertices, const glm::vec2* uvs, const glm::vec3* normals, const OBJCorner* corners,
+                     size_t numCorners, unsigned int vertexBase, unsigned int indexBase, MeshClusters& clusters, Arena& arena);
+
+struct Mesh;
+
+// Bounded memory import for OBJ files too large to parse in one go. The file is
+// parsed in windows whose attributes and faces are spilled to temporary files,
+// then the vertex and index buffers are built in windows of triangles read back
+// from them. Vertices are only welded and tangents only averaged within a window,
+// and the mesh gets no picking BVH.
+Mesh LoadMeshFromOBJStreaming(const char* path, size_t memoryBudget);
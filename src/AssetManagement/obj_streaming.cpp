@@ -0,0 +1,304 @@
+#include "obj_parser.h"
+#include "async_loader.h"
+#include "../Memory/arena.h"
+#include "../Mesh/mesh.h"
+#include "../Platform/file_mapping.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+
+// Temporary file holding one kind of parsed element
+struct SpillFile
+{
+    FILE* file;
+    std::string path;
+    size_t count;
+    MappedFile mapping;
+};
+
+static bool OpenSpill(SpillFile& spill, const char* name)
+{
+    static unsigned int counter = 0;
+    long long ticks = (long long)std::chrono::steady_clock::now().time_since_epoch().count();
+    std::string fileName = "model-viewer-" + std::to_string(ticks) + "-" + std::to_string(counter++) + "-" + name + ".bin";
+
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+    spill.path = (error ? std::filesystem::path(".") : directory).append(fileName).string();
+    spill.file = fopen(spill.path.c_str(), "wb");
+    spill.count = 0;
+    spill.mapping = { nullptr, 0, -1, -1 };
+
+    if(spill.file == nullptr)
+        printf("Failed to create temporary file at path: %s\n", spill.path.c_str());
+    return spill.file != nullptr;
+}
+
+static bool WriteSpill(SpillFile& spill, const void* data, size_t elementSize, size_t count)
+{
+    if(count > 0 && fwrite(data, elementSize, count, spill.file) != count)
+    {
+        printf("Failed to write to temporary file at path: %s\n", spill.path.c_str());
+        return false;
+    }
+    spill.count += count;
+    return true;
+}
+
+// Vertices needed for all corners at the welding ratio of the ones built so far, with an
+// eighth of slack so windows welding a little worse don't each force a resize
+static size_t EstimateVertices(size_t vertices, size_t corners, size_t totalCorners)
+{
+    size_t estimate = (size_t)((double)vertices / (double)corners * (double)totalCorners * 1.125);
+    return estimate < totalCorners ? estimate : totalCorners;
+}
+
+static void CloseSpill(SpillFile& spill)
+{
+    if(spill.file != nullptr)
+        fclose(spill.file);
+    UnmapFile(spill.mapping);
+
+    std::error_code error;
+    std::filesystem::remove(spill.path, error);
+    spill.file = nullptr;
+}
+
+Mesh LoadMeshFromOBJStreaming(const char* path, size_t memoryBudget)
+{
+    // Reading and parsing are interleaved in the first pass, which counts as decoding
+    AssetLoadTimes times = {};
+    double start = GetLoadTimerMilliseconds();
+    FILE* objRaw = fopen(path, "rb");
+    if(!objRaw)
+    {
+        printf("Failed to open OBJ file at path: %s\n", path);
+        return {};
+    }
+
+    SpillFile spills[4];
+    const char* spillNames[4] = { "vertices", "uvs", "normals", "corners" };
+    for(int i = 0; i < 4; i++)
+    {
+        if(!OpenSpill(spills[i], spillNames[i]))
+        {
+            for(int j = 0; j < i; j++)
+                CloseSpill(spills[j]);
+            fclose(objRaw);
+            return {};
+        }
+    }
+
+    // Only needed for progress reports
+    fseek(objRaw, 0, SEEK_END);
+    size_t fileSize = (size_t)ftell(objRaw);
+    rewind(objRaw);
+    size_t bytesRead = 0;
+
+    // An eighth of the budget goes to the text window, its parsed contents take up to twice as much
+    const size_t minWindowSize = 1024 * 1024;
+    size_t windowSize = memoryBudget / 8 > minWindowSize ? memoryBudget / 8 : minWindowSize;
+    Arena arena = CreateArena(windowSize * 3 + 4096);
+    char* window = ArenaPushArray<char>(arena, windowSize + 1);
+    ArenaMarker windowMarker = ArenaGetMarker(arena);
+
+    // First pass: parse the file in windows of complete lines and spill the results
+    size_t carried = 0;
+    size_t numWindows = 0;
+    OBJCounts preceding = {};
+    while(true)
+    {
+        size_t readSize = fread(window + carried, 1, windowSize - carried, objRaw);
+        bytesRead += readSize;
+        size_t available = carried + readSize;
+        bool lastWindow = readSize < windowSize - carried;
+
+        // The partial line at the end of the window gets carried over to the next one
+        size_t parseEnd = available;
+        if(!lastWindow)
+        {
+            while(parseEnd > 0 && window[parseEnd - 1] != '\n')
+                parseEnd--;
+            if(parseEnd == 0)
+            {
+                printf("Line longer than the streaming window in OBJ file: %s\n", path);
+                for(auto& spill : spills)
+                    CloseSpill(spill);
+                DestroyArena(arena);
+                fclose(objRaw);
+                return {};
+            }
+        }
+
+        // Terminate the window for the parser, restoring the carried over character afterwards
+        char saved = window[parseEnd];
+        window[parseEnd] = '\0';
+        OBJData data = ParseOBJText(window, window + parseEnd, preceding, arena);
+        window[parseEnd] = saved;
+        PrintOBJErrors(data, path);
+
+        // A full disk fails the load rather than the process
+        bool spilled = WriteSpill(spills[0], data.vertices, sizeof(glm::vec3), data.counts.vertices) &&
+                       WriteSpill(spills[1], data.uvs, sizeof(glm::vec2), data.counts.uvs) &&
+                       WriteSpill(spills[2], data.normals, sizeof(glm::vec3), data.counts.normals) &&
+                       WriteSpill(spills[3], data.corners, sizeof(OBJCorner), data.counts.triangles * 3);
+        ArenaPopToMarker(arena, windowMarker);
+        if(!spilled)
+        {
+            for(auto& spill : spills)
+                CloseSpill(spill);
+            DestroyArena(arena);
+            fclose(objRaw);
+            return {};
+        }
+
+        // Later windows' relative indices and error lines continue from this one
+        preceding.vertices += data.counts.vertices;
+        preceding.uvs += data.counts.uvs;
+        preceding.normals += data.counts.normals;
+        preceding.lines += data.counts.lines;
+        numWindows++;
+
+        carried = available - parseEnd;
+        memmove(window, window + parseEnd, carried);
+        if(lastWindow)
+            break;
+
+        // Background loads can be cancelled between windows
+        ReportLoadProgress(fileSize > 0 ? 0.5f * (float)bytesRead / (float)fileSize : 0.0f);
+        if(IsLoadCancelled())
+        {
+            for(auto& spill : spills)
+                CloseSpill(spill);
+            DestroyArena(arena);
+            fclose(objRaw);
+            return {};
+        }
+    }
+    fclose(objRaw);
+
+    double parsed = GetLoadTimerMilliseconds();
+    times.decode = parsed - start;
+
+    // The spilled arrays are mapped, so the OS pages them in and out as the faces reference them.
+    // Closing flushes the last writes, which can fail just like the earlier ones.
+    const size_t elementSizes[4] = { sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(OBJCorner) };
+    for(int i = 0; i < 4; i++)
+    {
+        SpillFile& spill = spills[i];
+        bool written = fclose(spill.file) == 0;
+        spill.file = nullptr;
+        bool mapped = written && MapFile(spill.path.c_str(), spill.mapping);
+        bool complete = mapped && spill.mapping.size == spill.count * elementSizes[i];
+        if(!written || (mapped && !complete))
+            printf("Failed to write to temporary file at path: %s\n", spill.path.c_str());
+        if(!complete)
+        {
+            for(auto& s : spills)
+                CloseSpill(s);
+            DestroyArena(arena);
+            return {};
+        }
+    }
+
+    const glm::vec3* vertices = (const glm::vec3*)spills[0].mapping.data;
+    const glm::vec2* uvs = (const glm::vec2*)spills[1].mapping.data;
+    const glm::vec3* normals = (const glm::vec3*)spills[2].mapping.data;
+    const OBJCorner* corners = (const OBJCorner*)spills[3].mapping.data;
+    size_t numCorners = spills[3].count;
+    if(numCorners == 0)
+    {
+        printf("No valid faces in OBJ file at path: %s\n", path);
+        for(auto& spill : spills)
+            CloseSpill(spill);
+        DestroyArena(arena);
+        return {};
+    }
+
+    // Draw calls take the index count as a GLsizei
+    if(numCorners > (size_t)INT_MAX)
+    {
+        printf("Too many faces for 32 bit indices in OBJ file at path: %s\n", path);
+        for(auto& spill : spills)
+            CloseSpill(spill);
+        DestroyArena(arena);
+        return {};
+    }
+
+    // Second pass: build and upload the vertex and index buffers a window of triangles at a time.
+    // Every corner needs around 200 bytes of welding, tangent, clustering and upload memory.
+    const size_t bytesPerCorner = 200;
+    size_t cornersPerWindow = memoryBudget / 2 / bytesPerCorner / 3 * 3;
+    if(cornersPerWindow < 3 * 1024)
+        cornersPerWindow = 3 * 1024;
+
+    // Welding shrinks the vertex count by a ratio only known once windows are built, so the vertex
+    // buffers are sized from the windows so far, grown when one doesn't fit and trimmed at the end
+    Mesh result = {};
+    MeshClusters clusters;
+    size_t vertexBase = 0;
+    for(size_t first = 0; first < numCorners; first += cornersPerWindow)
+    {
+        size_t count = numCorners - first < cornersPerWindow ? numCorners - first : cornersPerWindow;
+
+        ArenaMarker marker = ArenaGetMarker(arena);
+        OBJMesh part = BuildOBJMesh(vertices, uvs, normals, corners + first, count,
+                                    (unsigned int)vertexBase, (unsigned int)first, clusters, arena);
+
+        size_t needed = vertexBase + part.numVertices;
+        if(first == 0 || needed > result.numVertices)
+        {
+            size_t estimate = EstimateVertices(needed, first + count, numCorners);
+            unsigned int capacity = (unsigned int)(estimate > needed ? estimate : needed);
+            if(first == 0)
+            {
+                result = CreateMesh(capacity);
+                CreateMeshIndices(result, (unsigned int)numCorners);
+            }
+            else
+                ResizeMeshVertices(result, capacity, (unsigned int)vertexBase);
+        }
+
+        // The window's vertices and indices were built straight into upload memory
+        double uploadStart = GetLoadTimerMilliseconds();
+        UploadMeshVertices(result, part.upload, (unsigned int)vertexBase);
+        UploadMeshIndexRange(result, part.indices, (unsigned int)first, (unsigned int)count);
+        times.upload += GetLoadTimerMilliseconds() - uploadStart;
+
+        vertexBase += part.numVertices;
+        ArenaPopToMarker(arena, marker);
+
+        ReportLoadProgress(0.5f + 0.5f * (float)(first + count) / (float)numCorners);
+        if(IsLoadCancelled())
+        {
+            DeleteMesh(result);
+            for(auto& spill : spills)
+                CloseSpill(spill);
+            DestroyArena(arena);
+            return {};
+        }
+    }
+    if(result.numVertices > vertexBase)
+        ResizeMeshVertices(result, (unsigned int)vertexBase, (unsigned int)vertexBase);
+    result.clusters = std::move(clusters);
+
+    // A picking BVH would keep tens of bytes per triangle resident, which the memory budget
+    // doesn't allow for, so streamed meshes can't be picked
+    result.streamed = true;
+    times.build = GetLoadTimerMilliseconds() - parsed - times.upload;
+
+    printf("Streamed mesh from .obj file at: %s (%zu text windows, %.2f MiB peak scratch memory)\n",
+           path, numWindows, (double)arena.peak / (1024.0 * 1024.0));
+
+    for(auto& spill : spills)
+        CloseSpill(spill);
+    DestroyArena(arena);
+
+    result.name = path;
+    result.loadTimes = times;
+    return result;
+}
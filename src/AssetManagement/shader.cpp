@@ -1,30 +1,43 @@
 #include "shader.h"
+#include "../Renderer/gl_state.h"
 #include <glad/glad.h>
 
+// Uniforms a shader doesn't have, or that the compiler removed, go to location -1 which GL ignores
+static int GetUniformLocation(const Shader& shader, const std::string& name)
+{
+    auto it = shader.uniformLocations.find(name);
+    return it != shader.uniformLocations.end() ? it->second : -1;
+}
+
 void UseShader(Shader& shader)
 {
-    glUseProgram(shader.ID);
+    UseProgram(shader.ID);
 }
 
 void UniformInt(Shader& shader, const char* location, int value) 
 {
-    glUniform1i(shader.uniformLocations[location], value);
+    glUniform1i(GetUniformLocation(shader, location), value);
 }
 
 void UniformFloat(Shader& shader, const char* location, float value) 
 {
-    glUniform1f(shader.uniformLocations[location], value);
+    glUniform1f(GetUniformLocation(shader, location), value);
 }
 
 void UniformVec3(Shader& shader, const char* location, glm::vec3& value)
 {
-    glUniform3fv(shader.uniformLocations[location], 1, &value.x);
+    glUniform3fv(GetUniformLocation(shader, location), 1, &value.x);
+}
+// Arrays are listed under their first element
+void UniformVec3Array(Shader& shader, const char* location, const glm::vec3* values, int count)
+{
+    glUniform3fv(GetUniformLocation(shader, std::string(location) + "[0]"), count, &values[0].x);
 }
 void UniformVec4(Shader& shader, const char* location, glm::vec4& value)
 {
-    glUniform4fv(shader.uniformLocations[location], 1, &value.x);
+    glUniform4fv(GetUniformLocation(shader, location), 1, &value.x);
 }
 void UniformMat4(Shader& shader, const char* location, glm::mat4& value)
 {
-    glUniformMatrix4fv(shader.uniformLocations[location], 1, GL_FALSE, &value[0][0]);
+    glUniformMatrix4fv(GetUniformLocation(shader, location), 1, GL_FALSE, &value[0][0]);
 }
\ No newline at end of file
@@ -15,5 +15,6 @@ void UseShader(Shader& shader);
 void UniformInt(Shader& shader, const char* location, int value);
 void UniformFloat(Shader& shader, const char* location, float value);
 void UniformVec3(Shader& shader, const char* location, glm::vec3& value);
+void UniformVec3Array(Shader& shader, const char* location, const glm::vec3* values, int count);
 void UniformVec4(Shader& shader, const char* location, glm::vec4& value);
 void UniformMat4(Shader& shader, const char* location, glm::mat4& value);
@@ -1,12 +1,26 @@
 #pragma once
+#include "asset_stats.h"
 #include "../String/string.h"
+#include <cstddef>
+
+// How a texture's texels are interpreted when filtering its mip chain
+enum class TextureType
+{
+    Color,  // sRGB encoded colors
+    Normal, // Tangent space normals remapped to [0, 1]
+    Data    // Linear data such as occlusion, roughness and metalness
+};
 
 struct Texture
 {
     unsigned int width, height, channels;
-    unsigned int ID, index;
+    unsigned int ID;
+    unsigned int levels;
 
-    static int GlobalTextureIndex;
+    // GPU memory taken up by all mip levels
+    size_t memorySize;
 
     String path;
-};
\ No newline at end of file
+
+    AssetLoadTimes loadTimes;
+};
@@ -9,6 +9,24 @@
 #include <cmath>
 #include "../Camera/camera.h"
 
+// ImGui's hover and layout states settle a frame or two after the input that changed them
+static const int RedrawFrames = 3;
+
+static struct
+{
+	int pendingFrames = RedrawFrames;
+	double frameStart = 0.0;
+} pacing;
+
+// Installed before ImGui's, which chains to them
+static void OnMouseButton(GLFWwindow*, int, int, int) { RequestRedraw(); }
+static void OnCursorPos(GLFWwindow*, double, double) { RequestRedraw(); }
+static void OnScroll(GLFWwindow*, double, double) { RequestRedraw(); }
+static void OnKey(GLFWwindow*, int, int, int, int) { RequestRedraw(); }
+static void OnChar(GLFWwindow*, unsigned int) { RequestRedraw(); }
+static void OnFramebufferSize(GLFWwindow*, int, int) { RequestRedraw(); }
+static void OnWindowRefresh(GLFWwindow*) { RequestRedraw(); }
+
 Display CreateDisplay(int width, int height, const char* title)
 {
 	// Init GLFW
@@ -28,6 +46,14 @@ Display CreateDisplay(int width, int height, const char* title)
 	glfwMakeContextCurrent(window);
 	glfwSwapInterval(1);
 
+	glfwSetMouseButtonCallback(window, OnMouseButton);
+	glfwSetCursorPosCallback(window, OnCursorPos);
+	glfwSetScrollCallback(window, OnScroll);
+	glfwSetKeyCallback(window, OnKey);
+	glfwSetCharCallback(window, OnChar);
+	glfwSetFramebufferSizeCallback(window, OnFramebufferSize);
+	glfwSetWindowRefreshCallback(window, OnWindowRefresh);
+
 	// Initialize GLAD
 	if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
@@ -42,11 +68,28 @@ Display CreateDisplay(int width, int height, const char* title)
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
 
+	// Filtered lookups of the prefiltered environments blend across cube faces
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
 	Display result { "", window, width, height, 0.0f, 0.0f, 0, 0.0f, 0.0, 0.0 };
 	strncpy(result.title, title, 511);
 	return result;
 }
 
+GLFWwindow* CreateSharedContext(const Display& display)
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(1, 1, display.title, nullptr, display.window);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if(window == nullptr)
+	{
+		printf("Failed to create shared GL context\n");
+		glfwTerminate();
+		exit(-1);
+	}
+	return window;
+}
+
 void DeltaTimeCalc(Display& display)
 {
 	float currentTime = (float)glfwGetTime();
@@ -110,4 +153,41 @@ void ProcessInput(Display& display, Camera& camera, bool rotating, bool& shouldR
 	}
 	else if(glfwGetMouseButton(display.window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE && !shouldReset)
 		shouldReset = true;
+}
+
+void RequestRedraw()
+{
+	pacing.pendingFrames = RedrawFrames;
+}
+
+void WaitForNextFrame(Display& display, double timeout)
+{
+	if(display.pacing == FramePacing::Benchmark)
+	{
+		glfwPollEvents();
+		pacing.frameStart = glfwGetTime();
+		return;
+	}
+
+	// Events keep being handled while the cap holds the frame back
+	if(display.frameRateCap > 0)
+	{
+		double frameEnd = pacing.frameStart + 1.0 / display.frameRateCap;
+		for(double now = glfwGetTime(); now < frameEnd; now = glfwGetTime())
+			glfwWaitEventsTimeout(frameEnd - now);
+	}
+
+	if(display.pacing == FramePacing::OnDemand && pacing.pendingFrames == 0)
+	{
+		if(timeout > 0.0)
+			glfwWaitEventsTimeout(timeout);
+		else
+			glfwWaitEvents();
+	}
+	else
+		glfwPollEvents();
+
+	if(pacing.pendingFrames > 0)
+		pacing.pendingFrames--;
+	pacing.frameStart = glfwGetTime();
 }
\ No newline at end of file
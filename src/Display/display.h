@@ -2,6 +2,13 @@
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 
+enum class FramePacing
+{
+	OnDemand,	// waits for input or a redraw request, then draws a few frames for the UI to settle
+	Continuous,	// draws every vsync
+	Benchmark	// draws as fast as possible, without vsync or the frame rate cap
+};
+
 struct Display
 {
 	char title[512];
@@ -16,8 +23,25 @@ struct Display
 	float lastFPSTime = 0;
 
 	double mouseX, mouseY;
+
+	FramePacing pacing = FramePacing::OnDemand;
+
+	// Frames per second at most outside benchmark mode, 0 leaves it to vsync
+	int frameRateCap = 0;
 };
 
 Display CreateDisplay(int width, int height, const char* title);
+
+// Creates an invisible window whose context shares objects with the display's,
+// for threads that upload resources while the display's context is in use
+struct GLFWwindow* CreateSharedContext(const Display& display);
 void DeltaTimeCalc(Display& display);
-void ProcessInput(Display& display, struct Camera& camera, bool rotating, bool& shouldReset);
\ No newline at end of file
+void ProcessInput(Display& display, struct Camera& camera, bool rotating, bool& shouldReset);
+
+// Draws the next few frames in on-demand mode, for changes that don't come from window events
+void RequestRedraw();
+
+// Processes window events, first sleeping off what's left of the frame under the cap. In
+// on-demand mode it blocks until an event or redraw request arrives, or for at most timeout
+// seconds when it's positive. Other threads wake it with glfwPostEmptyEvent.
+void WaitForNextFrame(Display& display, double timeout);
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "arena.h"
+#include <cstdio>
+#include <cstdlib>
+
+struct ArenaBlock
+{
+    ArenaBlock* previous;
+    size_t size;
+    size_t offset;
+    unsigned char* data;
+};
+
+static ArenaBlock* AllocateBlock(Arena& arena, size_t size)
+{
+    // The header and the memory it manages come from a single allocation
+    ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+    if(block == nullptr)
+    {
+        printf("Failed to allocate arena block of %zu bytes\n", size);
+        exit(-1);
+    }
+
+    block->previous = arena.current;
+    block->size = size;
+    block->offset = 0;
+    block->data = (unsigned char*)(block + 1);
+
+    arena.current = block;
+    arena.reserved += size;
+    arena.numBlocks++;
+    return block;
+}
+
+Arena CreateArena(size_t blockSize)
+{
+    Arena result = { nullptr, blockSize, 0, 0, 0, 0 };
+    AllocateBlock(result, blockSize);
+    return result;
+}
+
+void DestroyArena(Arena& arena)
+{
+    ArenaBlock* block = arena.current;
+    while(block != nullptr)
+    {
+        ArenaBlock* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+
+    arena.current = nullptr;
+    arena.used = arena.reserved = 0;
+    arena.numBlocks = 0;
+}
+
+// Offset within the block where an allocation with the given alignment can start
+static size_t AlignedOffset(ArenaBlock* block, size_t alignment)
+{
+    size_t address = (size_t)(block->data + block->offset);
+    size_t aligned = (address + alignment - 1) & ~(alignment - 1);
+    return block->offset + (aligned - address);
+}
+
+void* ArenaPush(Arena& arena, size_t size, size_t alignment)
+{
+    ArenaBlock* block = arena.current;
+    size_t start = block != nullptr ? AlignedOffset(block, alignment) : 0;
+
+    // Start a new block when this one is full. Oversized requests get a block of their own.
+    if(block == nullptr || start + size > block->size)
+    {
+        size_t blockSize = size + alignment > arena.blockSize ? size + alignment : arena.blockSize;
+        block = AllocateBlock(arena, blockSize);
+        start = AlignedOffset(block, alignment);
+    }
+
+    arena.used += start - block->offset + size;
+    if(arena.used > arena.peak)
+        arena.peak = arena.used;
+
+    block->offset = start + size;
+    return block->data + start;
+}
+
+ArenaMarker ArenaGetMarker(Arena& arena)
+{
+    return { arena.current, arena.current != nullptr ? arena.current->offset : 0, arena.used };
+}
+
+void ArenaPopToMarker(Arena& arena, ArenaMarker marker)
+{
+    // Free the blocks that were started after the marker was taken
+    while(arena.current != marker.block)
+    {
+        ArenaBlock* previous = arena.current->previous;
+        arena.reserved -= arena.current->size;
+        arena.numBlocks--;
+        free(arena.current);
+        arena.current = previous;
+    }
+
+    if(arena.current != nullptr)
+        arena.current->offset = marker.offset;
+    arena.used = marker.used;
+}
+
+void ArenaReset(Arena& arena)
+{
+    ArenaBlock* first = arena.current;
+    while(first != nullptr && first->previous != nullptr)
+        first = first->previous;
+
+    ArenaPopToMarker(arena, { first, 0, 0 });
+}
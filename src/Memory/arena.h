@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+
+struct ArenaBlock;
+
+// Linear allocator for short lived scratch memory. Pushes bump a pointer
+// within large blocks and everything is released at once, so a load does a
+// handful of big allocations instead of many small growing ones.
+struct Arena
+{
+    ArenaBlock* current;
+    size_t blockSize;
+
+    // Statistics for reporting
+    size_t used;
+    size_t peak;
+    size_t reserved;
+    unsigned int numBlocks;
+};
+
+// Saved position in an arena that can be rolled back to
+struct ArenaMarker
+{
+    ArenaBlock* block;
+    size_t offset;
+    size_t used;
+};
+
+Arena CreateArena(size_t blockSize);
+void DestroyArena(Arena& arena);
+
+// Returns uninitialized memory, never fails short of the system running out of memory
+void* ArenaPush(Arena& arena, size_t size, size_t alignment = 16);
+
+template<typename T>
+T* ArenaPushArray(Arena& arena, size_t count)
+{
+    return (T*)ArenaPush(arena, count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+}
+
+ArenaMarker ArenaGetMarker(Arena& arena);
+void ArenaPopToMarker(Arena& arena, ArenaMarker marker);
+
+// Frees all but the first block and rewinds it, keeping the peak statistic
+void ArenaReset(Arena& arena);
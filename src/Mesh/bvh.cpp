@@ -0,0 +1,483 @@
+#include "bvh.h"
+#include "simd_ops.h"
+#include "../Threading/job_system.h"
+#include "../Threading/parallel_for.h"
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+static const int NumBins = 16;
+static const unsigned int MaxLeafTriangles = 8;
+
+// Cost of stepping into a node relative to testing a triangle
+static const float TraversalCost = 1.0f;
+
+// Nodes this large have their bounds and bins gathered in parallel and their children built as separate jobs
+static const unsigned int ParallelNodeSize = 64 * 1024;
+static const size_t BinChunkSize = 16 * 1024;
+
+// Past this depth nodes are split at the median, which bounds the traversal stack
+static const int MaxSAHDepth = 64;
+static const int TraversalStackSize = 128;
+
+// Offsets of the triangle arrays, in units of numTriangles
+enum { V0X, V0Y, V0Z, E1X, E1Y, E1Z, E2X, E2Y, E2Z, NumTriangleArrays };
+
+struct AABB
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void Grow(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Grow(const AABB& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Half the surface area, which is all the heuristic's ratios need
+    float Area() const
+    {
+        glm::vec3 size = max - min;
+        return size.x < 0.0f ? 0.0f : size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+struct BinnedTriangles
+{
+    AABB bounds[NumBins];
+    unsigned int counts[NumBins] = {};
+};
+
+struct BVHBuilder
+{
+    MeshBVH& bvh;
+    std::vector<AABB> triangleBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<unsigned int> order;
+    std::atomic<unsigned int> numNodes{1};
+};
+
+void BeginMeshBVH(MeshBVH& bvh, size_t numTriangles)
+{
+    bvh.nodes.clear();
+    bvh.numTriangles = numTriangles;
+    bvh.triangles.resize(numTriangles * NumTriangleArrays);
+    bvh.triangleIds.clear();
+}
+
+void SetBVHTriangle(MeshBVH& bvh, size_t index, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    const glm::vec3 values[3] = { a, b - a, c - a };
+    float* triangle = bvh.triangles.data() + index;
+    for(int i = 0; i < 9; i++)
+        triangle[i * bvh.numTriangles] = values[i / 3][i % 3];
+}
+
+static glm::vec3 GetTriangleVector(const MeshBVH& bvh, size_t index, int array)
+{
+    const float* triangle = bvh.triangles.data() + index;
+    size_t n = bvh.numTriangles;
+    return glm::vec3(triangle[array * n], triangle[(array + 1) * n], triangle[(array + 2) * n]);
+}
+
+// Splits a range of the triangle order into chunks, runs them in parallel when it's large enough and merges the results
+template<typename T, typename Gather, typename Merge>
+static T GatherRange(unsigned int first, unsigned int count, Gather gather, Merge merge)
+{
+    if(count < ParallelNodeSize)
+        return gather(first, first + count);
+
+    size_t numChunks = (count + BinChunkSize - 1) / BinChunkSize;
+    std::vector<T> chunks(numChunks);
+    ParallelFor(numChunks, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            size_t chunkFirst = first + i * BinChunkSize;
+            size_t chunkEnd = std::min(chunkFirst + BinChunkSize, (size_t)first + count);
+            chunks[i] = gather((unsigned int)chunkFirst, (unsigned int)chunkEnd);
+        }
+    }, "BVH gather");
+
+    T result = chunks[0];
+    for(size_t i = 1; i < numChunks; i++)
+        merge(result, chunks[i]);
+    return result;
+}
+
+static int GetBin(float centroid, float min, float scale)
+{
+    int bin = (int)((centroid - min) * scale);
+    return bin < 0 ? 0 : (bin >= NumBins ? NumBins - 1 : bin);
+}
+
+static void BuildNode(BVHBuilder& builder, unsigned int nodeIndex, unsigned int first, unsigned int count, int depth)
+{
+    struct NodeBounds
+    {
+        AABB bounds, centroids;
+    };
+    NodeBounds nodeBounds = GatherRange<NodeBounds>(first, count, [&](unsigned int begin, unsigned int end)
+    {
+        NodeBounds result;
+        for(unsigned int i = begin; i < end; i++)
+        {
+            unsigned int triangle = builder.order[i];
+            result.bounds.Grow(builder.triangleBounds[triangle]);
+            result.centroids.Grow(builder.centroids[triangle]);
+        }
+        return result;
+    }, [](NodeBounds& a, const NodeBounds& b)
+    {
+        a.bounds.Grow(b.bounds);
+        a.centroids.Grow(b.centroids);
+    });
+
+    // The vector was sized for the most nodes a build can make, so it never moves
+    BVHNode& node = builder.bvh.nodes[nodeIndex];
+    node.min = nodeBounds.bounds.min;
+    node.max = nodeBounds.bounds.max;
+    node.first = first;
+    node.count = count;
+    if(count <= 1)
+        return;
+
+    const AABB& centroids = nodeBounds.centroids;
+    glm::vec3 extents = centroids.max - centroids.min;
+    int axis = extents.x > extents.y ? (extents.x > extents.z ? 0 : 2) : (extents.y > extents.z ? 1 : 2);
+    float extent = extents[axis];
+
+    // Triangles with coinciding centroids can't be told apart, only split them up if the leaf would be too big
+    unsigned int split = 0;
+    if(extent > 0.0f && depth < MaxSAHDepth)
+    {
+        float binMin = centroids.min[axis];
+        float binScale = NumBins / extent;
+        BinnedTriangles bins = GatherRange<BinnedTriangles>(first, count, [&](unsigned int begin, unsigned int end)
+        {
+            BinnedTriangles result;
+            for(unsigned int i = begin; i < end; i++)
+            {
+                unsigned int triangle = builder.order[i];
+                int bin = GetBin(builder.centroids[triangle][axis], binMin, binScale);
+                result.bounds[bin].Grow(builder.triangleBounds[triangle]);
+                result.counts[bin]++;
+            }
+            return result;
+        }, [](BinnedTriangles& a, const BinnedTriangles& b)
+        {
+            for(int i = 0; i < NumBins; i++)
+            {
+                a.bounds[i].Grow(b.bounds[i]);
+                a.counts[i] += b.counts[i];
+            }
+        });
+
+        // Sweep from both ends for the cost of splitting after each bin
+        float leftCosts[NumBins - 1];
+        unsigned int leftCounts[NumBins - 1];
+        AABB left;
+        unsigned int numLeft = 0;
+        for(int i = 0; i < NumBins - 1; i++)
+        {
+            left.Grow(bins.bounds[i]);
+            numLeft += bins.counts[i];
+            leftCosts[i] = left.Area() * numLeft;
+            leftCounts[i] = numLeft;
+        }
+
+        AABB right;
+        unsigned int numRight = 0;
+        float bestCost = FLT_MAX;
+        int bestBin = -1;
+        for(int i = NumBins - 1; i > 0; i--)
+        {
+            right.Grow(bins.bounds[i]);
+            numRight += bins.counts[i];
+            float cost = leftCosts[i - 1] + right.Area() * numRight;
+            if(leftCounts[i - 1] > 0 && numRight > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                bestBin = i - 1;
+            }
+        }
+
+        float splitCost = TraversalCost + bestCost / nodeBounds.bounds.Area();
+        if((bestBin < 0 || splitCost >= (float)count) && count <= MaxLeafTriangles)
+            return;
+
+        if(bestBin >= 0)
+        {
+            unsigned int* begin = builder.order.data() + first;
+            unsigned int* middle = std::partition(begin, begin + count, [&](unsigned int triangle)
+            {
+                return GetBin(builder.centroids[triangle][axis], binMin, binScale) <= bestBin;
+            });
+            split = (unsigned int)(middle - begin);
+        }
+    }
+    else if(count <= MaxLeafTriangles)
+        return;
+
+    // Degenerate or too deep, split at the median
+    if(split == 0 || split == count)
+    {
+        unsigned int* begin = builder.order.data() + first;
+        split = count / 2;
+        std::nth_element(begin, begin + split, begin + count, [&](unsigned int a, unsigned int b)
+        {
+            return builder.centroids[a][axis] < builder.centroids[b][axis];
+        });
+    }
+
+    unsigned int children = builder.numNodes.fetch_add(2);
+    node.first = children;
+    node.count = 0;
+
+    if(count >= ParallelNodeSize)
+    {
+        JobCounter counter;
+        RunJob("BVH subtree", [&builder, children, first, split, depth] { BuildNode(builder, children, first, split, depth + 1); }, counter);
+        BuildNode(builder, children + 1, first + split, count - split, depth + 1);
+        WaitForCounter(counter);
+    }
+    else
+    {
+        BuildNode(builder, children, first, split, depth + 1);
+        BuildNode(builder, children + 1, first + split, count - split, depth + 1);
+    }
+}
+
+void BuildMeshBVH(MeshBVH& bvh)
+{
+    size_t n = bvh.numTriangles;
+    bvh.nodes.clear();
+    bvh.triangleIds.clear();
+    if(n == 0)
+        return;
+
+    BVHBuilder builder = { bvh, std::vector<AABB>(n), std::vector<glm::vec3>(n), std::vector<unsigned int>(n) };
+    ParallelFor(n, 4096, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 a = GetTriangleVector(bvh, i, V0X);
+            glm::vec3 b = a + GetTriangleVector(bvh, i, E1X);
+            glm::vec3 c = a + GetTriangleVector(bvh, i, E2X);
+            AABB& bounds = builder.triangleBounds[i];
+            bounds = AABB();
+            bounds.Grow(a);
+            bounds.Grow(b);
+            bounds.Grow(c);
+            builder.centroids[i] = (a + b + c) * (1.0f / 3.0f);
+            builder.order[i] = (unsigned int)i;
+        }
+    }, "BVH bounds");
+
+    // A binary tree with one triangle per leaf has 2n - 1 nodes
+    bvh.nodes.resize(2 * n - 1);
+    BuildNode(builder, 0, 0, (unsigned int)n, 0);
+    bvh.nodes.resize(builder.numNodes);
+
+    // Store the triangles in leaf order, so each leaf's are contiguous
+    std::vector<float> sorted(n * NumTriangleArrays);
+    bvh.triangleIds.resize(n);
+    ParallelFor(n, 4096, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            unsigned int source = builder.order[i];
+            for(int array = 0; array < NumTriangleArrays; array++)
+                sorted[array * n + i] = bvh.triangles[array * n + source];
+            bvh.triangleIds[i] = source;
+        }
+    }, "BVH reorder");
+    bvh.triangles.swap(sorted);
+}
+
+void BuildMeshBVH(const float* positions, const unsigned int* indices, size_t numTriangles, MeshBVH& result)
+{
+    BeginMeshBVH(result, numTriangles);
+    ParallelFor(numTriangles, 4096, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::vec3 corners[3];
+            for(size_t j = 0; j < 3; j++)
+            {
+                size_t vertex = indices != nullptr ? indices[i * 3 + j] : i * 3 + j;
+                corners[j] = glm::vec3(positions[vertex * 3], positions[vertex * 3 + 1], positions[vertex * 3 + 2]);
+            }
+            SetBVHTriangle(result, i, corners[0], corners[1], corners[2]);
+        }
+    }, "BVH triangles");
+    BuildMeshBVH(result);
+}
+
+template<typename Ops>
+static inline typename Ops::V And(typename Ops::V a, typename Ops::V b)
+{
+    return Ops::Select(a, b, Ops::Set(0.0f));
+}
+
+template<typename Ops>
+static inline Vec3<Ops> Cross(const Vec3<Ops>& a, const Vec3<Ops>& b)
+{
+    return { Ops::Sub(Ops::Mul(a.y, b.z), Ops::Mul(a.z, b.y)),
+             Ops::Sub(Ops::Mul(a.z, b.x), Ops::Mul(a.x, b.z)),
+             Ops::Sub(Ops::Mul(a.x, b.y), Ops::Mul(a.y, b.x)) };
+}
+
+// Moller-Trumbore against Ops::Width consecutive triangles, keeping the nearest hit
+template<typename Ops>
+static void IntersectTriangles(const MeshBVH& bvh, size_t first, const glm::vec3& origin, const glm::vec3& direction,
+                               float& nearest, size_t& nearestIndex)
+{
+    typedef typename Ops::V V;
+    const float* t = bvh.triangles.data() + first;
+    size_t n = bvh.numTriangles;
+
+    Vec3<Ops> v0 = { Ops::Load(t + V0X * n), Ops::Load(t + V0Y * n), Ops::Load(t + V0Z * n) };
+    Vec3<Ops> e1 = { Ops::Load(t + E1X * n), Ops::Load(t + E1Y * n), Ops::Load(t + E1Z * n) };
+    Vec3<Ops> e2 = { Ops::Load(t + E2X * n), Ops::Load(t + E2Y * n), Ops::Load(t + E2Z * n) };
+    Vec3<Ops> o = { Ops::Set(origin.x), Ops::Set(origin.y), Ops::Set(origin.z) };
+    Vec3<Ops> d = { Ops::Set(direction.x), Ops::Set(direction.y), Ops::Set(direction.z) };
+
+    Vec3<Ops> p = Cross(d, e2);
+    V det = Dot(e1, p);
+    V inverse = Ops::Div(Ops::Set(1.0f), det);
+    Vec3<Ops> s = Subtract(o, v0);
+    V u = Ops::Mul(Dot(s, p), inverse);
+    Vec3<Ops> q = Cross(s, e1);
+    V v = Ops::Mul(Dot(d, q), inverse);
+    V distance = Ops::Mul(Dot(e2, q), inverse);
+
+    // Comparisons with NaN fail, which takes care of parallel triangles
+    const float epsilon = 1e-6f;
+    V hit = Ops::Greater(Ops::Abs(det), Ops::Set(0.0f));
+    hit = And<Ops>(hit, Ops::Greater(u, Ops::Set(-epsilon)));
+    hit = And<Ops>(hit, Ops::Greater(v, Ops::Set(-epsilon)));
+    hit = And<Ops>(hit, Ops::Greater(Ops::Set(1.0f + epsilon), Ops::Add(u, v)));
+    hit = And<Ops>(hit, Ops::Greater(distance, Ops::Set(0.0f)));
+    hit = And<Ops>(hit, Ops::Greater(Ops::Set(nearest), distance));
+    if(Ops::MoveMask(hit) == 0)
+        return;
+
+    float distances[Ops::Width];
+    Ops::Store(distances, Ops::Select(hit, distance, Ops::Set(FLT_MAX)));
+    for(int i = 0; i < Ops::Width; i++)
+    {
+        if(distances[i] < nearest)
+        {
+            nearest = distances[i];
+            nearestIndex = first + i;
+        }
+    }
+}
+
+// Entry distance of the ray into the node's box, or false if it misses within maxDistance
+static bool IntersectBounds(const BVHNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry)
+{
+    glm::vec3 t0 = (node.min - origin) * inverseDirection;
+    glm::vec3 t1 = (node.max - origin) * inverseDirection;
+    glm::vec3 nearT = glm::min(t0, t1);
+    glm::vec3 farT = glm::max(t0, t1);
+    entry = std::max(std::max(nearT.x, nearT.y), std::max(nearT.z, 0.0f));
+    float exit = std::min(std::min(farT.x, farT.y), std::min(farT.z, maxDistance));
+    return entry <= exit;
+}
+
+bool IntersectMeshBVH(const MeshBVH& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BVHHit& hit)
+{
+    if(bvh.nodes.empty())
+        return false;
+
+    // Zero components become huge instead of infinite, so the slabs never multiply zero by infinity
+    glm::vec3 inverseDirection;
+    for(int i = 0; i < 3; i++)
+        inverseDirection[i] = 1.0f / (direction[i] != 0.0f ? direction[i] : 1e-30f);
+
+    float nearest = maxDistance;
+    size_t nearestIndex = bvh.numTriangles;
+
+    float entry;
+    if(!IntersectBounds(bvh.nodes[0], origin, inverseDirection, nearest, entry))
+        return false;
+
+    // Nearer children are visited first, the farther ones wait with their entry distance
+    struct StackEntry
+    {
+        unsigned int node;
+        float entry;
+    };
+    StackEntry stack[TraversalStackSize];
+    int stackSize = 0;
+    unsigned int index = 0;
+    while(true)
+    {
+        const BVHNode& node = bvh.nodes[index];
+        bool descend = false;
+        if(node.count > 0)
+        {
+            size_t i = node.first;
+            size_t end = (size_t)node.first + node.count;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+            for(; i + WideOps::Width <= end; i += WideOps::Width)
+                IntersectTriangles<WideOps>(bvh, i, origin, direction, nearest, nearestIndex);
+#endif
+            for(; i < end; i++)
+                IntersectTriangles<ScalarOps>(bvh, i, origin, direction, nearest, nearestIndex);
+        }
+        else
+        {
+            float entries[2];
+            bool hits[2];
+            for(int i = 0; i < 2; i++)
+                hits[i] = IntersectBounds(bvh.nodes[node.first + i], origin, inverseDirection, nearest, entries[i]);
+
+            if(hits[0] && hits[1])
+            {
+                int nearChild = entries[0] <= entries[1] ? 0 : 1;
+                stack[stackSize++] = { node.first + 1 - nearChild, entries[1 - nearChild] };
+                index = node.first + nearChild;
+                descend = true;
+            }
+            else if(hits[0] || hits[1])
+            {
+                index = node.first + (hits[0] ? 0 : 1);
+                descend = true;
+            }
+        }
+
+        if(descend)
+            continue;
+
+        // Skip boxes that start beyond a hit found since they were pushed
+        while(stackSize > 0 && stack[stackSize - 1].entry > nearest)
+            stackSize--;
+        if(stackSize == 0)
+            break;
+        index = stack[--stackSize].node;
+    }
+
+    if(nearestIndex == bvh.numTriangles)
+        return false;
+
+    hit.distance = nearest;
+    hit.triangle = bvh.triangleIds[nearestIndex];
+    hit.normal = glm::cross(GetTriangleVector(bvh, nearestIndex, E1X), GetTriangleVector(bvh, nearestIndex, E2X));
+    return true;
+}
+
+size_t GetMeshBVHMemory(const MeshBVH& bvh)
+{
+    return bvh.nodes.size() * sizeof(BVHNode) + bvh.triangles.size() * sizeof(float) + bvh.triangleIds.size() * sizeof(unsigned int);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <vector>
+
+// Interior nodes have count 0 and their children at first and first + 1,
+// leaves hold count triangles starting at first
+struct BVHNode
+{
+    glm::vec3 min;
+    unsigned int first;
+    glm::vec3 max;
+    unsigned int count;
+};
+
+// Bounding volume hierarchy over a mesh's triangles for ray casts on the CPU. Triangles are
+// stored as a corner and two edges, nine float arrays of numTriangles each in leaf order,
+// so a leaf's triangles are tested several at a time.
+struct MeshBVH
+{
+    std::vector<BVHNode> nodes;
+    std::vector<float> triangles;
+    size_t numTriangles = 0;
+
+    // Index each stored triangle was set at, its place in the index buffer for most meshes
+    std::vector<unsigned int> triangleIds;
+};
+
+struct BVHHit
+{
+    float distance;
+    unsigned int triangle;
+    glm::vec3 normal;
+};
+
+// Allocates the triangle arrays, which are then filled with SetBVHTriangle (from any
+// thread) before BuildMeshBVH partitions them with the surface area heuristic
+void BeginMeshBVH(MeshBVH& bvh, size_t numTriangles);
+void SetBVHTriangle(MeshBVH& bvh, size_t index, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+void BuildMeshBVH(MeshBVH& bvh);
+
+// Builds from tightly packed xyz positions and three indices per triangle,
+// or consecutive corners when indices is null
+void BuildMeshBVH(const float* positions, const unsigned int* indices, size_t numTriangles, MeshBVH& result);
+
+// Nearest hit along origin + direction * t for t in (0, maxDistance). The distance is
+// in units of direction's length and the normal is unnormalized, facing either way.
+bool IntersectMeshBVH(const MeshBVH& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BVHHit& hit);
+
+size_t GetMeshBVHMemory(const MeshBVH& bvh);
@@ -1,79 +1,198 @@
 #include "mesh.h"
+#include "../Renderer/gl_state.h"
 #include <glad/glad.h>
+#include <cstring>
 
-void Draw(Mesh& mesh)
+void BindMesh(Mesh& mesh)
 {
-    glBindVertexArray(mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, mesh.numVertices);
+    if(mesh.VAO == 0)
+        CreateMeshVertexArray(mesh);
+    BindVertexArray(mesh.VAO);
 }
 
-void DrawLines(Mesh& mesh)
+void Draw(Mesh& mesh)
 {
-    glBindVertexArray(mesh.VAO);
-    glDrawArrays(GL_LINES, 0, mesh.numVertices);
+    BindMesh(mesh);
+    if(mesh.numIndices > 0)
+        glDrawElements(GL_TRIANGLES, mesh.numIndices, mesh.indexType, nullptr);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, mesh.numVertices);
 }
 
 void Draw(MeshIndexed& mesh)
 {
-    glBindVertexArray(mesh.VAO);
+    BindVertexArray(mesh.VAO);
     glDrawElements(GL_TRIANGLES, mesh.numVertices, GL_UNSIGNED_INT, nullptr);
 }
 
-Mesh GenerateMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec3>& tangents, std::vector<glm::vec3>& bitangents)
+MeshUpload BeginMeshUpload(unsigned int numVertices)
 {
-    Mesh result;
-    result.numVertices = (unsigned int)vertices.size();
+    size_t vec3Size = (size_t)numVertices * sizeof(glm::vec3);
+    size_t vec2Size = (size_t)numVertices * sizeof(glm::vec2);
+
+    MeshUpload result;
+    result.memory = StagingAlloc((size_t)numVertices * MeshVertexSize);
+    result.numVertices = numVertices;
+
+    unsigned char* data = result.memory.data;
+    result.vertices = (glm::vec3*)data;
+    result.uvs = (glm::vec2*)(data + vec3Size);
+    result.normals = (glm::vec3*)(data + vec3Size + vec2Size);
+    result.tangents = (glm::vec4*)(data + 2 * vec3Size + vec2Size);
+    return result;
+}
 
-    glGenVertexArrays(1, &result.VAO);
-    glBindVertexArray(result.VAO);
-    glGenBuffers(5, result.VBO);
+// Attribute layout shared by all loaded meshes:
+// positions, UVs, normals and tangents with their handedness as attributes 0 to 3
+static const int streamComponents[4] = { 3, 2, 3, 4 };
 
-    // Pass vertex positions as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, (int)vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+Mesh CreateMesh(unsigned int numVertices)
+{
+    Mesh result = {};
+    result.numVertices = numVertices;
+    result.vertexMemory = (size_t)numVertices * MeshVertexSize;
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glGenBuffers(4, result.VBO);
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, result.VBO[i]);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)numVertices * streamComponents[i] * sizeof(float), nullptr, GL_STATIC_DRAW);
+    }
 
-    // Pass UVs as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, (int)uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+    return result;
+}
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+void CreateMeshVertexArray(Mesh& mesh)
+{
+    glGenVertexArrays(1, &mesh.VAO);
+    BindVertexArray(mesh.VAO);
 
-    // Pass normals as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, (int)normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO[i]);
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, streamComponents[i], GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if(mesh.EBO != 0)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+}
 
-    // Pass tangents as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[3]);
-    glBufferData(GL_ARRAY_BUFFER, (int)tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
+void DeleteMesh(Mesh& mesh)
+{
+    if(mesh.VAO != 0)
+        DeleteVertexArray(mesh.VAO);
+    glDeleteBuffers(4, mesh.VBO);
+    if(mesh.EBO != 0)
+        glDeleteBuffers(1, &mesh.EBO);
+
+    mesh.VAO = mesh.EBO = 0;
+    mesh.numVertices = mesh.numIndices = 0;
+    mesh.vertexMemory = mesh.indexMemory = 0;
+    mesh.clusters = {};
+    mesh.bvh = {};
+}
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+void ResizeMeshVertices(Mesh& mesh, unsigned int numVertices, unsigned int numKept)
+{
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        size_t stride = streamComponents[i] * sizeof(float);
+        unsigned int resized;
+        glGenBuffers(1, &resized);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(numVertices * stride), nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.VBO[i]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)(numKept * stride));
+        glDeleteBuffers(1, &mesh.VBO[i]);
+        mesh.VBO[i] = resized;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    mesh.numVertices = numVertices;
+    mesh.vertexMemory = (size_t)numVertices * MeshVertexSize;
+}
+
+void UploadMeshVertices(Mesh& mesh, MeshUpload& upload, unsigned int firstVertex)
+{
+    // Streams are laid out back to back in the upload
+    size_t srcOffset = 0;
+    for(unsigned int i = 0; i < 4; i++)
+    {
+        size_t stride = streamComponents[i] * sizeof(float);
+        size_t size = (size_t)upload.numVertices * stride;
 
-    // Pass bitangents as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[4]);
-    glBufferData(GL_ARRAY_BUFFER, (int)bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO[i]);
+        StagingUploadBuffer(upload.memory, srcOffset, GL_ARRAY_BUFFER, (size_t)firstVertex * stride, size);
+        srcOffset += size;
+    }
 
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    StagingRelease(upload.memory);
+}
+
+void UploadMeshStream(Mesh& mesh, unsigned int stream, const void* data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO[stream]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)mesh.numVertices * streamComponents[stream] * sizeof(float), data);
+}
+
+void UploadMeshIndices(Mesh& mesh, const void* indices, unsigned int numIndices, unsigned int indexType)
+{
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    mesh.numIndices = numIndices;
+    mesh.indexType = indexType;
+    mesh.indexMemory = numIndices * indexSize;
+
+    // Filled through the copy target, the element buffer binding is made along with the vertex array
+    glGenBuffers(1, &mesh.EBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(numIndices * indexSize), indices, GL_STATIC_DRAW);
+}
+
+void CreateMeshIndices(Mesh& mesh, unsigned int numIndices)
+{
+    mesh.numIndices = numIndices;
+    mesh.indexType = GL_UNSIGNED_INT;
+    mesh.indexMemory = (size_t)numIndices * sizeof(unsigned int);
 
+    glGenBuffers(1, &mesh.EBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)numIndices * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+}
+
+void UploadMeshIndexRange(Mesh& mesh, StagingAllocation& indices, unsigned int firstIndex, unsigned int numIndices)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.EBO);
+    StagingUploadBuffer(indices, 0, GL_COPY_WRITE_BUFFER, (size_t)firstIndex * sizeof(unsigned int), (size_t)numIndices * sizeof(unsigned int));
+    StagingRelease(indices);
+}
+
+Mesh EndMeshUpload(MeshUpload& upload)
+{
+    Mesh result = CreateMesh(upload.numVertices);
+    UploadMeshVertices(result, upload, 0);
     return result;
 }
 
-MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec3>& tangents, std::vector<glm::vec3>& bitangents)
+Mesh GenerateMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents)
+{
+    MeshUpload upload = BeginMeshUpload((unsigned int)vertices.size());
+    memcpy(upload.vertices, vertices.data(), vertices.size() * sizeof(glm::vec3));
+    memcpy(upload.uvs, uvs.data(), uvs.size() * sizeof(glm::vec2));
+    memcpy(upload.normals, normals.data(), normals.size() * sizeof(glm::vec3));
+    memcpy(upload.tangents, tangents.data(), tangents.size() * sizeof(glm::vec4));
+    return EndMeshUpload(upload);
+}
+
+MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents)
 {
     MeshIndexed result;
     result.numVertices = (unsigned int)indices.size();
 
     glGenVertexArrays(1, &result.VAO);
-    glBindVertexArray(result.VAO);
-    glGenBuffers(5, result.VBO);
+    BindVertexArray(result.VAO);
+    glGenBuffers(4, result.VBO);
 
     // Pass vertex positions as attribute
     glBindBuffer(GL_ARRAY_BUFFER, result.VBO[0]);
@@ -96,19 +215,12 @@ MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<un
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-    // Pass tangents as attribute
+    // Pass tangents with their handedness as attribute
     glBindBuffer(GL_ARRAY_BUFFER, result.VBO[3]);
-    glBufferData(GL_ARRAY_BUFFER, (int)tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, (int)tangents.size() * sizeof(glm::vec4), &tangents[0], GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    // Pass bitangents as attribute
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[4]);
-    glBufferData(GL_ARRAY_BUFFER, (int)bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     // Pass indices
     glGenBuffers(1, &result.EBO);
@@ -117,177 +229,3 @@ MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<un
 
     return result;
 }
-
-Mesh GenerateCube()
-{
-    float vertices[]
-	{
-		// front
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-
-        // back
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-
-        // bottom
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, -1.0f,
-
-        // top
-        -1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-
-        // left
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-
-        // right
-        1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-	};
-
-    Mesh result;
-    result.numVertices = 36;
-    
-    glGenVertexArrays(1, &result.VAO);
-    glBindVertexArray(result.VAO);
-    
-    glGenBuffers(1, &result.VBO[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, 36 * 3 * sizeof(float), vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
-    return result;
-}
-
-Mesh GenerateInvertedCube()
-{
-    float vertices[]
-    {
-        // front
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-
-        // back
-        1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-
-        // bottom
-        -1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, 1.0f, -1.0f,
-
-        // top
-        -1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f, 1.0f,
-
-        // left
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-
-        // right
-        -1.0f, -1.0f, 1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, -1.0f,
-        -1.0f, 1.0f, 1.0f,
-        -1.0f, -1.0f, 1.0f,
-    };
-
-    Mesh result;
-    result.numVertices = 36;
-
-    glGenVertexArrays(1, &result.VAO);
-    glBindVertexArray(result.VAO);
-
-    glGenBuffers(1, &result.VBO[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, 36 * 3 * sizeof(float), vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
-    return result;
-}
-
-Mesh GenerateAxes()
-{
-    float vertices[]
-    {
-        // x axis
-        1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-
-        // y axis
-        0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-        0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-
-        // z axis
-        0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
-    };
-
-    Mesh result;
-    result.numVertices = 6;
-
-    glGenVertexArrays(1, &result.VAO);
-    glBindVertexArray(result.VAO);
-
-    glGenBuffers(1, &result.VBO[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, 6 * 6 * sizeof(float), vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    return result;
-}
@@ -1,39 +1,99 @@
 #pragma once
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <vector>
+#include "bvh.h"
+#include "meshlets.h"
+#include "../AssetManagement/asset_stats.h"
+#include "../String/string.h"
+#include "../Renderer/staging_buffer.h"
 
 struct Mesh
 {
-    char name[128];
+    String name;
     unsigned int VAO;
-    unsigned int VBO[5];
+    unsigned int VBO[4];
     unsigned int numVertices;
+
+    // Optional index buffer, drawn with glDrawElements when numIndices isn't 0
+    unsigned int EBO;
+    unsigned int numIndices;
+    unsigned int indexType;
+
+    // Clusters for culling, empty for meshes that are always drawn whole
+    MeshClusters clusters;
+
+    // Triangles kept on the CPU for picking, empty for generated and streamed meshes
+    MeshBVH bvh;
+
+    // Imported in bounded memory windows, too large to keep its triangles on the CPU for picking
+    bool streamed;
+
+    // GPU memory of the vertex and index buffers
+    size_t vertexMemory;
+    size_t indexMemory;
+
+    AssetLoadTimes loadTimes;
 };
 
 struct MeshIndexed
 {
-    char name[128];
+    String name;
     unsigned int VAO;
-    unsigned int VBO[5];
+    unsigned int VBO[4];
     unsigned int EBO;
     unsigned int numVertices;
 };
 
-struct Entity
+// Bytes per vertex across the position, UV, normal and tangent streams
+const size_t MeshVertexSize = 2 * sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec4);
+
+// Vertex streams laid out back to back in upload memory, so loaders
+// can write their output directly where the GPU copies it from
+struct MeshUpload
 {
-    glm::vec3 position;
-    glm::vec3 rotation;
-    glm::vec3 scale;
+    StagingAllocation memory;
+    unsigned int numVertices;
+
+    glm::vec3* vertices;
+    glm::vec2* uvs;
+    glm::vec3* normals;
+    glm::vec4* tangents;
 };
 
+// Binds the mesh's vertex array, made on first use as vertex arrays belong to the context that
+// creates them. Meshes can be loaded on any context sharing objects with the one drawing them.
+void BindMesh(Mesh& mesh);
 void Draw(Mesh& mesh);
-void DrawLines(Mesh& mesh);
 void Draw(MeshIndexed& mesh);
 
-Mesh GenerateMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec3>& tangents, std::vector<glm::vec3>& bitangents);
-MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec3>& tangents, std::vector<glm::vec3>& bitangents);
+MeshUpload BeginMeshUpload(unsigned int numVertices);
+Mesh EndMeshUpload(MeshUpload& upload);
+
+// Allocates a mesh's vertex buffers without filling them, so they can be uploaded in parts
+Mesh CreateMesh(unsigned int numVertices);
+
+// Creates a vertex array around the mesh's existing buffers
+void CreateMeshVertexArray(Mesh& mesh);
+
+// Deletes the mesh's buffers, and its vertex array which has to be done on the context that drew it
+void DeleteMesh(Mesh& mesh);
+void UploadMeshVertices(Mesh& mesh, MeshUpload& upload, unsigned int firstVertex);
+
+// Reallocates the vertex buffers for numVertices, keeping their first numKept vertices.
+// The copy stays on the GPU. Has to be done before the mesh's vertex array is made.
+void ResizeMeshVertices(Mesh& mesh, unsigned int numVertices, unsigned int numKept);
+
+// Uploads a whole vertex stream (0 to 3: positions, UVs, normals, tangents) from client memory
+void UploadMeshStream(Mesh& mesh, unsigned int stream, const void* data);
+
+// Index type is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+void UploadMeshIndices(Mesh& mesh, const void* indices, unsigned int numIndices, unsigned int indexType);
+
+// Allocates a 32 bit index buffer to be filled in parts from upload memory
+void CreateMeshIndices(Mesh& mesh, unsigned int numIndices);
+void UploadMeshIndexRange(Mesh& mesh, StagingAllocation& indices, unsigned int firstIndex, unsigned int numIndices);
 
-Mesh GenerateCube();
-Mesh GenerateInvertedCube();
-Mesh GenerateAxes();
\ No newline at end of file
+Mesh GenerateMesh(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents);
+MeshIndexed GenerateMeshIndexed(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals, std::vector<glm::vec4>& tangents);
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include "meshlets.h"
+#include "mesh.h"
+#include "simd_ops.h"
+#include "../Memory/arena.h"
+#include "../Threading/parallel_for.h"
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <glad/glad.h>
+
+// Cluster being filled by BuildMeshlets
+struct MeshletBuilder
+{
+    unsigned int vertices[MaxMeshletVertices];
+    unsigned int numVertices;
+    unsigned int numTriangles;
+    float normalSum[3];
+};
+
+void BuildMeshlets(const float* px, const float* py, const float* pz, size_t numVertices,
+                   unsigned int* indices, size_t numIndices, unsigned int indexBase, MeshClusters& result, Arena& scratch)
+{
+    size_t numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+
+    ArenaMarker marker = ArenaGetMarker(scratch);
+
+    // Unit face normals, zero for degenerate triangles
+    float* faceNormals = ArenaPushArray<float>(scratch, numTriangles * 3);
+    for(size_t t = 0; t < numTriangles; t++)
+    {
+        unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        float e1x = px[b] - px[a], e1y = py[b] - py[a], e1z = pz[b] - pz[a];
+        float e2x = px[c] - px[a], e2y = py[c] - py[a], e2z = pz[c] - pz[a];
+        float nx = e1y * e2z - e1z * e2y;
+        float ny = e1z * e2x - e1x * e2z;
+        float nz = e1x * e2y - e1y * e2x;
+        float length = sqrtf(nx * nx + ny * ny + nz * nz);
+        float inverse = length > 1e-20f ? 1.0f / length : 0.0f;
+        faceNormals[t * 3] = nx * inverse;
+        faceNormals[t * 3 + 1] = ny * inverse;
+        faceNormals[t * 3 + 2] = nz * inverse;
+    }
+
+    // Triangles around each vertex, as offsets into one shared array
+    unsigned int* adjacencyOffsets = ArenaPushArray<unsigned int>(scratch, numVertices + 1);
+    memset(adjacencyOffsets, 0, (numVertices + 1) * sizeof(unsigned int));
+    for(size_t i = 0; i < numTriangles * 3; i++)
+        adjacencyOffsets[indices[i] + 1]++;
+    for(size_t v = 0; v < numVertices; v++)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+    unsigned int* adjacency = ArenaPushArray<unsigned int>(scratch, numTriangles * 3);
+    unsigned int* fill = ArenaPushArray<unsigned int>(scratch, numVertices);
+    memcpy(fill, adjacencyOffsets, numVertices * sizeof(unsigned int));
+    for(size_t i = 0; i < numTriangles * 3; i++)
+        adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+    unsigned char* emitted = ArenaPushArray<unsigned char>(scratch, numTriangles);
+    memset(emitted, 0, numTriangles);
+
+    // Vertices are tagged with the id of the cluster they were last added to
+    unsigned int* vertexMeshlet = ArenaPushArray<unsigned int>(scratch, numVertices);
+    for(size_t v = 0; v < numVertices; v++)
+        vertexMeshlet[v] = ~0u;
+
+    // Triangles in cluster order
+    unsigned int* order = ArenaPushArray<unsigned int>(scratch, numTriangles);
+
+    MeshletBuilder meshlet = {};
+    unsigned int meshletId = 0;
+    size_t numWritten = 0;
+    size_t seed = 0;
+
+    auto finishMeshlet = [&]()
+    {
+        size_t firstTriangle = numWritten - meshlet.numTriangles;
+        result.meshlets.push_back({ indexBase + (unsigned int)(firstTriangle * 3), meshlet.numTriangles * 3 });
+
+        // Bounding sphere around the center of the cluster's bounding box
+        float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for(unsigned int i = 0; i < meshlet.numVertices; i++)
+        {
+            unsigned int v = meshlet.vertices[i];
+            float p[3] = { px[v], py[v], pz[v] };
+            for(int k = 0; k < 3; k++)
+            {
+                minimum[k] = p[k] < minimum[k] ? p[k] : minimum[k];
+                maximum[k] = p[k] > maximum[k] ? p[k] : maximum[k];
+            }
+        }
+
+        float center[3] = { (minimum[0] + maximum[0]) * 0.5f, (minimum[1] + maximum[1]) * 0.5f, (minimum[2] + maximum[2]) * 0.5f };
+        float radiusSq = 0.0f;
+        for(unsigned int i = 0; i < meshlet.numVertices; i++)
+        {
+            unsigned int v = meshlet.vertices[i];
+            float dx = px[v] - center[0], dy = py[v] - center[1], dz = pz[v] - center[2];
+            float distanceSq = dx * dx + dy * dy + dz * dz;
+            radiusSq = distanceSq > radiusSq ? distanceSq : radiusSq;
+        }
+
+        // Normal cone around the average face normal. The cutoff is the sine of the cone's
+        // half angle, clusters spreading close to a hemisphere or more are never culled.
+        float axis[3] = { meshlet.normalSum[0], meshlet.normalSum[1], meshlet.normalSum[2] };
+        float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        float minDot = axisLength > 1e-20f ? 1.0f : -1.0f;
+        for(int k = 0; k < 3; k++)
+            axis[k] = axisLength > 1e-20f ? axis[k] / axisLength : 0.0f;
+
+        for(size_t t = firstTriangle; t < numWritten; t++)
+        {
+            const float* n = faceNormals + (size_t)order[t] * 3;
+            if(n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+                continue;
+
+            float d = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+            minDot = d < minDot ? d : minDot;
+        }
+
+        result.centerX.push_back(center[0]);
+        result.centerY.push_back(center[1]);
+        result.centerZ.push_back(center[2]);
+        result.radius.push_back(sqrtf(radiusSq));
+        result.axisX.push_back(axis[0]);
+        result.axisY.push_back(axis[1]);
+        result.axisZ.push_back(axis[2]);
+        result.cutoff.push_back(minDot > 0.1f ? sqrtf(1.0f - minDot * minDot) : 1.0f);
+
+        meshlet.numVertices = 0;
+        meshlet.numTriangles = 0;
+        meshlet.normalSum[0] = meshlet.normalSum[1] = meshlet.normalSum[2] = 0.0f;
+        meshletId++;
+    };
+
+    while(numWritten < numTriangles)
+    {
+        // Grow the cluster with the neighbouring triangle adding the fewest new vertices,
+        // breaking ties by how close its normal is to the cluster's average
+        unsigned int best = ~0u;
+        if(meshlet.numTriangles > 0)
+        {
+            float axis[3] = { meshlet.normalSum[0], meshlet.normalSum[1], meshlet.normalSum[2] };
+            float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            for(int k = 0; k < 3; k++)
+                axis[k] = axisLength > 1e-20f ? axis[k] / axisLength : 0.0f;
+
+            float bestScore = FLT_MAX;
+            for(unsigned int i = 0; i < meshlet.numVertices; i++)
+            {
+                unsigned int v = meshlet.vertices[i];
+                for(unsigned int j = adjacencyOffsets[v]; j < adjacencyOffsets[v + 1]; j++)
+                {
+                    unsigned int t = adjacency[j];
+                    if(emitted[t])
+                        continue;
+
+                    unsigned int extra = 0;
+                    for(int k = 0; k < 3; k++)
+                        extra += vertexMeshlet[indices[t * 3 + k]] != meshletId;
+                    if(meshlet.numVertices + extra > MaxMeshletVertices)
+                        continue;
+
+                    const float* n = faceNormals + (size_t)t * 3;
+                    float score = (float)extra + 0.5f * (1.0f - (axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2]));
+                    if(score < bestScore)
+                    {
+                        bestScore = score;
+                        best = t;
+                    }
+                }
+            }
+
+            // Nothing adjacent fits, start a new cluster
+            if(best == ~0u)
+            {
+                finishMeshlet();
+                continue;
+            }
+        }
+        else
+        {
+            // New clusters start from the first triangle not yet emitted
+            while(emitted[seed])
+                seed++;
+            best = (unsigned int)seed;
+        }
+
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[(size_t)best * 3 + k];
+            if(vertexMeshlet[v] != meshletId)
+            {
+                vertexMeshlet[v] = meshletId;
+                meshlet.vertices[meshlet.numVertices++] = v;
+            }
+        }
+
+        const float* n = faceNormals + (size_t)best * 3;
+        meshlet.normalSum[0] += n[0];
+        meshlet.normalSum[1] += n[1];
+        meshlet.normalSum[2] += n[2];
+        meshlet.numTriangles++;
+        emitted[best] = 1;
+        order[numWritten++] = best;
+
+        if(meshlet.numTriangles == MaxMeshletTriangles)
+            finishMeshlet();
+    }
+    if(meshlet.numTriangles > 0)
+        finishMeshlet();
+
+    // Rewrite the indices in cluster order
+    unsigned int* reordered = ArenaPushArray<unsigned int>(scratch, numTriangles * 3);
+    for(size_t t = 0; t < numTriangles; t++)
+        memcpy(reordered + t * 3, indices + (size_t)order[t] * 3, 3 * sizeof(unsigned int));
+    memcpy(indices, reordered, numTriangles * 3 * sizeof(unsigned int));
+
+    ArenaPopToMarker(scratch, marker);
+}
+
+// Object space frustum planes and camera position
+struct CullingInput
+{
+    float planeX[6], planeY[6], planeZ[6], planeW[6];
+    float cameraX, cameraY, cameraZ;
+};
+
+template<typename Ops>
+static void CullKernel(const MeshClusters& clusters, const CullingInput& input, size_t i, unsigned char* visible)
+{
+    typedef typename Ops::V V;
+    V cx = Ops::Load(&clusters.centerX[i]);
+    V cy = Ops::Load(&clusters.centerY[i]);
+    V cz = Ops::Load(&clusters.centerZ[i]);
+    V radius = Ops::Load(&clusters.radius[i]);
+    V negativeRadius = Ops::Sub(Ops::Set(0.0f), radius);
+
+    // Outside of any frustum plane
+    V culled = Ops::Set(0.0f);
+    for(int p = 0; p < 6; p++)
+    {
+        V distance = Ops::Add(Ops::Add(Ops::Mul(cx, Ops::Set(input.planeX[p])), Ops::Mul(cy, Ops::Set(input.planeY[p]))),
+                              Ops::Add(Ops::Mul(cz, Ops::Set(input.planeZ[p])), Ops::Set(input.planeW[p])));
+        culled = Ops::Or(culled, Ops::Greater(negativeRadius, distance));
+    }
+
+    // Every triangle facing away from the camera
+    V dx = Ops::Sub(cx, Ops::Set(input.cameraX));
+    V dy = Ops::Sub(cy, Ops::Set(input.cameraY));
+    V dz = Ops::Sub(cz, Ops::Set(input.cameraZ));
+    V along = Ops::Add(Ops::Add(Ops::Mul(dx, Ops::Load(&clusters.axisX[i])), Ops::Mul(dy, Ops::Load(&clusters.axisY[i]))),
+                       Ops::Mul(dz, Ops::Load(&clusters.axisZ[i])));
+    V distance = Ops::Sqrt(Ops::Add(Ops::Add(Ops::Mul(dx, dx), Ops::Mul(dy, dy)), Ops::Mul(dz, dz)));
+    V limit = Ops::Add(Ops::Mul(Ops::Load(&clusters.cutoff[i]), distance), radius);
+    culled = Ops::Or(culled, Ops::Greater(along, limit));
+
+    int mask = Ops::MoveMask(culled);
+    for(int k = 0; k < Ops::Width; k++)
+        visible[i + k] = !((mask >> k) & 1);
+}
+
+void DrawMeshClusters(Mesh& mesh, const glm::mat4& modelViewProjection, const glm::vec3& cameraPosition, ClusterCullingStats& stats)
+{
+    const MeshClusters& clusters = mesh.clusters;
+    size_t count = clusters.meshlets.size();
+
+    // Frustum planes are sums and differences of the clip matrix's rows (Gribb & Hartmann).
+    // Taken from the model-view-projection matrix they come out in object space.
+    CullingInput input;
+    const glm::mat4& m = modelViewProjection;
+    for(int axis = 0; axis < 3; axis++)
+    {
+        for(int side = 0; side < 2; side++)
+        {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            int p = axis * 2 + side;
+            float x = m[0][3] + sign * m[0][axis];
+            float y = m[1][3] + sign * m[1][axis];
+            float z = m[2][3] + sign * m[2][axis];
+            float w = m[3][3] + sign * m[3][axis];
+            float length = sqrtf(x * x + y * y + z * z);
+            float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+            input.planeX[p] = x * inverse;
+            input.planeY[p] = y * inverse;
+            input.planeZ[p] = z * inverse;
+            input.planeW[p] = w * inverse;
+        }
+    }
+    input.cameraX = cameraPosition.x;
+    input.cameraY = cameraPosition.y;
+    input.cameraZ = cameraPosition.z;
+
+    // Scratch arrays are reused across frames
+    static std::vector<unsigned char> visible;
+    static std::vector<GLsizei> counts;
+    static std::vector<const void*> offsets;
+    visible.resize(count);
+
+    ParallelFor(count, 8192, [&](size_t begin, size_t end)
+    {
+        size_t i = begin;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+        for(; i + WideOps::Width <= end; i += WideOps::Width)
+            CullKernel<WideOps>(clusters, input, i, visible.data());
+#endif
+        for(; i < end; i++)
+            CullKernel<ScalarOps>(clusters, input, i, visible.data());
+    }, "Cluster culling");
+
+    // Survivors next to each other in the index buffer are merged into one draw
+    size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    counts.clear();
+    offsets.clear();
+    unsigned int rangeEnd = ~0u;
+    for(size_t i = 0; i < count; i++)
+    {
+        if(!visible[i])
+            continue;
+
+        const Meshlet& meshlet = clusters.meshlets[i];
+        if(!counts.empty() && rangeEnd == meshlet.firstIndex)
+            counts.back() += (GLsizei)meshlet.numIndices;
+        else
+        {
+            counts.push_back((GLsizei)meshlet.numIndices);
+            offsets.push_back((const void*)(meshlet.firstIndex * indexSize));
+        }
+        rangeEnd = meshlet.firstIndex + meshlet.numIndices;
+
+        stats.visibleClusters++;
+        stats.visibleTriangles += meshlet.numIndices / 3;
+    }
+    stats.totalClusters += count;
+    stats.totalTriangles += mesh.numIndices / 3;
+
+    if(counts.empty())
+        return;
+
+    BindMesh(mesh);
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), mesh.indexType, offsets.data(), (GLsizei)counts.size());
+}
+
+size_t GetMeshClustersMemory(const MeshClusters& clusters)
+{
+    return clusters.meshlets.size() * sizeof(Meshlet) + clusters.centerX.size() * 8 * sizeof(float);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <vector>
+
+struct Arena;
+struct Mesh;
+
+// Cluster sizes suited to both vertex reuse and culling granularity
+const unsigned int MaxMeshletVertices = 64;
+const unsigned int MaxMeshletTriangles = 124;
+
+// A cluster's triangles, contiguous in the mesh's index buffer
+struct Meshlet
+{
+    unsigned int firstIndex;
+    unsigned int numIndices;
+};
+
+struct MeshClusters
+{
+    std::vector<Meshlet> meshlets;
+
+    // Bounding spheres and normal cones as a structure of arrays for the culling kernel.
+    // A cluster faces away from the camera if dot(center - camera, axis) > cutoff * |center - camera| + radius.
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<float> axisX, axisY, axisZ, cutoff;
+};
+
+struct ClusterCullingStats
+{
+    size_t totalClusters, visibleClusters;
+    size_t totalTriangles, visibleTriangles;
+};
+
+// Partitions indexed triangles into clusters, reordering the indices in place so that each
+// cluster's triangles are contiguous. Clusters are appended with their first index offset by indexBase.
+void BuildMeshlets(const float* px, const float* py, const float* pz, size_t numVertices,
+                   unsigned int* indices, size_t numIndices, unsigned int indexBase, MeshClusters& result, Arena& scratch);
+
+// Culls the mesh's clusters against the view frustum and their normal cones, then draws the
+// survivors. The camera position is in the mesh's object space.
+void DrawMeshClusters(Mesh& mesh, const glm::mat4& modelViewProjection, const glm::vec3& cameraPosition, ClusterCullingStats& stats);
+
+size_t GetMeshClustersMemory(const MeshClusters& clusters);
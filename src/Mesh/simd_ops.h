@@ -0,0 +1,123 @@
+#pragma once
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+/*  Kernels are written once against these small wrappers and instantiated
+    for the widest instruction set available, with the scalar version
+    handling the leftover elements.
+*/
+struct ScalarOps
+{
+    typedef float V;
+    static const int Width = 1;
+
+    static V Set(float x) { return x; }
+    static V Gather(const float* base, const unsigned int* idx) { return base[idx[0]]; }
+    static V Load(const float* p) { return *p; }
+    static void Store(float* p, V x) { *p = x; }
+    static V Add(V a, V b) { return a + b; }
+    static V Sub(V a, V b) { return a - b; }
+    static V Mul(V a, V b) { return a * b; }
+    static V Div(V a, V b) { return a / b; }
+    static V Sqrt(V a) { return sqrtf(a); }
+    static V Min(V a, V b) { return a < b ? a : b; }
+    static V Max(V a, V b) { return a > b ? a : b; }
+    static V Abs(V a) { return fabsf(a); }
+    static V Greater(V a, V b) { return a > b ? 1.0f : 0.0f; }
+    static V Select(V mask, V a, V b) { return mask != 0.0f ? a : b; }
+    static V Or(V a, V b) { return (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; }
+    static int MoveMask(V mask) { return mask != 0.0f ? 1 : 0; }
+};
+
+#ifdef SIMD_SSE2
+struct SSEOps
+{
+    typedef __m128 V;
+    static const int Width = 4;
+
+    static V Set(float x) { return _mm_set1_ps(x); }
+    static V Gather(const float* base, const unsigned int* idx) { return _mm_set_ps(base[idx[3]], base[idx[2]], base[idx[1]], base[idx[0]]); }
+    static V Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, V x) { _mm_storeu_ps(p, x); }
+    static V Add(V a, V b) { return _mm_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+    static V Min(V a, V b) { return _mm_min_ps(a, b); }
+    static V Max(V a, V b) { return _mm_max_ps(a, b); }
+    static V Abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static V Greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+    static V Select(V mask, V a, V b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static V Or(V a, V b) { return _mm_or_ps(a, b); }
+    static int MoveMask(V mask) { return _mm_movemask_ps(mask); }
+};
+typedef SSEOps WideOps;
+#endif
+
+#ifdef SIMD_AVX2
+struct AVXOps
+{
+    typedef __m256 V;
+    static const int Width = 8;
+
+    static V Set(float x) { return _mm256_set1_ps(x); }
+    static V Gather(const float* base, const unsigned int* idx) { return _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i*)idx), 4); }
+    static V Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, V x) { _mm256_storeu_ps(p, x); }
+    static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+    static V Abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static V Greater(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static V Select(V mask, V a, V b) { return _mm256_blendv_ps(b, a, mask); }
+    static V Or(V a, V b) { return _mm256_or_ps(a, b); }
+    static int MoveMask(V mask) { return _mm256_movemask_ps(mask); }
+};
+typedef AVXOps WideOps;
+#endif
+
+template<typename Ops>
+struct Vec3
+{
+    typename Ops::V x, y, z;
+};
+
+template<typename Ops>
+inline typename Ops::V Dot(const Vec3<Ops>& a, const Vec3<Ops>& b)
+{
+    return Ops::Add(Ops::Add(Ops::Mul(a.x, b.x), Ops::Mul(a.y, b.y)), Ops::Mul(a.z, b.z));
+}
+
+template<typename Ops>
+inline Vec3<Ops> Scale(const Vec3<Ops>& a, typename Ops::V s)
+{
+    return { Ops::Mul(a.x, s), Ops::Mul(a.y, s), Ops::Mul(a.z, s) };
+}
+
+template<typename Ops>
+inline Vec3<Ops> Subtract(const Vec3<Ops>& a, const Vec3<Ops>& b)
+{
+    return { Ops::Sub(a.x, b.x), Ops::Sub(a.y, b.y), Ops::Sub(a.z, b.z) };
+}
+
+// Normalizes a, leaving vectors that are too short to normalize as zero
+template<typename Ops>
+inline Vec3<Ops> SafeNormalize(const Vec3<Ops>& a)
+{
+    typename Ops::V lengthSq = Dot(a, a);
+    typename Ops::V valid = Ops::Greater(lengthSq, Ops::Set(1e-20f));
+    typename Ops::V inverse = Ops::Select(valid, Ops::Div(Ops::Set(1.0f), Ops::Sqrt(Ops::Max(lengthSq, Ops::Set(1e-20f)))), Ops::Set(0.0f));
+    return Scale(a, inverse);
+}
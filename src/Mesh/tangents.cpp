@@ -0,0 +1,201 @@
+#include "tangents.h"
+#include "../Memory/arena.h"
+#include "../Threading/parallel_for.h"
+#include "simd_ops.h"
+#include <cmath>
+
+// Per corner results, weighted tangent in xyz and the triangle's orientation
+struct CornerData
+{
+    float* tx;
+    float* ty;
+    float* tz;
+    float* sign;
+};
+
+// acos approximation (Abramowitz & Stegun 4.4.45), max error around 7e-5 radians
+template<typename Ops>
+static typename Ops::V Acos(typename Ops::V x)
+{
+    x = Ops::Min(Ops::Max(x, Ops::Set(-1.0f)), Ops::Set(1.0f));
+    typename Ops::V a = Ops::Abs(x);
+    typename Ops::V poly = Ops::Add(Ops::Mul(Ops::Add(Ops::Mul(Ops::Add(Ops::Mul(Ops::Set(-0.0187293f), a), Ops::Set(0.0742610f)), a), Ops::Set(-0.2121144f)), a), Ops::Set(1.5707288f));
+    typename Ops::V result = Ops::Mul(Ops::Sqrt(Ops::Sub(Ops::Set(1.0f), a)), poly);
+    return Ops::Select(Ops::Greater(Ops::Set(0.0f), x), Ops::Sub(Ops::Set(3.14159265f), result), result);
+}
+
+template<typename Ops>
+static Vec3<Ops> GatherVec3(const float* x, const float* y, const float* z, const unsigned int* idx)
+{
+    return { Ops::Gather(x, idx), Ops::Gather(y, idx), Ops::Gather(z, idx) };
+}
+
+// Processes Ops::Width triangles starting at triangle t
+template<typename Ops>
+static void TriangleKernel(const TangentInput& in, const CornerData& out, size_t t)
+{
+    typedef typename Ops::V V;
+
+    // Corner indices of the triangles, transposed so each corner's indices are contiguous
+    unsigned int idx[3][Ops::Width];
+    for(int lane = 0; lane < Ops::Width; lane++)
+        for(int k = 0; k < 3; k++)
+            idx[k][lane] = in.indices[(t + lane) * 3 + k];
+
+    Vec3<Ops> p[3], n[3];
+    V u[3], v[3];
+    for(int k = 0; k < 3; k++)
+    {
+        p[k] = GatherVec3<Ops>(in.px, in.py, in.pz, idx[k]);
+        n[k] = SafeNormalize(GatherVec3<Ops>(in.nx, in.ny, in.nz, idx[k]));
+        u[k] = Ops::Gather(in.u, idx[k]);
+        v[k] = Ops::Gather(in.v, idx[k]);
+    }
+
+    Vec3<Ops> d1 = Subtract(p[1], p[0]);
+    Vec3<Ops> d2 = Subtract(p[2], p[0]);
+    V t21x = Ops::Sub(u[1], u[0]), t21y = Ops::Sub(v[1], v[0]);
+    V t31x = Ops::Sub(u[2], u[0]), t31y = Ops::Sub(v[2], v[0]);
+
+    // Signed UV area decides the orientation, the face tangent is the
+    // direction of increasing u flipped to match it
+    V area = Ops::Sub(Ops::Mul(t21x, t31y), Ops::Mul(t21y, t31x));
+    V preserving = Ops::Greater(area, Ops::Set(0.0f));
+    V sign = Ops::Select(preserving, Ops::Set(1.0f), Ops::Set(-1.0f));
+    V degenerate = Ops::Greater(Ops::Set(1e-20f), Ops::Abs(area));
+
+    Vec3<Ops> faceTangent = SafeNormalize(Subtract(Scale(d1, t31y), Scale(d2, t21y)));
+    faceTangent = Scale(faceTangent, Ops::Select(degenerate, Ops::Set(0.0f), sign));
+
+    for(int k = 0; k < 3; k++)
+    {
+        // Project onto the corner's normal plane
+        Vec3<Ops> tangent = SafeNormalize(Subtract(faceTangent, Scale(n[k], Dot(n[k], faceTangent))));
+
+        // Angle between the two edges leaving this corner, also within the normal plane
+        Vec3<Ops> e1 = Subtract(p[(k + 1) % 3], p[k]);
+        Vec3<Ops> e2 = Subtract(p[(k + 2) % 3], p[k]);
+        e1 = SafeNormalize(Subtract(e1, Scale(n[k], Dot(n[k], e1))));
+        e2 = SafeNormalize(Subtract(e2, Scale(n[k], Dot(n[k], e2))));
+        V angle = Acos<Ops>(Dot(e1, e2));
+
+        // Lanes are consecutive triangles, so corner k of each lands at a stride of 3
+        float tx[Ops::Width], ty[Ops::Width], tz[Ops::Width];
+        Ops::Store(tx, Ops::Mul(tangent.x, angle));
+        Ops::Store(ty, Ops::Mul(tangent.y, angle));
+        Ops::Store(tz, Ops::Mul(tangent.z, angle));
+        for(int lane = 0; lane < Ops::Width; lane++)
+        {
+            size_t corner = (t + lane) * 3 + k;
+            out.tx[corner] = tx[lane];
+            out.ty[corner] = ty[lane];
+            out.tz[corner] = tz[lane];
+        }
+    }
+
+    float signs[Ops::Width];
+    Ops::Store(signs, sign);
+    for(int lane = 0; lane < Ops::Width; lane++)
+        out.sign[t + lane] = signs[lane];
+}
+
+void GenerateTangents(const TangentInput& input, float* tangents, Arena& scratch)
+{
+    ArenaMarker marker = ArenaGetMarker(scratch);
+    size_t numCorners = input.numTriangles * 3;
+
+    CornerData corners;
+    corners.tx = ArenaPushArray<float>(scratch, numCorners);
+    corners.ty = ArenaPushArray<float>(scratch, numCorners);
+    corners.tz = ArenaPushArray<float>(scratch, numCorners);
+    corners.sign = ArenaPushArray<float>(scratch, input.numTriangles);
+
+    // Weighted corner tangents, independent per triangle
+    ParallelFor(input.numTriangles, 8192, [&](size_t begin, size_t end)
+    {
+        size_t t = begin;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+        for(; t + WideOps::Width <= end; t += WideOps::Width)
+            TriangleKernel<WideOps>(input, corners, t);
+#endif
+        for(; t < end; t++)
+            TriangleKernel<ScalarOps>(input, corners, t);
+    }, "Corner tangents");
+
+    // Vertex to corner adjacency, so the accumulation can run per vertex without atomics
+    unsigned int* cornerStart = ArenaPushArray<unsigned int>(scratch, input.numVertices + 1);
+    unsigned int* vertexCorners = ArenaPushArray<unsigned int>(scratch, numCorners);
+    for(size_t i = 0; i <= input.numVertices; i++)
+        cornerStart[i] = 0;
+    for(size_t c = 0; c < numCorners; c++)
+        cornerStart[input.indices[c] + 1]++;
+    for(size_t i = 0; i < input.numVertices; i++)
+        cornerStart[i + 1] += cornerStart[i];
+
+    unsigned int* fill = ArenaPushArray<unsigned int>(scratch, input.numVertices);
+    for(size_t i = 0; i < input.numVertices; i++)
+        fill[i] = cornerStart[i];
+    for(size_t c = 0; c < numCorners; c++)
+        vertexCorners[fill[input.indices[c]]++] = (unsigned int)c;
+
+    ParallelFor(input.numVertices, 8192, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            // Orientation preserving and mirrored triangles are summed separately,
+            // the vertex takes the side with more weight
+            float sum[2][3] = {};
+            float weight[2] = {};
+            for(unsigned int j = cornerStart[i]; j < cornerStart[i + 1]; j++)
+            {
+                unsigned int c = vertexCorners[j];
+                int side = corners.sign[c / 3] > 0.0f ? 0 : 1;
+                sum[side][0] += corners.tx[c];
+                sum[side][1] += corners.ty[c];
+                sum[side][2] += corners.tz[c];
+                weight[side] += sqrtf(corners.tx[c] * corners.tx[c] + corners.ty[c] * corners.ty[c] + corners.tz[c] * corners.tz[c]);
+            }
+            int side = weight[0] >= weight[1] ? 0 : 1;
+
+            float n[3] = { input.nx[i], input.ny[i], input.nz[i] };
+            float nLength = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if(nLength > 0.0f)
+            {
+                n[0] /= nLength;
+                n[1] /= nLength;
+                n[2] /= nLength;
+            }
+
+            // Orthogonalize the average against the normal
+            float* t = sum[side];
+            float d = t[0] * n[0] + t[1] * n[1] + t[2] * n[2];
+            t[0] -= d * n[0];
+            t[1] -= d * n[1];
+            t[2] -= d * n[2];
+
+            float length = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+            if(length < 1e-10f)
+            {
+                // No usable UVs around this vertex, pick any direction perpendicular to the normal
+                float axis[3] = { 1.0f, 0.0f, 0.0f };
+                if(fabsf(n[0]) > 0.9f)
+                {
+                    axis[0] = 0.0f;
+                    axis[1] = 1.0f;
+                }
+                t[0] = axis[1] * n[2] - axis[2] * n[1];
+                t[1] = axis[2] * n[0] - axis[0] * n[2];
+                t[2] = axis[0] * n[1] - axis[1] * n[0];
+                length = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+            }
+
+            float* out = tangents + i * 4;
+            out[0] = t[0] / length;
+            out[1] = t[1] / length;
+            out[2] = t[2] / length;
+            out[3] = side == 0 ? 1.0f : -1.0f;
+        }
+    }, "Vertex tangents");
+
+    ArenaPopToMarker(scratch, marker);
+}
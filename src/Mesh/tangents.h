@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+struct Arena;
+
+// Structure of arrays view of an indexed triangle mesh
+struct TangentInput
+{
+    const float* px;
+    const float* py;
+    const float* pz;
+    const float* u;
+    const float* v;
+    const float* nx;
+    const float* ny;
+    const float* nz;
+    const unsigned int* indices;
+
+    size_t numVertices;
+    size_t numTriangles;
+};
+
+// MikkTSpace style tangent generation. Face tangents are projected onto each
+// corner's normal plane, weighted by the corner angle and averaged per vertex.
+// Writes 4 floats per vertex: the tangent and the bitangent sign in w, so
+// that bitangent = cross(normal, tangent.xyz) * tangent.w.
+void GenerateTangents(const TangentInput& input, float* tangents, Arena& scratch);
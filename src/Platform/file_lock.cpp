@@ -0,0 +1,71 @@
+#include "file_lock.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+bool AcquireFileLock(const char* path, bool exclusive, FileLock& result)
+{
+    result = { -1 };
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        printf("Failed to open lock file at path: %s\n", path);
+        return false;
+    }
+
+    OVERLAPPED overlapped = {};
+    if(!LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped))
+    {
+        printf("Failed to lock file at path: %s\n", path);
+        CloseHandle(file);
+        return false;
+    }
+    result.file = (intptr_t)file;
+#else
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if(fd < 0)
+    {
+        printf("Failed to open lock file at path: %s\n", path);
+        return false;
+    }
+
+    // flock locks belong to the open file, so threads of one process exclude each other too
+    if(flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0)
+    {
+        printf("Failed to lock file at path: %s\n", path);
+        close(fd);
+        return false;
+    }
+    result.file = fd;
+#endif
+
+    return true;
+}
+
+void ReleaseFileLock(FileLock& lock)
+{
+    if(lock.file == -1)
+        return;
+
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    UnlockFileEx((HANDLE)lock.file, 0, MAXDWORD, MAXDWORD, &overlapped);
+    CloseHandle((HANDLE)lock.file);
+#else
+    flock((int)lock.file, LOCK_UN);
+    close((int)lock.file);
+#endif
+
+    lock = { -1 };
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+// Advisory lock on a file, respected by every process locking the same path.
+// Readers share the lock, a writer holds it exclusively.
+struct FileLock
+{
+    // A file descriptor on POSIX and a file handle on Windows
+    intptr_t file;
+};
+
+// Blocks until the lock is held, creating the file if needed
+bool AcquireFileLock(const char* path, bool exclusive, FileLock& result);
+void ReleaseFileLock(FileLock& lock);
@@ -0,0 +1,98 @@
+#include "file_mapping.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MapFile(const char* path, MappedFile& result)
+{
+    result = { nullptr, 0, -1, -1 };
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        printf("Failed to open file for mapping at path: %s\n", path);
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    result.file = (intptr_t)file;
+    result.size = (size_t)size.QuadPart;
+
+    // Empty files can't be mapped, but are valid
+    if(result.size == 0)
+        return true;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(data == nullptr)
+    {
+        printf("Failed to map file at path: %s\n", path);
+        if(mapping != nullptr)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        result.file = -1;
+        return false;
+    }
+
+    result.mapping = (intptr_t)mapping;
+    result.data = (const unsigned char*)data;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        printf("Failed to open file for mapping at path: %s\n", path);
+        return false;
+    }
+
+    struct stat info;
+    fstat(fd, &info);
+    result.file = fd;
+    result.size = (size_t)info.st_size;
+
+    if(result.size == 0)
+        return true;
+
+    void* data = mmap(nullptr, result.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        printf("Failed to map file at path: %s\n", path);
+        close(fd);
+        result.file = -1;
+        return false;
+    }
+
+    result.data = (const unsigned char*)data;
+#endif
+
+    return true;
+}
+
+void UnmapFile(MappedFile& file)
+{
+#ifdef _WIN32
+    if(file.data != nullptr)
+        UnmapViewOfFile(file.data);
+    if(file.mapping != -1)
+        CloseHandle((HANDLE)file.mapping);
+    if(file.file != -1)
+        CloseHandle((HANDLE)file.file);
+#else
+    if(file.data != nullptr)
+        munmap((void*)file.data, file.size);
+    if(file.file != -1)
+        close((int)file.file);
+#endif
+
+    file = { nullptr, 0, -1, -1 };
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file
+struct MappedFile
+{
+    const unsigned char* data;
+    size_t size;
+
+    // Platform handles, a file descriptor on POSIX and file/mapping handles on Windows
+    intptr_t file;
+    intptr_t mapping;
+};
+
+bool MapFile(const char* path, MappedFile& result);
+void UnmapFile(MappedFile& file);
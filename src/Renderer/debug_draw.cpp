@@ -0,0 +1,112 @@
+#include "debug_draw.h"
+#include "../AssetManagement/shader.h"
+#include "gl_state.h"
+#include <glad/glad.h>
+
+void ClearDebugDraw(DebugDrawList& list)
+{
+    list.triangles.clear();
+    list.lines.clear();
+}
+
+void AddDebugLine(DebugDrawList& list, const glm::vec3& from, const glm::vec3& to, const glm::vec3& color)
+{
+    list.lines.push_back({ from, color });
+    list.lines.push_back({ to, color });
+}
+
+void AddDebugBox(DebugDrawList& list, const glm::vec3& center, const glm::vec3& halfSize, const glm::vec3& color)
+{
+    // Corner i has x, y and z on the positive side for bits 0, 1 and 2.
+    // Faces wind counter clockwise seen from outside, so culling still applies.
+    const int faces[6][4] =
+    {
+        { 1, 3, 7, 5 }, { 0, 4, 6, 2 },
+        { 2, 6, 7, 3 }, { 0, 1, 5, 4 },
+        { 4, 5, 7, 6 }, { 0, 2, 3, 1 },
+    };
+    const int corners[6] = { 0, 1, 2, 2, 3, 0 };
+
+    for(auto& face : faces)
+    {
+        for(int corner : corners)
+        {
+            int i = face[corner];
+            glm::vec3 side((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+            list.triangles.push_back({ center + side * halfSize, color });
+        }
+    }
+}
+
+void AddDebugAxes(DebugDrawList& list, const glm::mat4& transform)
+{
+    glm::vec3 origin(transform[3]);
+    for(int axis = 0; axis < 3; axis++)
+    {
+        glm::vec3 color(0.0f);
+        color[axis] = 1.0f;
+        AddDebugLine(list, origin, origin + glm::vec3(transform[axis]), color);
+    }
+}
+
+DebugDrawBuffer CreateDebugDrawBuffer()
+{
+    DebugDrawBuffer result = {};
+
+    glGenVertexArrays(1, &result.VAO);
+    BindVertexArray(result.VAO);
+
+    glGenBuffers(1, &result.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, result.VBO);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)sizeof(glm::vec3));
+
+    return result;
+}
+
+void DeleteDebugDrawBuffer(DebugDrawBuffer& buffer)
+{
+    DeleteVertexArray(buffer.VAO);
+    glDeleteBuffers(1, &buffer.VBO);
+    buffer = {};
+}
+
+void DrawDebugList(DebugDrawBuffer& buffer, const DebugDrawList& list, Shader& shader, const glm::mat4& viewProjection)
+{
+    size_t numTriangleVertices = list.triangles.size();
+    size_t numLineVertices = list.lines.size();
+    if(numTriangleVertices + numLineVertices == 0)
+        return;
+
+    BindVertexArray(buffer.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.VBO);
+
+    // Orphaning the old storage each frame lets the driver hand out fresh memory
+    // instead of waiting on the draws still reading last frame's vertices
+    size_t size = (numTriangleVertices + numLineVertices) * sizeof(DebugVertex);
+    if(size > buffer.capacity)
+        buffer.capacity = size * 2;
+    glBufferData(GL_ARRAY_BUFFER, buffer.capacity, nullptr, GL_STREAM_DRAW);
+    if(numTriangleVertices > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, numTriangleVertices * sizeof(DebugVertex), list.triangles.data());
+    if(numLineVertices > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, numTriangleVertices * sizeof(DebugVertex), numLineVertices * sizeof(DebugVertex), list.lines.data());
+
+    glm::mat4 MVP = viewProjection;
+    UseShader(shader);
+    UniformMat4(shader, "MVP", MVP);
+
+    if(numTriangleVertices > 0)
+        glDrawArrays(GL_TRIANGLES, 0, (int)numTriangleVertices);
+
+    if(numLineVertices > 0)
+    {
+        SetCapability(GL_DEPTH_TEST, false);
+        glDrawArrays(GL_LINES, (int)numTriangleVertices, (int)numLineVertices);
+        SetCapability(GL_DEPTH_TEST, true);
+    }
+}
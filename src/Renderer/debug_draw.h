@@ -0,0 +1,41 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+struct Shader;
+
+struct DebugVertex
+{
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+// Helper geometry collected on the CPU each frame and drawn in one go.
+// Triangles are depth tested against the scene, lines are drawn on top.
+struct DebugDrawList
+{
+    std::vector<DebugVertex> triangles;
+    std::vector<DebugVertex> lines;
+};
+
+void ClearDebugDraw(DebugDrawList& list);
+void AddDebugLine(DebugDrawList& list, const glm::vec3& from, const glm::vec3& to, const glm::vec3& color);
+void AddDebugBox(DebugDrawList& list, const glm::vec3& center, const glm::vec3& halfSize, const glm::vec3& color);
+
+// Lines along the transform's x, y and z axes in red, green and blue
+void AddDebugAxes(DebugDrawList& list, const glm::mat4& transform);
+
+// One dynamic vertex buffer shared by every debug primitive, owned by the drawing context
+struct DebugDrawBuffer
+{
+    unsigned int VAO;
+    unsigned int VBO;
+    size_t capacity;
+};
+
+DebugDrawBuffer CreateDebugDrawBuffer();
+void DeleteDebugDrawBuffer(DebugDrawBuffer& buffer);
+
+// Streams the list into the buffer and draws it with the debug shader, at most one draw per primitive type
+void DrawDebugList(DebugDrawBuffer& buffer, const DebugDrawList& list, Shader& shader, const glm::mat4& viewProjection);
@@ -0,0 +1,166 @@
+#include "gl_state.h"
+#include <glad/glad.h>
+
+static const unsigned int Unknown = ~0u;
+static const int NumTextureUnits = 16;
+static const int NumTextureTargets = 3;
+static const int NumCapabilities = 4;
+
+static const GLenum TextureTargets[NumTextureTargets] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER };
+static const GLenum Capabilities[NumCapabilities] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST };
+
+struct GLStateCache
+{
+    unsigned int program = Unknown;
+    unsigned int vertexArray = Unknown;
+    unsigned int activeUnit = Unknown;
+    unsigned int textures[NumTextureUnits][NumTextureTargets];
+
+    // 0 or 1 once known
+    int capabilities[NumCapabilities];
+
+    GLStateStats stats = {};
+
+    GLStateCache()
+    {
+        ResetBindings();
+    }
+
+    void ResetBindings()
+    {
+        program = vertexArray = activeUnit = Unknown;
+        for(auto& unit : textures)
+            for(unsigned int& texture : unit)
+                texture = Unknown;
+        for(int& capability : capabilities)
+            capability = -1;
+    }
+};
+
+static thread_local GLStateCache cache;
+
+static int TextureTargetIndex(unsigned int target)
+{
+    for(int i = 0; i < NumTextureTargets; i++)
+    {
+        if(TextureTargets[i] == target)
+            return i;
+    }
+    return -1;
+}
+
+void ResetGLStateCache()
+{
+    cache.ResetBindings();
+}
+
+void UseProgram(unsigned int program)
+{
+    if(cache.program == program)
+    {
+        cache.stats.skipped++;
+        return;
+    }
+    glUseProgram(program);
+    cache.program = program;
+    cache.stats.issued++;
+}
+
+void BindVertexArray(unsigned int vertexArray)
+{
+    if(cache.vertexArray == vertexArray)
+    {
+        cache.stats.skipped++;
+        return;
+    }
+    glBindVertexArray(vertexArray);
+    cache.vertexArray = vertexArray;
+    cache.stats.issued++;
+}
+
+void BindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    // Other targets and units are passed through without caching
+    int targetIndex = TextureTargetIndex(target);
+    unsigned int* binding = unit < (unsigned int)NumTextureUnits && targetIndex >= 0 ? &cache.textures[unit][targetIndex] : nullptr;
+    if(binding != nullptr && *binding == texture)
+    {
+        cache.stats.skipped++;
+        return;
+    }
+
+    if(cache.activeUnit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        cache.activeUnit = unit;
+        cache.stats.issued++;
+    }
+    glBindTexture(target, texture);
+    if(binding != nullptr)
+        *binding = texture;
+    cache.stats.issued++;
+}
+
+void SetCapability(unsigned int capability, bool enabled)
+{
+    int* state = nullptr;
+    for(int i = 0; i < NumCapabilities; i++)
+    {
+        if(Capabilities[i] == capability)
+            state = &cache.capabilities[i];
+    }
+    if(state != nullptr && *state == (int)enabled)
+    {
+        cache.stats.skipped++;
+        return;
+    }
+
+    if(enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    if(state != nullptr)
+        *state = (int)enabled;
+    cache.stats.issued++;
+}
+
+void DeleteVertexArray(unsigned int vertexArray)
+{
+    glDeleteVertexArrays(1, &vertexArray);
+    if(cache.vertexArray == vertexArray)
+        cache.vertexArray = 0;
+}
+
+static void ForgetTexture(unsigned int name, unsigned int binding)
+{
+    for(auto& unit : cache.textures)
+    {
+        for(unsigned int& texture : unit)
+        {
+            if(texture == name)
+                texture = binding;
+        }
+    }
+}
+
+void DeleteTextures(int count, const unsigned int* textures)
+{
+    glDeleteTextures(count, textures);
+    for(int i = 0; i < count; i++)
+        ForgetTexture(textures[i], 0);
+}
+
+unsigned int GenTexture()
+{
+    unsigned int result;
+    glGenTextures(1, &result);
+    ForgetTexture(result, Unknown);
+    return result;
+}
+
+GLStateStats TakeGLStateStats()
+{
+    GLStateStats result = cache.stats;
+    cache.stats = {};
+    return result;
+}
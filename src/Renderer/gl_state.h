@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+
+// Binding state of the GL context current on the calling thread, so binds that wouldn't
+// change anything are skipped. Every bind and toggle of the cached state has to go
+// through here, or the cache goes stale. The cache is per thread, as each context is
+// current on one thread at a time, and starts out unknown so the first calls always go
+// through. Call ResetGLStateCache when a context moves to the calling thread.
+void ResetGLStateCache();
+
+void UseProgram(unsigned int program);
+void BindVertexArray(unsigned int vertexArray);
+
+// Makes unit active only if the binding has to change. Targets are GL_TEXTURE_2D,
+// GL_TEXTURE_CUBE_MAP and GL_TEXTURE_BUFFER on units 0 to 15.
+void BindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+
+// GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND or GL_SCISSOR_TEST
+void SetCapability(unsigned int capability, bool enabled);
+
+// Deleting a bound object unbinds it, and its name may come back for a new object
+void DeleteVertexArray(unsigned int vertexArray);
+void DeleteTextures(int count, const unsigned int* textures);
+
+// Textures are shared between contexts, so a name deleted on another one can come back
+// while this context still has the old texture bound under it. New names are forgotten.
+unsigned int GenTexture();
+
+// State calls made and skipped on the calling thread since the last take
+struct GLStateStats
+{
+    size_t issued;
+    size_t skipped;
+};
+
+GLStateStats TakeGLStateStats();
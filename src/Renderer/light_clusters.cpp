@@ -0,0 +1,219 @@
+#include "light_clusters.h"
+#include "../AssetManagement/shader.h"
+#include "../Threading/parallel_for.h"
+#include "gl_state.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const int TilesPerSlice = ClusterCountX * ClusterCountY;
+
+// Slices get exponentially deeper, so clusters keep a similar shape from near to far
+static float SliceDepth(const LightClusters& clusters, int slice)
+{
+    return clusters.nearDepth * powf(clusters.farDepth / clusters.nearDepth, (float)slice / ClusterCountZ);
+}
+
+static void BuildClusterBounds(LightClusters& clusters, const glm::mat4& projection)
+{
+    clusters.projection = projection;
+    clusters.nearDepth = projection[3][2] / (projection[2][2] - 1.0f);
+    clusters.farDepth = projection[3][2] / (projection[2][2] + 1.0f);
+    clusters.boundsMin.resize(NumClusters);
+    clusters.boundsMax.resize(NumClusters);
+
+    // A tile's edges in normalized device coordinates scale with depth in view space
+    for(int z = 0; z < ClusterCountZ; z++)
+    {
+        float depths[2] = { SliceDepth(clusters, z), SliceDepth(clusters, z + 1) };
+        for(int y = 0; y < ClusterCountY; y++)
+        {
+            for(int x = 0; x < ClusterCountX; x++)
+            {
+                float ndcX[2] = { -1.0f + 2.0f * x / ClusterCountX, -1.0f + 2.0f * (x + 1) / ClusterCountX };
+                float ndcY[2] = { -1.0f + 2.0f * y / ClusterCountY, -1.0f + 2.0f * (y + 1) / ClusterCountY };
+                glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+                for(float depth : depths)
+                {
+                    for(int i = 0; i < 2; i++)
+                    {
+                        glm::vec3 corner(ndcX[i] * depth / projection[0][0], ndcY[i] * depth / projection[1][1], -depth);
+                        min = glm::min(min, corner);
+                        max = glm::max(max, corner);
+                    }
+                }
+                int cluster = x + ClusterCountX * (y + ClusterCountY * z);
+                clusters.boundsMin[cluster] = min;
+                clusters.boundsMax[cluster] = max;
+            }
+        }
+    }
+}
+
+static bool SphereTouchesBox(const glm::vec4& sphere, const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 center(sphere);
+    glm::vec3 offset = glm::max(min, glm::min(center, max)) - center;
+    return offset.x * offset.x + offset.y * offset.y + offset.z * offset.z <= sphere.w * sphere.w;
+}
+
+void BuildLightClusters(LightClusters& clusters, const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection)
+{
+    size_t numLights = lights.size();
+    clusters.numLights = numLights;
+
+    // Nothing to bin, and BindLightClusters has nothing to upload
+    if(numLights == 0)
+    {
+        clusters.indices.clear();
+        clusters.maxLightsPerCluster = 0;
+        return;
+    }
+
+    if(projection != clusters.projection)
+        BuildClusterBounds(clusters, projection);
+    clusters.lightData.resize(numLights * 8);
+    clusters.viewLights.resize(numLights);
+    for(size_t i = 0; i < numLights; i++)
+    {
+        const PointLight& light = lights[i];
+        float* data = &clusters.lightData[i * 8];
+        data[0] = light.position.x;
+        data[1] = light.position.y;
+        data[2] = light.position.z;
+        data[3] = light.radius;
+        data[4] = light.color.x;
+        data[5] = light.color.y;
+        data[6] = light.color.z;
+        data[7] = 0.0f;
+        clusters.viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(light.position, 1.0f)), light.radius);
+    }
+
+    // Each slice only tests its tiles against the lights overlapping its depth range,
+    // writing offsets relative to its own index list until they're joined below
+    clusters.ranges.resize(NumClusters * 2);
+    clusters.sliceLights.resize(ClusterCountZ);
+    clusters.rowLights.resize(ClusterCountZ);
+    clusters.sliceIndices.resize(ClusterCountZ);
+    ParallelFor(ClusterCountZ, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t z = begin; z < end; z++)
+        {
+            float sliceNear = SliceDepth(clusters, (int)z);
+            float sliceFar = SliceDepth(clusters, (int)z + 1);
+            std::vector<unsigned int>& candidates = clusters.sliceLights[z];
+            candidates.clear();
+            for(size_t i = 0; i < numLights; i++)
+            {
+                float depth = -clusters.viewLights[i].z;
+                float radius = clusters.viewLights[i].w;
+                if(depth + radius >= sliceNear && depth - radius <= sliceFar)
+                    candidates.push_back((unsigned int)i);
+            }
+
+            // Tiles of a row share their y and depth ranges, so a row's bounds
+            // go from its first tile's minimum to its last tile's maximum
+            std::vector<unsigned int>& indices = clusters.sliceIndices[z];
+            std::vector<unsigned int>& rowLights = clusters.rowLights[z];
+            indices.clear();
+            for(int y = 0; y < ClusterCountY; y++)
+            {
+                int rowStart = (int)z * TilesPerSlice + y * ClusterCountX;
+                glm::vec3 rowMin = clusters.boundsMin[rowStart];
+                glm::vec3 rowMax(clusters.boundsMax[rowStart + ClusterCountX - 1].x, clusters.boundsMax[rowStart].y, clusters.boundsMax[rowStart].z);
+                rowLights.clear();
+                for(unsigned int light : candidates)
+                {
+                    if(SphereTouchesBox(clusters.viewLights[light], rowMin, rowMax))
+                        rowLights.push_back(light);
+                }
+
+                for(int cluster = rowStart; cluster < rowStart + ClusterCountX; cluster++)
+                {
+                    size_t first = indices.size();
+                    for(unsigned int light : rowLights)
+                    {
+                        if(SphereTouchesBox(clusters.viewLights[light], clusters.boundsMin[cluster], clusters.boundsMax[cluster]))
+                            indices.push_back(light);
+                    }
+                    clusters.ranges[cluster * 2] = (unsigned int)first;
+                    clusters.ranges[cluster * 2 + 1] = (unsigned int)(indices.size() - first);
+                }
+            }
+        }
+    }, "Light clusters");
+
+    clusters.indices.clear();
+    clusters.maxLightsPerCluster = 0;
+    for(int z = 0; z < ClusterCountZ; z++)
+    {
+        unsigned int offset = (unsigned int)clusters.indices.size();
+        for(int tile = 0; tile < TilesPerSlice; tile++)
+        {
+            int cluster = z * TilesPerSlice + tile;
+            clusters.ranges[cluster * 2] += offset;
+            clusters.maxLightsPerCluster = std::max(clusters.maxLightsPerCluster, (size_t)clusters.ranges[cluster * 2 + 1]);
+        }
+        clusters.indices.insert(clusters.indices.end(), clusters.sliceIndices[z].begin(), clusters.sliceIndices[z].end());
+    }
+}
+
+LightClusterBuffers CreateLightClusterBuffers()
+{
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+    LightClusterBuffers result;
+    glGenBuffers(3, result.buffers);
+    for(int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, result.buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        result.textures[i] = GenTexture();
+        BindTexture(0, GL_TEXTURE_BUFFER, result.textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], result.buffers[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return result;
+}
+
+void DeleteLightClusterBuffers(LightClusterBuffers& buffers)
+{
+    DeleteTextures(3, buffers.textures);
+    glDeleteBuffers(3, buffers.buffers);
+    buffers = {};
+}
+
+void SetLightClusterSamplers(Shader& shader)
+{
+    UniformInt(shader, "clusterLightData", 6);
+    UniformInt(shader, "clusterRanges", 7);
+    UniformInt(shader, "clusterLightIndices", 8);
+    UniformInt(shader, "numClusterLights", 0);
+}
+
+void BindLightClusters(LightClusterBuffers& buffers, const LightClusters& clusters, Shader& shader)
+{
+    SetLightClusterSamplers(shader);
+    if(clusters.numLights == 0)
+        return;
+
+    // Orphaned every frame, the driver hands out fresh storage while the last frame's is read
+    const void* data[3] = { clusters.lightData.data(), clusters.ranges.data(), clusters.indices.data() };
+    const size_t sizes[3] = { clusters.lightData.size() * sizeof(float), clusters.ranges.size() * sizeof(unsigned int),
+                              clusters.indices.size() * sizeof(unsigned int) };
+    for(int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers.buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(sizes[i], (size_t)16), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+        BindTexture(6 + i, GL_TEXTURE_BUFFER, buffers.textures[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Slice index from view depth, log(depth) * scale + bias
+    float depthScale = ClusterCountZ / logf(clusters.farDepth / clusters.nearDepth);
+    UniformInt(shader, "numClusterLights", (int)clusters.numLights);
+    UniformFloat(shader, "clusterDepthScale", depthScale);
+    UniformFloat(shader, "clusterDepthBias", -logf(clusters.nearDepth) * depthScale);
+}
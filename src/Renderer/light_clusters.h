@@ -0,0 +1,69 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <vector>
+
+struct Shader;
+
+struct PointLight
+{
+    glm::vec3 position;
+    // Light falls off to nothing at this distance
+    float radius;
+    glm::vec3 color;
+};
+
+// The view frustum split into screen tiles and exponential depth slices
+static const int ClusterCountX = 16;
+static const int ClusterCountY = 9;
+static const int ClusterCountZ = 24;
+static const int NumClusters = ClusterCountX * ClusterCountY * ClusterCountZ;
+
+// Lights binned into the clusters they reach, built on the CPU every frame. Cluster
+// x + ClusterCountX * (y + ClusterCountY * z) uses indices[offset, offset + count)
+// of its ranges entry, which point into the lights.
+struct LightClusters
+{
+    // Two vec4s per light, world position and radius, then color
+    std::vector<float> lightData;
+    std::vector<unsigned int> ranges;
+    std::vector<unsigned int> indices;
+    size_t numLights = 0;
+    size_t maxLightsPerCluster = 0;
+
+    // Depth range of the slices, taken from the projection
+    float nearDepth = 0.0f;
+    float farDepth = 0.0f;
+
+    // View space cluster bounds, rebuilt when the projection changes
+    glm::mat4 projection = glm::mat4(0.0f);
+    std::vector<glm::vec3> boundsMin;
+    std::vector<glm::vec3> boundsMax;
+
+    // Per slice scratch, the slices are binned in parallel
+    std::vector<std::vector<unsigned int>> sliceLights;
+    std::vector<std::vector<unsigned int>> rowLights;
+    std::vector<std::vector<unsigned int>> sliceIndices;
+    std::vector<glm::vec4> viewLights;
+};
+
+// Bins the lights against the clusters of a symmetric perspective projection, one depth slice per job
+void BuildLightClusters(LightClusters& clusters, const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection);
+
+// Texture buffers the shaders read clusters from, owned by the drawing context
+struct LightClusterBuffers
+{
+    unsigned int buffers[3];
+    unsigned int textures[3];
+};
+
+LightClusterBuffers CreateLightClusterBuffers();
+void DeleteLightClusterBuffers(LightClusterBuffers& buffers);
+
+// Cluster samplers go to units 6 to 8. Shaders with them always need the units set,
+// as samplers of different types can't share a unit, even with no lights to read.
+void SetLightClusterSamplers(Shader& shader);
+
+// Streams the clusters into the buffers and binds them for the shader
+void BindLightClusters(LightClusterBuffers& buffers, const LightClusters& clusters, Shader& shader);
@@ -0,0 +1,278 @@
+#include "render_thread.h"
+#include "gl_state.h"
+#include "../Threading/triple_buffer.h"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/matrix.hpp>
+#include <imgui_impl_opengl3.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Packets are exchanged through the lock free triple buffer, the mutex only
+// guards the command queue and lets either thread sleep until the other catches up
+static struct
+{
+    std::thread thread;
+    GLFWwindow* window = nullptr;
+    RenderResources resources;
+
+    // Vertex arrays aren't shared between contexts, these are made on the render thread
+    unsigned int emptyVertexArray = 0;
+    DebugDrawBuffer debugBuffer = {};
+    LightClusterBuffers lightBuffers = {};
+    ShadowMap shadowMap = {};
+
+    TripleBuffer<RenderPacket> packets;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+    std::vector<std::function<void()>> commands;
+
+    std::mutex statsMutex;
+    ClusterCullingStats stats = {};
+    GLStateStats stateStats = {};
+    std::atomic<unsigned int> shadowMapRenders{ 0 };
+} renderer;
+
+// Wakes the other thread after a lock free state change. Taking the lock first
+// makes sure it either sees the change or is already waiting for the notify.
+static void WakeOtherThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(renderer.mutex);
+    }
+    renderer.wake.notify_all();
+}
+
+static void RenderFrame(RenderPacket& packet)
+{
+    RenderResources& resources = renderer.resources;
+
+    // Reuses last frame's shadow cube unless the light, the scene or the quality changed
+    UpdateShadowMap(renderer.shadowMap, packet.shadowQuality, packet.lightPosition, packet.sceneVersion, packet.draws, resources.shadow);
+    renderer.shadowMapRenders = renderer.shadowMap.renders;
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    const Environment& environment = *packet.environment;
+    Shader& shader = packet.imageBasedLighting ? resources.pbr : resources.lighting;
+    UseShader(shader);
+    UniformMat4(shader, "projection", packet.projection);
+    UniformMat4(shader, "view", packet.view);
+    UniformVec3(shader, "pointLightPos", packet.lightPosition);
+    UniformVec3(shader, "cameraPos", packet.cameraPosition);
+
+    // Units 0 to 2 take the material textures, bound per mesh
+    if(packet.imageBasedLighting)
+    {
+        UniformVec3Array(shader, "irradiance", environment.irradiance, 9);
+        UniformFloat(shader, "prefilteredMaxLod", (float)(environment.specular.levels - 1));
+        UniformInt(shader, "prefilteredMap", 4);
+        UniformInt(shader, "brdfLookup", 5);
+        BindTexture(4, GL_TEXTURE_CUBE_MAP, environment.specular.ID);
+        BindTexture(5, GL_TEXTURE_2D, resources.brdfLookup.ID);
+    }
+
+    // Units 6 to 8 take the clustered lights
+    if(renderer.lightBuffers.buffers[0] == 0)
+        renderer.lightBuffers = CreateLightClusterBuffers();
+    BindLightClusters(renderer.lightBuffers, packet.lights, shader);
+    BindShadowMap(&renderer.shadowMap, shader);
+
+    // Render the models and their children
+    ModelDrawContext context = { packet.projection * packet.view, packet.cameraPosition, packet.cullClusters, {} };
+    for(auto& draw : packet.draws)
+        DrawModel(*draw.model, shader, draw.transform, context);
+    {
+        std::lock_guard<std::mutex> lock(renderer.statsMutex);
+        renderer.stats = context.stats;
+    }
+
+    // The skybox goes after the opaque models, as one triangle over the whole screen. It
+    // sits at the far plane, so only pixels the models left at the cleared depth run it.
+    if(renderer.emptyVertexArray == 0)
+        glGenVertexArrays(1, &renderer.emptyVertexArray);
+    glm::mat4 nonTranslatedView = glm::mat4(glm::mat3(packet.view));
+    glm::mat4 inverseViewProjection = glm::inverse(packet.projection * nonTranslatedView);
+    UseShader(resources.cubemap);
+    UniformMat4(resources.cubemap, "inverseViewProjection", inverseViewProjection);
+    UniformInt(resources.cubemap, "cubemap", 3);
+    BindTexture(3, GL_TEXTURE_CUBE_MAP, environment.skybox.ID);
+    BindVertexArray(renderer.emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Light cube, axes and any other helpers in at most two draws from one buffer
+    if(renderer.debugBuffer.VAO == 0)
+        renderer.debugBuffer = CreateDebugDrawBuffer();
+    DrawDebugList(renderer.debugBuffer, packet.debug, resources.debug, packet.projection * packet.view);
+
+    // ImGui's backend restores everything it changes, so the cache still holds after it
+    if(packet.uiDrawData.Valid)
+        ImGui_ImplOpenGL3_RenderDrawData(&packet.uiDrawData);
+
+    GLStateStats stateStats = TakeGLStateStats();
+    std::lock_guard<std::mutex> lock(renderer.statsMutex);
+    renderer.stateStats = stateStats;
+}
+
+static void RunCommands(std::vector<std::function<void()>>& commands)
+{
+    for(auto& command : commands)
+        command();
+    commands.clear();
+}
+
+static void RenderThreadMain()
+{
+    glfwMakeContextCurrent(renderer.window);
+    ResetGLStateCache();
+
+    std::vector<std::function<void()>> commands;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(renderer.mutex);
+            renderer.wake.wait(lock, [] { return !renderer.running || !renderer.commands.empty() || TripleBufferHasFresh(renderer.packets); });
+            if(!renderer.running)
+                break;
+            commands.swap(renderer.commands);
+        }
+        RunCommands(commands);
+
+        if(!TripleBufferAcquire(renderer.packets))
+            continue;
+
+        // The main thread can start on the next frame while this one is drawn
+        WakeOtherThread();
+        RenderFrame(TripleBufferFront(renderer.packets));
+        glfwSwapBuffers(renderer.window);
+    }
+
+    // Commands enqueued before shutdown may be releasing GL objects
+    {
+        std::lock_guard<std::mutex> lock(renderer.mutex);
+        commands.swap(renderer.commands);
+    }
+    RunCommands(commands);
+
+    DeleteVertexArray(renderer.emptyVertexArray);
+    renderer.emptyVertexArray = 0;
+    if(renderer.debugBuffer.VAO != 0)
+        DeleteDebugDrawBuffer(renderer.debugBuffer);
+    if(renderer.lightBuffers.buffers[0] != 0)
+        DeleteLightClusterBuffers(renderer.lightBuffers);
+    if(renderer.shadowMap.FBO != 0)
+        DeleteShadowMap(renderer.shadowMap);
+
+    glFinish();
+    glfwMakeContextCurrent(nullptr);
+}
+
+void StartRenderThread(GLFWwindow* window, const RenderResources& resources)
+{
+    renderer.window = window;
+    renderer.resources = resources;
+    renderer.running = true;
+
+    glfwMakeContextCurrent(nullptr);
+    renderer.thread = std::thread(RenderThreadMain);
+}
+
+void StopRenderThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(renderer.mutex);
+        renderer.running = false;
+    }
+    renderer.wake.notify_all();
+    renderer.thread.join();
+
+    for(auto& packet : renderer.packets.slots)
+    {
+        for(ImDrawList* list : packet.uiDrawLists)
+            IM_DELETE(list);
+        packet.uiDrawLists.clear();
+        packet.draws.clear();
+        ClearDebugDraw(packet.debug);
+    }
+
+    glfwMakeContextCurrent(renderer.window);
+    ResetGLStateCache();
+}
+
+RenderPacket& BeginRenderPacket()
+{
+    std::unique_lock<std::mutex> lock(renderer.mutex);
+    renderer.wake.wait(lock, [] { return !TripleBufferHasFresh(renderer.packets); });
+    return TripleBufferBack(renderer.packets);
+}
+
+template<typename T>
+static void CopyImVector(ImVector<T>& destination, const ImVector<T>& source)
+{
+    // resize keeps the capacity from earlier frames, unlike ImVector's assignment
+    destination.resize(source.Size);
+    if(source.Size > 0)
+        memcpy(destination.Data, source.Data, source.size_in_bytes());
+}
+
+static void CopyDrawData(RenderPacket& packet, const ImDrawData* source)
+{
+    packet.uiDrawData = *source;
+    if(!source->Valid)
+        return;
+
+    while((int)packet.uiDrawLists.size() < source->CmdListsCount)
+        packet.uiDrawLists.push_back(IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData()));
+
+    for(int i = 0; i < source->CmdListsCount; i++)
+    {
+        const ImDrawList* from = source->CmdLists[i];
+        ImDrawList* to = packet.uiDrawLists[i];
+        CopyImVector(to->CmdBuffer, from->CmdBuffer);
+        CopyImVector(to->IdxBuffer, from->IdxBuffer);
+        CopyImVector(to->VtxBuffer, from->VtxBuffer);
+        to->Flags = from->Flags;
+    }
+    packet.uiDrawData.CmdLists = packet.uiDrawLists.data();
+}
+
+void SubmitRenderPacket(const ImDrawData* uiDrawData)
+{
+    RenderPacket& packet = TripleBufferBack(renderer.packets);
+    CopyDrawData(packet, uiDrawData);
+
+    TripleBufferPublish(renderer.packets);
+    WakeOtherThread();
+}
+
+void EnqueueRenderCommand(std::function<void()> command)
+{
+    {
+        std::lock_guard<std::mutex> lock(renderer.mutex);
+        renderer.commands.push_back(std::move(command));
+    }
+    renderer.wake.notify_all();
+}
+
+ClusterCullingStats GetRenderStats()
+{
+    std::lock_guard<std::mutex> lock(renderer.statsMutex);
+    return renderer.stats;
+}
+
+GLStateStats GetGLStateStats()
+{
+    std::lock_guard<std::mutex> lock(renderer.statsMutex);
+    return renderer.stateStats;
+}
+
+unsigned int GetShadowMapRenders()
+{
+    return renderer.shadowMapRenders;
+}
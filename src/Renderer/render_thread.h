@@ -0,0 +1,89 @@
+#pragma once
+#include "../AssetManagement/environment.h"
+#include "../AssetManagement/model.h"
+#include "debug_draw.h"
+#include "gl_state.h"
+#include "light_clusters.h"
+#include "shadow_map.h"
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <imgui.h>
+#include <functional>
+#include <vector>
+
+struct GLFWwindow;
+
+struct RenderDrawItem
+{
+    Model* model;
+    glm::mat4 transform;
+};
+
+// Everything the render thread needs to draw one frame. Packets are written
+// by the main thread and only read by the render thread once submitted.
+struct RenderPacket
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 cameraPosition;
+    glm::vec3 lightPosition;
+
+    std::vector<RenderDrawItem> draws;
+    const Environment* environment;
+    bool imageBasedLighting;
+    bool cullClusters;
+
+    // Bumped by the main thread whenever the draws move or change, keeps cached shadows valid otherwise
+    ShadowQuality shadowQuality;
+    unsigned int sceneVersion;
+
+    // Point lights besides the main one, binned into clusters before submitting
+    LightClusters lights;
+
+    // Light markers, axes and other helpers, cleared and refilled every frame
+    DebugDrawList debug;
+
+    // Copy of the frame's ImGui output, ImGui reuses its own draw lists on the next NewFrame
+    ImDrawData uiDrawData;
+    std::vector<ImDrawList*> uiDrawLists;
+};
+
+// Shaders and textures used around the scene's models. The skybox and debug
+// geometry bring their own vertices, so there are no helper meshes.
+struct RenderResources
+{
+    Shader lighting;
+    Shader pbr;
+    Shader cubemap;
+    Shader debug;
+    Shader shadow;
+
+    Texture brdfLookup;
+};
+
+// Moves the window's GL context, which must be current on the calling thread,
+// over to a dedicated render thread. Models referenced by packets must stay
+// alive until StopRenderThread, and their assets until the render thread has
+// moved on from the last packet drawing them.
+void StartRenderThread(GLFWwindow* window, const RenderResources& resources);
+
+// Runs the pending commands, joins the thread and makes the context current
+// on the calling thread again
+void StopRenderThread();
+
+// Packet for the next frame. Waits while the previously submitted packet
+// hasn't been picked up, so the main thread runs at most one frame ahead.
+RenderPacket& BeginRenderPacket();
+void SubmitRenderPacket(const ImDrawData* uiDrawData);
+
+// Runs a function with the GL context current, before the next frame is drawn
+void EnqueueRenderCommand(std::function<void()> command);
+
+// Cluster culling results of the most recently drawn frame
+ClusterCullingStats GetRenderStats();
+
+// State calls of the most recently drawn frame, including the commands run before it
+GLStateStats GetGLStateStats();
+
+// Times the shadow cube has been rendered, only goes up when its cache was invalidated
+unsigned int GetShadowMapRenders();
@@ -0,0 +1,135 @@
+#include "shadow_map.h"
+#include "render_thread.h"
+#include "gl_state.h"
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdio>
+#include <cstdlib>
+
+struct ShadowTier
+{
+    int size;
+    // Depth compared samples averaged per fragment, each already filtered 2x2 by the hardware
+    int taps;
+};
+
+static const ShadowTier ShadowTiers[] =
+{
+    { 0, 0 },
+    { 512, 1 },
+    { 1024, 9 },
+    { 2048, 21 },
+};
+
+static const float ShadowNear = 0.05f;
+static const float ShadowFar = 50.0f;
+
+// Face order of GL_TEXTURE_CUBE_MAP_POSITIVE_X onwards, with the up vectors cube maps are sampled with
+static const glm::vec3 FaceDirections[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+static const glm::vec3 FaceUps[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+static void CreateShadowCube(ShadowMap& shadow, int size)
+{
+    if(shadow.FBO == 0)
+    {
+        glGenFramebuffers(1, &shadow.FBO);
+        shadow.depthCube = GenTexture();
+    }
+
+    BindTexture(0, GL_TEXTURE_CUBE_MAP, shadow.depthCube);
+    for(int face = 0; face < 6; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // Depth only, there's no color attachment to draw to
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow.FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, shadow.depthCube, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Shadow map framebuffer is incomplete\n");
+        exit(-1);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    shadow.size = size;
+}
+
+void UpdateShadowMap(ShadowMap& shadow, ShadowQuality quality, const glm::vec3& lightPosition, unsigned int sceneVersion,
+                     const std::vector<RenderDrawItem>& draws, Shader& shadowShader)
+{
+    if(quality == ShadowQuality::Off)
+    {
+        shadow.quality = quality;
+        shadow.valid = false;
+        return;
+    }
+
+    // The light usually stays put while the camera orbits, which reuses the faces
+    if(shadow.valid && shadow.quality == quality && shadow.lightPosition == lightPosition && shadow.sceneVersion == sceneVersion)
+        return;
+
+    const ShadowTier& tier = ShadowTiers[(int)quality];
+    if(shadow.size != tier.size)
+        CreateShadowCube(shadow, tier.size);
+
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow.FBO);
+    glViewport(0, 0, shadow.size, shadow.size);
+
+    UseShader(shadowShader);
+    glm::vec3 light = lightPosition;
+    UniformVec3(shadowShader, "pointLightPos", light);
+    UniformFloat(shadowShader, "shadowFar", ShadowFar);
+
+    // Everything is drawn into every face, clusters are culled against the camera only
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, ShadowNear, ShadowFar);
+    for(int face = 0; face < 6; face++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, shadow.depthCube, 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        glm::mat4 viewProjection = projection * glm::lookAt(light, light + FaceDirections[face], FaceUps[face]);
+        UniformMat4(shadowShader, "lightViewProjection", viewProjection);
+        ModelDrawContext context = { viewProjection, light, false, {} };
+        for(auto& draw : draws)
+            DrawModel(*draw.model, shadowShader, draw.transform, context);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    shadow.quality = quality;
+    shadow.lightPosition = lightPosition;
+    shadow.sceneVersion = sceneVersion;
+    shadow.valid = true;
+    shadow.renders++;
+}
+
+void DeleteShadowMap(ShadowMap& shadow)
+{
+    glDeleteFramebuffers(1, &shadow.FBO);
+    DeleteTextures(1, &shadow.depthCube);
+    shadow = {};
+}
+
+void BindShadowMap(const ShadowMap* shadow, Shader& shader)
+{
+    UniformInt(shader, "shadowMap", 9);
+    bool enabled = shadow != nullptr && shadow->valid;
+    UniformInt(shader, "shadowTaps", enabled ? ShadowTiers[(int)shadow->quality].taps : 0);
+    if(!enabled)
+        return;
+
+    // Filter taps and depth bias are measured in texels, whose angle shrinks with resolution
+    UniformFloat(shader, "shadowFar", ShadowFar);
+    UniformFloat(shader, "shadowTexelAngle", 2.0f / shadow->size);
+    BindTexture(9, GL_TEXTURE_CUBE_MAP, shadow->depthCube);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <vector>
+
+struct Shader;
+struct RenderDrawItem;
+
+// Resolution and filter taps of the point light's shadows
+enum class ShadowQuality
+{
+    Off,
+    Low,
+    Medium,
+    High,
+};
+
+// Omnidirectional shadows of the main point light, a depth cube map holding each
+// direction's distance to the nearest occluder over shadowFar. The faces are only
+// rendered again when the light, the scene or the quality changes.
+struct ShadowMap
+{
+    unsigned int FBO;
+    unsigned int depthCube;
+    int size;
+
+    // What the faces currently show
+    ShadowQuality quality;
+    glm::vec3 lightPosition;
+    unsigned int sceneVersion;
+    bool valid;
+
+    // Times the faces were rendered, the cache's hit rate shows in the UI
+    unsigned int renders;
+};
+
+// Renders the faces with the shadow shader if anything they depend on changed since
+// the last call. The main thread bumps sceneVersion whenever the draws move or change.
+void UpdateShadowMap(ShadowMap& shadow, ShadowQuality quality, const glm::vec3& lightPosition, unsigned int sceneVersion,
+                     const std::vector<RenderDrawItem>& draws, Shader& shadowShader);
+void DeleteShadowMap(ShadowMap& shadow);
+
+// Binds the cube to unit 9 and sets the lighting shader's shadow uniforms.
+// Null or Off leaves the light unshadowed, the sampler still needs its unit.
+void BindShadowMap(const ShadowMap* shadow, Shader& shader);
@@ -0,0 +1,166 @@
+#include "staging_buffer.h"
+#include <glad/glad.h>
+#include <cstdio>
+#include <deque>
+
+struct StagingFence
+{
+    GLsync sync;
+    unsigned long long end;
+};
+
+// Positions are monotonically increasing byte counters, the ring offset is position % size
+static struct
+{
+    GLuint ID = 0;
+    unsigned char* mapped = nullptr;
+    size_t size = 0;
+
+    unsigned long long head = 0;
+    unsigned long long tail = 0;
+    std::deque<StagingFence> fences;
+} ring;
+
+static const size_t STAGING_ALIGNMENT = 64;
+
+void InitStaging(size_t size)
+{
+    if(!GLAD_GL_ARB_buffer_storage)
+    {
+        printf("GL_ARB_buffer_storage isn't supported, uploads will go through client memory\n");
+        return;
+    }
+
+    glGenBuffers(1, &ring.ID);
+    glBindBuffer(GL_COPY_READ_BUFFER, ring.ID);
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_READ_BUFFER, (GLsizeiptr)size, nullptr, flags);
+    ring.mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)size, flags);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if(ring.mapped == nullptr)
+    {
+        printf("Failed to persistently map the staging buffer, uploads will go through client memory\n");
+        glDeleteBuffers(1, &ring.ID);
+        ring.ID = 0;
+        return;
+    }
+
+    ring.size = size;
+    ring.head = ring.tail = 0;
+}
+
+void ShutdownStaging()
+{
+    for(auto& fence : ring.fences)
+        glDeleteSync(fence.sync);
+    ring.fences.clear();
+
+    if(ring.ID != 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, ring.ID);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &ring.ID);
+    }
+
+    ring.ID = 0;
+    ring.mapped = nullptr;
+    ring.size = 0;
+}
+
+// Frees up the oldest fenced region. Blocks until the GPU is done with it if wait is set.
+static bool RetireOldest(bool wait)
+{
+    if(ring.fences.empty())
+        return false;
+
+    StagingFence& fence = ring.fences.front();
+    GLuint64 timeout = wait ? 1000000000ull : 0;
+    GLenum status = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if(status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+        return false;
+
+    ring.tail = fence.end;
+    glDeleteSync(fence.sync);
+    ring.fences.pop_front();
+    return true;
+}
+
+StagingAllocation StagingAlloc(size_t size)
+{
+    size_t aligned = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+    // Unsupported or too large for the ring, hand out client memory instead
+    if(ring.ID == 0 || aligned > ring.size)
+        return { new unsigned char[size], 0, size, false, 0 };
+
+    // Regions are contiguous, so skip the rest of the ring if this doesn't fit before wrapping
+    unsigned long long start = ring.head;
+    size_t offset = (size_t)(start % ring.size);
+    if(offset + aligned > ring.size)
+    {
+        start += ring.size - offset;
+        offset = 0;
+    }
+
+    // Opportunistically retire finished uploads, then wait on the ones still in our way
+    while(RetireOldest(false));
+    while(start + aligned - ring.tail > ring.size)
+    {
+        if(!RetireOldest(true))
+        {
+            // Everything in flight is unreleased, so nothing can be reclaimed
+            printf("Staging ring exhausted, falling back to client memory for %zu bytes\n", size);
+            return { new unsigned char[size], 0, size, false, 0 };
+        }
+    }
+
+    ring.head = start + aligned;
+    return { ring.mapped + offset, offset, size, true, ring.head };
+}
+
+void StagingRelease(StagingAllocation& allocation)
+{
+    if(!allocation.staged)
+        delete[] allocation.data;
+    else
+    {
+        // The region becomes reusable once the GPU has executed the copies issued so far
+        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ring.fences.push_back({ sync, allocation.end });
+    }
+
+    allocation.data = nullptr;
+    allocation.size = 0;
+}
+
+void StagingUploadBuffer(const StagingAllocation& allocation, size_t srcOffset, unsigned int target, size_t dstOffset, size_t size)
+{
+    if(!allocation.staged)
+    {
+        glBufferSubData(target, (GLintptr)dstOffset, (GLsizeiptr)size, allocation.data + srcOffset);
+        return;
+    }
+
+    // Let the GPU copy out of the ring asynchronously
+    glBindBuffer(GL_COPY_READ_BUFFER, ring.ID);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, target, (GLintptr)(allocation.offset + srcOffset), (GLintptr)dstOffset, (GLsizeiptr)size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void StagingUploadTexture(const StagingAllocation& allocation, size_t srcOffset, unsigned int target, int level,
+                          int internalFormat, int width, int height, unsigned int format, unsigned int type)
+{
+    if(!allocation.staged)
+    {
+        glTexImage2D(target, level, internalFormat, width, height, 0, format, type, allocation.data + srcOffset);
+        return;
+    }
+
+    // With a pixel unpack buffer bound the data pointer is an offset into it
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.ID);
+    glTexImage2D(target, level, internalFormat, width, height, 0, format, type, (void*)(allocation.offset + srcOffset));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+
+// A region of upload memory handed out by the staging ring. When the
+// persistent mapped ring isn't supported or the request doesn't fit in it,
+// the memory is a plain heap allocation that is uploaded the regular way.
+struct StagingAllocation
+{
+    unsigned char* data;
+    size_t offset;
+    size_t size;
+    bool staged;
+
+    // Ring position just past this allocation, used to fence it on release
+    unsigned long long end;
+};
+
+// Creates the persistently mapped ring (needs a current GL context)
+void InitStaging(size_t size);
+void ShutdownStaging();
+
+// Allocations must be released in the order they were made, after the
+// uploads that read from them have been issued.
+StagingAllocation StagingAlloc(size_t size);
+void StagingRelease(StagingAllocation& allocation);
+
+// Copies size bytes starting at srcOffset within the allocation to dstOffset
+// within the buffer bound to target, whose storage must already be allocated
+void StagingUploadBuffer(const StagingAllocation& allocation, size_t srcOffset, unsigned int target, size_t dstOffset, size_t size);
+
+// glTexImage2D for the texture bound to target, sourcing the pixels from the allocation
+void StagingUploadTexture(const StagingAllocation& allocation, size_t srcOffset, unsigned int target, int level,
+                          int internalFormat, int width, int height, unsigned int format, unsigned int type);
@@ -0,0 +1,284 @@
+#include "thumbnail_atlas.h"
+#include "../AssetManagement/async_loader.h"
+#include "gl_state.h"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+struct ThumbnailView
+{
+    const char* name;
+    float yaw;
+    float pitch;
+};
+
+// Yaw turns around +y starting from the front (+z), pitch looks down from above
+static const ThumbnailView CanonicalViews[] =
+{
+    { "three-quarter", 45.0f, 25.0f },
+    { "front", 0.0f, 0.0f },
+    { "right", 90.0f, 0.0f },
+    { "back", 180.0f, 0.0f },
+    { "left", 270.0f, 0.0f },
+    { "top", 0.0f, 89.0f },
+};
+static const int NumCanonicalViews = sizeof(CanonicalViews) / sizeof(CanonicalViews[0]);
+
+static const int MaxAtlasSize = 4096;
+static const float FieldOfView = 30.0f;
+
+// Enough to keep the loader busy while tiles are drawn, without holding every model at once
+static const size_t LoadsAhead = 4;
+
+struct ThumbnailAtlas
+{
+    unsigned int FBO;
+    unsigned int color;
+    unsigned int depth;
+    int size;
+    int columns;
+};
+
+static ThumbnailAtlas CreateThumbnailAtlas(int tileSize)
+{
+    int maxTextureSize, maxRenderbufferSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+
+    ThumbnailAtlas result = {};
+    result.columns = std::min({ MaxAtlasSize, maxTextureSize, maxRenderbufferSize }) / tileSize;
+    result.size = result.columns * tileSize;
+    if(result.columns == 0)
+    {
+        printf("Thumbnail tiles of %d pixels don't fit in a framebuffer\n", tileSize);
+        exit(-1);
+    }
+
+    result.color = GenTexture();
+    BindTexture(0, GL_TEXTURE_2D, result.color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, result.size, result.size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenRenderbuffers(1, &result.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, result.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, result.size, result.size);
+
+    glGenFramebuffers(1, &result.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, result.FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, result.color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, result.depth);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Thumbnail atlas framebuffer is incomplete\n");
+        exit(-1);
+    }
+    return result;
+}
+
+static void DeleteThumbnailAtlas(ThumbnailAtlas& atlas)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &atlas.FBO);
+    glDeleteRenderbuffers(1, &atlas.depth);
+    DeleteTextures(1, &atlas.color);
+    atlas = {};
+}
+
+// Only reads back the rows holding tiles, the last page is usually partly empty
+static bool WriteThumbnailPage(const ThumbnailAtlas& atlas, int numTiles, int tileSize, const char* path)
+{
+    int height = (numTiles + atlas.columns - 1) / atlas.columns * tileSize;
+    std::vector<unsigned char> pixels((size_t)atlas.size * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, atlas.size, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    // GL rows start at the bottom, so the first tile ends up top left
+    stbi_flip_vertically_on_write(1);
+    if(stbi_write_png(path, atlas.size, height, 4, pixels.data(), atlas.size * 4) == 0)
+    {
+        printf("Failed to write thumbnail atlas to %s\n", path);
+        return false;
+    }
+    printf("Wrote %d thumbnails to %s\n", numTiles, path);
+    return true;
+}
+
+static void AppendJSONString(std::string& json, const char* value)
+{
+    json += '"';
+    for(const char* c = value; *c != '\0'; c++)
+    {
+        if(*c == '"' || *c == '\\')
+            json += '\\';
+        if((unsigned char)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+            json += escaped;
+        }
+        else
+            json += *c;
+    }
+    json += '"';
+}
+
+static void ClearThumbnailPage(const ThumbnailAtlas& atlas)
+{
+    glScissor(0, 0, atlas.size, atlas.size);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+int RenderThumbnailAtlas(const std::vector<std::string>& paths, const ThumbnailSettings& settings,
+                         RenderResources& resources, const Environment& environment)
+{
+    int tileSize = settings.tileSize;
+    int views = std::max(1, std::min(settings.views, NumCanonicalViews));
+    ThumbnailAtlas atlas = CreateThumbnailAtlas(tileSize);
+    int tilesPerPage = atlas.columns * atlas.columns;
+    if(views > tilesPerPage)
+        views = tilesPerPage;
+
+    // Shader, lighting and environment stay bound for every tile
+    Shader& shader = resources.pbr;
+    UseShader(shader);
+    UniformVec3Array(shader, "irradiance", environment.irradiance, 9);
+    UniformFloat(shader, "prefilteredMaxLod", (float)(environment.specular.levels - 1));
+    UniformInt(shader, "prefilteredMap", 4);
+    UniformInt(shader, "brdfLookup", 5);
+    BindTexture(4, GL_TEXTURE_CUBE_MAP, environment.specular.ID);
+    BindTexture(5, GL_TEXTURE_2D, resources.brdfLookup.ID);
+    SetLightClusterSamplers(shader);
+    BindShadowMap(nullptr, shader);
+
+    // Transparent background, so thumbnails can go on any color
+    glBindFramebuffer(GL_FRAMEBUFFER, atlas.FBO);
+    SetCapability(GL_SCISSOR_TEST, true);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    ClearThumbnailPage(atlas);
+
+    std::string modelsJSON;
+    std::vector<std::string> pageFiles;
+    int page = 0, tile = 0, failed = 0;
+    double start = glfwGetTime();
+
+    std::vector<AsyncLoad*> loads;
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        while(loads.size() < paths.size() && loads.size() < i + LoadsAhead)
+            loads.push_back(QueueModelLoad(paths[loads.size()].c_str()));
+
+        // The loader posts an empty event whenever a load ends
+        AsyncLoad* load = loads[i];
+        while(load->state == AsyncLoadState::Queued || load->state == AsyncLoadState::Loading)
+            glfwWaitEventsTimeout(0.1);
+        if(load->state != AsyncLoadState::Ready)
+        {
+            printf("No thumbnails for %s\n", paths[i].c_str());
+            FreeLoad(load);
+            failed++;
+            continue;
+        }
+
+        // A model's views stay together on one page
+        if(tile + views > tilesPerPage)
+        {
+            pageFiles.push_back(std::string(settings.outputPath) + "_" + std::to_string(page) + ".png");
+            WriteThumbnailPage(atlas, tile, tileSize, pageFiles.back().c_str());
+            ClearThumbnailPage(atlas);
+            page++;
+            tile = 0;
+        }
+
+        // Frame the bounding sphere of the model's clusters
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+        if(!GetModelBounds(load->model, glm::mat4(1.0f), min, max))
+        {
+            min = glm::vec3(-1.0f);
+            max = glm::vec3(1.0f);
+        }
+        glm::vec3 center = (min + max) * 0.5f;
+        float radius = std::max(glm::length(max - min) * 0.5f, 1e-4f);
+        float distance = radius / sinf(glm::radians(FieldOfView * 0.5f));
+        glm::mat4 projection = glm::perspective(glm::radians(FieldOfView), 1.0f, std::max(distance - radius * 1.01f, distance * 1e-3f), distance + radius * 1.01f);
+        UniformMat4(shader, "projection", projection);
+
+        if(!modelsJSON.empty())
+            modelsJSON += ",\n";
+        modelsJSON += "    { \"path\": ";
+        AppendJSONString(modelsJSON, paths[i].c_str());
+        modelsJSON += ", \"page\": " + std::to_string(page) + ", \"tiles\": [";
+
+        for(int view = 0; view < views; view++, tile++)
+        {
+            int x = tile % atlas.columns * tileSize;
+            int y = tile / atlas.columns * tileSize;
+            glViewport(x, y, tileSize, tileSize);
+            glScissor(x, y, tileSize, tileSize);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            float yaw = glm::radians(CanonicalViews[view].yaw);
+            float pitch = glm::radians(CanonicalViews[view].pitch);
+            glm::vec3 direction(sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch));
+            glm::vec3 eye = center + direction * distance;
+            glm::mat4 viewMatrix = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            // The light sits above the camera's shoulder
+            glm::vec3 light = eye + glm::vec3(0.0f, radius, 0.0f);
+            UniformMat4(shader, "view", viewMatrix);
+            UniformVec3(shader, "cameraPos", eye);
+            UniformVec3(shader, "pointLightPos", light);
+
+            ModelDrawContext context = { projection * viewMatrix, eye, true, {} };
+            DrawModel(load->model, shader, glm::mat4(1.0f), context);
+
+            // Image coordinates with the origin top left, as written to the page
+            modelsJSON += (view > 0 ? ", " : "") + std::string("{ \"view\": \"") + CanonicalViews[view].name + "\", \"x\": " +
+                          std::to_string(x) + ", \"y\": " + std::to_string(y) + " }";
+        }
+        modelsJSON += "] }";
+
+        // Drawn on this context, which is where its vertex arrays have to be deleted
+        ReleaseModel(load->model);
+        FreeLoad(load);
+    }
+
+    if(tile > 0)
+    {
+        pageFiles.push_back(std::string(settings.outputPath) + "_" + std::to_string(page) + ".png");
+        WriteThumbnailPage(atlas, tile, tileSize, pageFiles.back().c_str());
+    }
+
+    SetCapability(GL_SCISSOR_TEST, false);
+    DeleteThumbnailAtlas(atlas);
+
+    std::string json = "{\n  \"tileSize\": " + std::to_string(tileSize) + ",\n  \"pages\": [";
+    for(size_t i = 0; i < pageFiles.size(); i++)
+    {
+        json += i > 0 ? ", " : "";
+        AppendJSONString(json, pageFiles[i].c_str());
+    }
+    json += "],\n  \"models\": [\n" + modelsJSON + "\n  ]\n}\n";
+
+    std::string indexPath = std::string(settings.outputPath) + ".json";
+    FILE* file = fopen(indexPath.c_str(), "wb");
+    if(file == nullptr)
+    {
+        printf("Failed to write thumbnail index to %s\n", indexPath.c_str());
+        return (int)paths.size();
+    }
+    fwrite(json.data(), 1, json.size(), file);
+    fclose(file);
+
+    double seconds = glfwGetTime() - start;
+    printf("Rendered %zu models in %.2f s (%.0f per minute), %d failed\n", paths.size() - failed, seconds,
+           (double)(paths.size() - failed) * 60.0 / std::max(seconds, 1e-6), failed);
+    return failed;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "render_thread.h"
+#include <string>
+#include <vector>
+
+struct ThumbnailSettings
+{
+    // Pages are written to <outputPath>_<page>.png and the index to <outputPath>.json
+    const char* outputPath;
+    int tileSize;
+
+    // Canonical angles per model, starting from a three-quarter view
+    int views;
+};
+
+// Batch mode: loads the models through the async loader a few ahead of the one being drawn
+// and renders each from canonical angles into tiles of a shared framebuffer atlas. Shaders and
+// environment are bound once for all tiles. Runs on the thread whose context is current, after
+// StartAsyncLoader. Returns the number of models that failed to load.
+int RenderThumbnailAtlas(const std::vector<std::string>& paths, const ThumbnailSettings& settings,
+                         RenderResources& resources, const Environment& environment);
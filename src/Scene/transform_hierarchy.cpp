@@ -0,0 +1,165 @@
+#include "transform_hierarchy.h"
+#include "../Mesh/simd_ops.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+enum TransformFlags : unsigned char
+{
+    LocalDirty = 1,
+    WorldDirty = 2,
+    // Queued in the current batch, its world matrix isn't written yet
+    Pending = 4,
+};
+
+static const int MaxBatchSize = 64;
+
+// Nodes whose parents' world matrices are final, multiplied together
+struct TransformBatch
+{
+    unsigned int parentOffsets[MaxBatchSize];
+    unsigned int nodeOffsets[MaxBatchSize];
+    unsigned int nodes[MaxBatchSize];
+    int count;
+};
+
+unsigned int AddTransform(TransformHierarchy& hierarchy, int parent, const Entity& entity)
+{
+    unsigned int node = (unsigned int)hierarchy.parents.size();
+    if(parent >= (int)node)
+    {
+        printf("Transform parent %d has to be added before its children\n", parent);
+        exit(-1);
+    }
+
+    hierarchy.parents.push_back(parent < 0 ? -1 : parent);
+    hierarchy.positions.push_back(entity.position);
+    hierarchy.rotations.push_back(entity.rotation);
+    hierarchy.scales.push_back(entity.scale);
+    hierarchy.locals.push_back(glm::mat4(1.0f));
+    hierarchy.worlds.push_back(glm::mat4(1.0f));
+    hierarchy.flags.push_back(LocalDirty);
+    hierarchy.firstDirty = std::min(hierarchy.firstDirty, (size_t)node);
+    return node;
+}
+
+void MarkTransformDirty(TransformHierarchy& hierarchy, unsigned int node)
+{
+    hierarchy.flags[node] |= LocalDirty;
+    hierarchy.firstDirty = std::min(hierarchy.firstDirty, (size_t)node);
+}
+
+void SetTransform(TransformHierarchy& hierarchy, unsigned int node, const Entity& entity)
+{
+    hierarchy.positions[node] = entity.position;
+    hierarchy.rotations[node] = entity.rotation;
+    hierarchy.scales[node] = entity.scale;
+    MarkTransformDirty(hierarchy, node);
+}
+
+static glm::mat4 ComposeLocal(const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+{
+    glm::mat4 result = glm::translate(glm::mat4(1.0f), position);
+    result = glm::rotate(result, glm::radians(rotation.x), {1.0f, 0.0f, 0.0f});
+    result = glm::rotate(result, glm::radians(rotation.y), {0.0f, 1.0f, 0.0f});
+    result = glm::rotate(result, glm::radians(rotation.z), {0.0f, 0.0f, 1.0f});
+    return glm::scale(result, scale);
+}
+
+// world = parentWorld * local for Ops::Width nodes at once, one matrix element per lane.
+// Offsets are in floats, column major like glm.
+template<typename Ops>
+static void MultiplyTransforms(float* worlds, const float* locals, const unsigned int* parentOffsets, const unsigned int* nodeOffsets)
+{
+    typedef typename Ops::V V;
+
+    V parent[16], local[16];
+    for(int e = 0; e < 16; e++)
+    {
+        parent[e] = Ops::Gather(worlds + e, parentOffsets);
+        local[e] = Ops::Gather(locals + e, nodeOffsets);
+    }
+
+    for(int column = 0; column < 4; column++)
+    {
+        for(int row = 0; row < 4; row++)
+        {
+            V sum = Ops::Mul(parent[row], local[column * 4]);
+            for(int k = 1; k < 4; k++)
+                sum = Ops::Add(sum, Ops::Mul(parent[k * 4 + row], local[column * 4 + k]));
+
+            float values[Ops::Width];
+            Ops::Store(values, sum);
+            for(int lane = 0; lane < Ops::Width; lane++)
+                worlds[nodeOffsets[lane] + column * 4 + row] = values[lane];
+        }
+    }
+}
+
+static void FlushBatch(TransformHierarchy& hierarchy, TransformBatch& batch)
+{
+    float* worlds = &hierarchy.worlds[0][0][0];
+    const float* locals = &hierarchy.locals[0][0][0];
+
+    int i = 0;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    for(; i + WideOps::Width <= batch.count; i += WideOps::Width)
+        MultiplyTransforms<WideOps>(worlds, locals, batch.parentOffsets + i, batch.nodeOffsets + i);
+#endif
+    for(; i < batch.count; i++)
+        MultiplyTransforms<ScalarOps>(worlds, locals, batch.parentOffsets + i, batch.nodeOffsets + i);
+
+    for(int j = 0; j < batch.count; j++)
+        hierarchy.flags[batch.nodes[j]] &= ~Pending;
+    batch.count = 0;
+}
+
+size_t UpdateTransforms(TransformHierarchy& hierarchy)
+{
+    size_t numNodes = hierarchy.parents.size();
+    if(hierarchy.firstDirty >= numNodes)
+        return 0;
+
+    TransformBatch batch;
+    batch.count = 0;
+    size_t result = 0;
+    for(size_t i = hierarchy.firstDirty; i < numNodes; i++)
+    {
+        unsigned char& flags = hierarchy.flags[i];
+        int parent = hierarchy.parents[i];
+        if(parent >= 0 && (hierarchy.flags[parent] & WorldDirty))
+            flags |= WorldDirty;
+        if(flags & LocalDirty)
+        {
+            hierarchy.locals[i] = ComposeLocal(hierarchy.positions[i], hierarchy.rotations[i], hierarchy.scales[i]);
+            flags |= WorldDirty;
+        }
+        if(!(flags & WorldDirty))
+            continue;
+
+        result++;
+        if(parent < 0)
+        {
+            hierarchy.worlds[i] = hierarchy.locals[i];
+            continue;
+        }
+
+        // Children of nodes still in the batch wait for the next one
+        if(hierarchy.flags[parent] & Pending)
+            FlushBatch(hierarchy, batch);
+
+        flags |= Pending;
+        batch.parentOffsets[batch.count] = (unsigned int)parent * 16;
+        batch.nodeOffsets[batch.count] = (unsigned int)i * 16;
+        batch.nodes[batch.count] = (unsigned int)i;
+        if(++batch.count == MaxBatchSize)
+            FlushBatch(hierarchy, batch);
+    }
+    FlushBatch(hierarchy, batch);
+
+    // Children read their parent's flags above, so they're only cleared once every node is done
+    std::fill(hierarchy.flags.begin() + hierarchy.firstDirty, hierarchy.flags.end(), 0);
+    hierarchy.firstDirty = numNodes;
+    return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <vector>
+
+// Translation, Euler rotation in degrees applied x then y then z, and scale
+struct Entity
+{
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+};
+
+// Parent/child transforms as parallel arrays, each node after its parent so a single
+// pass in order sees every parent's world matrix before its children. Edits only flag
+// nodes, UpdateTransforms then recomputes the flagged ones and everything below them.
+struct TransformHierarchy
+{
+    // -1 for roots
+    std::vector<int> parents;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> rotations;
+    std::vector<glm::vec3> scales;
+
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> flags;
+
+    // Nodes before this one are clean, saves scanning a static scene
+    size_t firstDirty = 0;
+};
+
+// Parent has to be an existing node or -1, which keeps the arrays in topological order
+unsigned int AddTransform(TransformHierarchy& hierarchy, int parent, const Entity& entity);
+
+// Marks a node whose position, rotation or scale has been written in place
+void MarkTransformDirty(TransformHierarchy& hierarchy, unsigned int node);
+void SetTransform(TransformHierarchy& hierarchy, unsigned int node, const Entity& entity);
+
+// Brings the world matrices of dirty nodes and their descendants up to date, several
+// nodes per multiply with simd_ops. Returns how many were recomputed, 0 when nothing moved.
+size_t UpdateTransforms(TransformHierarchy& hierarchy);
@@ -1,40 +1,124 @@
 #include "string.h"
 #include <cstring>
 
+// FNV-1a
+static size_t HashString(const char* str, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
 String::String()
 {
-    length = 0;
-    buffer = nullptr;
+    Assign("", 0, HashString("", 0));
 }
 
 String::String(const char* str)
 {
-    length = (unsigned long)strlen(str);
-    buffer = new char[length + 1];
-    strncpy(buffer, str, length);
-    buffer[length] = '\0';
+    size_t strLength = strlen(str);
+    Assign(str, strLength, HashString(str, strLength));
+}
+
+String::String(const char* str, size_t strLength)
+{
+    Assign(str, strLength, HashString(str, strLength));
 }
 
 String::String(const String& other)
 {
-    length = other.length;
-    buffer = new char[length + 1];
-    strncpy(buffer, other.buffer, length);
-    buffer[length] = '\0';
+    Assign(other.C_Str(), other.length, other.hash);
+}
+
+String::String(String&& other) noexcept
+{
+    MoveFrom(other);
 }
 
 String::~String()
 {
-    if(buffer != nullptr)
-        delete[] buffer;
+    Release();
+}
+
+String& String::operator=(const String& other)
+{
+    if(this == &other)
+        return *this;
+
+    Release();
+    Assign(other.C_Str(), other.length, other.hash);
+    return *this;
+}
+
+String& String::operator=(String&& other) noexcept
+{
+    if(this == &other)
+        return *this;
+
+    Release();
+    MoveFrom(other);
+    return *this;
+}
+
+void String::Assign(const char* str, size_t strLength, size_t strHash)
+{
+    length = strLength;
+    hash = strHash;
+
+    char* buffer = small;
+    if(length > InlineCapacity)
+        buffer = heap = new char[length + 1];
+    memcpy(buffer, str, length);
+    buffer[length] = '\0';
+}
+
+void String::MoveFrom(String& other)
+{
+    length = other.length;
+    hash = other.hash;
+    if(length > InlineCapacity)
+        heap = other.heap;
+    else
+        memcpy(small, other.small, length + 1);
+
+    // Leave the moved from string empty, without its heap buffer
+    other.length = 0;
+    other.hash = HashString("", 0);
+    other.small[0] = '\0';
+}
+
+void String::Release()
+{
+    if(length > InlineCapacity)
+        delete[] heap;
+    length = 0;
 }
 
 const char* String::C_Str() const
 {
-    return buffer;
+    return length > InlineCapacity ? heap : small;
+}
+
+size_t String::Length() const
+{
+    return length;
+}
+
+size_t String::Hash() const
+{
+    return hash;
 }
 
 bool String::operator==(const String& rhs) const
 {
-    return length == rhs.length && !strcmp(buffer, rhs.buffer);
-}
\ No newline at end of file
+    return hash == rhs.hash && length == rhs.length && memcmp(C_Str(), rhs.C_Str(), length) == 0;
+}
+
+bool String::operator!=(const String& rhs) const
+{
+    return !(*this == rhs);
+}
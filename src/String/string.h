@@ -1,16 +1,49 @@
 #pragma once
+#include <cstddef>
+#include <functional>
 
+// Strings of up to InlineCapacity characters are stored in place, so most asset names
+// and paths never allocate. The hash is computed once, making strings cheap lookup keys.
 struct String
 {
-    unsigned long length;
-    char* buffer;
+    static const size_t InlineCapacity = 47;
 
     String();
     String(const char* str);
+    String(const char* str, size_t strLength);
     String(const String& other);
+    String(String&& other) noexcept;
     ~String();
 
+    String& operator=(const String& other);
+    String& operator=(String&& other) noexcept;
+
     const char* C_Str() const;
+    size_t Length() const;
+    size_t Hash() const;
 
     bool operator==(const String& rhs) const;
-};
\ No newline at end of file
+    bool operator!=(const String& rhs) const;
+
+private:
+    void Assign(const char* str, size_t strLength, size_t strHash);
+    void MoveFrom(String& other);
+    void Release();
+
+    size_t length;
+    size_t hash;
+    union
+    {
+        char small[InlineCapacity + 1];
+        char* heap;
+    };
+};
+
+namespace std
+{
+    template<>
+    struct hash<String>
+    {
+        size_t operator()(const String& str) const { return str.Hash(); }
+    };
+}
@@ -0,0 +1,346 @@
+#include "job_system.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+
+struct Job
+{
+    const char* name;
+    std::function<void()> work;
+    JobCounter* counter;
+};
+
+// Chase-Lev work stealing deque. The owning worker pushes and pops at the
+// bottom, any other thread steals from the top. A full deque makes the push
+// fail and the job runs right away on the pushing thread instead.
+struct JobDeque
+{
+    static const int64_t Capacity = 4096;
+
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    std::atomic<Job*> jobs[Capacity];
+};
+
+static bool PushJob(JobDeque& deque, Job* job)
+{
+    int64_t b = deque.bottom.load(std::memory_order_relaxed);
+    int64_t t = deque.top.load(std::memory_order_acquire);
+    if(b - t >= JobDeque::Capacity)
+        return false;
+
+    deque.jobs[b & (JobDeque::Capacity - 1)].store(job, std::memory_order_relaxed);
+    deque.bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+static Job* PopJob(JobDeque& deque)
+{
+    int64_t b = deque.bottom.load(std::memory_order_relaxed) - 1;
+    deque.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = deque.top.load(std::memory_order_relaxed);
+
+    if(t > b)
+    {
+        // Empty
+        deque.bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = deque.jobs[b & (JobDeque::Capacity - 1)].load(std::memory_order_relaxed);
+    if(t == b)
+    {
+        // Last job, race the thieves for it
+        if(!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        deque.bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+static Job* StealJob(JobDeque& deque)
+{
+    int64_t t = deque.top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = deque.bottom.load(std::memory_order_acquire);
+    if(t >= b)
+        return nullptr;
+
+    Job* job = deque.jobs[t & (JobDeque::Capacity - 1)].load(std::memory_order_relaxed);
+    if(!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+static struct
+{
+    std::vector<std::thread> threads;
+    std::unique_ptr<JobDeque[]> deques;
+    unsigned int numWorkers = 0;
+    std::once_flag started;
+
+    // Jobs queued from threads outside the pool
+    std::mutex injectionMutex;
+    std::deque<Job*> injected;
+
+    // Queued jobs nobody has picked up yet, idle workers sleep while it's zero
+    std::atomic<unsigned int> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quit = false;
+
+    // Workers sleeping in WaitForCounter, who also need waking when a counter drops to zero
+    std::atomic<unsigned int> waitingWorkers{0};
+
+    std::atomic<JobTimingHook> timingHook{nullptr};
+    std::chrono::steady_clock::time_point epoch;
+} jobs;
+
+// 1 based index of the current thread's worker, 0 outside the pool
+static thread_local unsigned int workerIndex = 0;
+
+static Job* FindJob()
+{
+    if(workerIndex > 0)
+    {
+        Job* job = PopJob(jobs.deques[workerIndex - 1]);
+        if(job != nullptr)
+            return job;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobs.injectionMutex);
+        if(!jobs.injected.empty())
+        {
+            Job* job = jobs.injected.front();
+            jobs.injected.pop_front();
+            return job;
+        }
+    }
+
+    // Start stealing from the next worker along so thieves spread out
+    for(unsigned int i = 0; i < jobs.numWorkers; i++)
+    {
+        unsigned int victim = (workerIndex + i) % jobs.numWorkers;
+        if(victim + 1 == workerIndex)
+            continue;
+
+        Job* job = StealJob(jobs.deques[victim]);
+        if(job != nullptr)
+            return job;
+    }
+    return nullptr;
+}
+
+static void QueueJob(Job* job);
+
+static void FinishJob(JobCounter& counter)
+{
+    // Decremented under the lock as the counter may go out of scope as soon
+    // as a waiter sees zero, which WaitForCounter holds off until it's released
+    std::vector<Job*> continuations;
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if(counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            last = true;
+            continuations.swap(counter.continuations);
+            counter.done.notify_all();
+        }
+    }
+
+    // Pairs with the fence in WaitForCounter, either the waiter sees zero or this sees the waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(last && jobs.waitingWorkers.load(std::memory_order_relaxed) > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobs.sleepMutex);
+        }
+        jobs.wake.notify_all();
+    }
+
+    // Jobs waiting on this counter can start now
+    for(Job* job : continuations)
+        QueueJob(job);
+}
+
+static void ExecuteJob(Job* job)
+{
+    JobTimingHook hook = jobs.timingHook.load(std::memory_order_relaxed);
+    if(hook != nullptr)
+    {
+        double start = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobs.epoch).count();
+        job->work();
+        double end = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobs.epoch).count();
+        hook(job->name, workerIndex, start, end);
+    }
+    else
+        job->work();
+
+    JobCounter& counter = *job->counter;
+    delete job;
+    FinishJob(counter);
+}
+
+static void QueueJob(Job* job)
+{
+    // Counted before the job is visible so whoever takes it never sees the count at zero
+    jobs.queued.fetch_add(1, std::memory_order_acq_rel);
+
+    if(workerIndex > 0)
+    {
+        if(!PushJob(jobs.deques[workerIndex - 1], job))
+        {
+            jobs.queued.fetch_sub(1, std::memory_order_acq_rel);
+            ExecuteJob(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(jobs.injectionMutex);
+        jobs.injected.push_back(job);
+    }
+
+    // Taking the lock makes sure a worker about to sleep either sees the job or gets the notify
+    {
+        std::lock_guard<std::mutex> lock(jobs.sleepMutex);
+    }
+    jobs.wake.notify_one();
+}
+
+// Runs one queued job if there is any
+static bool RunQueuedJob()
+{
+    Job* job = FindJob();
+    if(job == nullptr)
+        return false;
+
+    jobs.queued.fetch_sub(1, std::memory_order_acq_rel);
+    ExecuteJob(job);
+    return true;
+}
+
+static void WorkerMain(unsigned int index)
+{
+    workerIndex = index;
+    while(true)
+    {
+        if(RunQueuedJob())
+            continue;
+
+        std::unique_lock<std::mutex> lock(jobs.sleepMutex);
+        jobs.wake.wait(lock, [] { return jobs.quit || jobs.queued.load(std::memory_order_acquire) > 0; });
+        if(jobs.quit)
+            return;
+    }
+}
+
+static void StartWorkers(unsigned int numWorkers)
+{
+    if(numWorkers == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        numWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    jobs.epoch = std::chrono::steady_clock::now();
+    jobs.numWorkers = numWorkers;
+    jobs.deques.reset(new JobDeque[numWorkers]);
+    jobs.quit = false;
+
+    jobs.threads.reserve(numWorkers);
+    for(unsigned int i = 0; i < numWorkers; i++)
+        jobs.threads.emplace_back(WorkerMain, i + 1);
+}
+
+void InitJobSystem(unsigned int numWorkers)
+{
+    std::call_once(jobs.started, StartWorkers, numWorkers);
+}
+
+void ShutdownJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs.sleepMutex);
+        jobs.quit = true;
+    }
+    jobs.wake.notify_all();
+
+    for(auto& thread : jobs.threads)
+        thread.join();
+    jobs.threads.clear();
+}
+
+unsigned int GetJobWorkerCount()
+{
+    std::call_once(jobs.started, StartWorkers, 0u);
+    return jobs.numWorkers;
+}
+
+void RunJob(const char* name, std::function<void()> work, JobCounter& counter)
+{
+    std::call_once(jobs.started, StartWorkers, 0u);
+
+    counter.pending.fetch_add(1, std::memory_order_acq_rel);
+    QueueJob(new Job{ name, std::move(work), &counter });
+}
+
+void RunJobAfter(JobCounter& dependency, const char* name, std::function<void()> work, JobCounter& counter)
+{
+    std::call_once(jobs.started, StartWorkers, 0u);
+
+    counter.pending.fetch_add(1, std::memory_order_acq_rel);
+    Job* job = new Job{ name, std::move(work), &counter };
+
+    // The dependency's last job decrements it under the lock, so the job is either queued here or by that job
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if(dependency.pending.load(std::memory_order_acquire) > 0)
+        {
+            dependency.continuations.push_back(job);
+            return;
+        }
+    }
+    QueueJob(job);
+}
+
+void WaitForCounter(JobCounter& counter)
+{
+    // A worker blocking here could leave queued jobs with nobody to run them,
+    // so it keeps running whatever is queued and only sleeps when there's none
+    if(workerIndex > 0)
+    {
+        while(counter.pending.load(std::memory_order_acquire) > 0)
+        {
+            if(RunQueuedJob())
+                continue;
+
+            jobs.waitingWorkers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(jobs.sleepMutex);
+                jobs.wake.wait(lock, [&counter]
+                {
+                    return counter.pending.load(std::memory_order_acquire) == 0 || jobs.queued.load(std::memory_order_acquire) > 0;
+                });
+            }
+            jobs.waitingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Other threads leave the pool's jobs to the pool and sleep until the last
+    // one is done. Waiting under the lock also covers that job still holding it.
+    std::unique_lock<std::mutex> lock(counter.mutex);
+    counter.done.wait(lock, [&counter] { return counter.pending.load(std::memory_order_acquire) == 0; });
+}
+
+void SetJobTimingHook(JobTimingHook hook)
+{
+    jobs.timingHook.store(hook, std::memory_order_relaxed);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+struct Job;
+
+// Tracks the unfinished jobs of a batch. Jobs queued with RunJobAfter start
+// once it drops to zero, and WaitForCounter blocks until it does.
+struct JobCounter
+{
+    std::atomic<unsigned int> pending{0};
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<Job*> continuations;
+};
+
+// Starts the shared worker pool. Zero picks one worker per hardware thread
+// besides the calling one. Jobs queued before this start a default sized pool.
+void InitJobSystem(unsigned int numWorkers = 0);
+void ShutdownJobSystem();
+unsigned int GetJobWorkerCount();
+
+// Queues work on the pool. The counter is incremented right away and
+// decremented once the job has run. Jobs queued from a worker go to the
+// front of its own deque, where idle workers steal them from the back.
+void RunJob(const char* name, std::function<void()> work, JobCounter& counter);
+
+// Queues work once every job counted by dependency has finished
+void RunJobAfter(JobCounter& dependency, const char* name, std::function<void()> work, JobCounter& counter);
+
+// Blocks until the counter reaches zero. Workers run other queued jobs
+// meanwhile, so nested waits can't leave the pool without a free thread.
+void WaitForCounter(JobCounter& counter);
+
+// Called after every job with its name, the index of the thread that ran it
+// (0 for threads outside the pool) and its start and end in seconds
+typedef void (*JobTimingHook)(const char* name, unsigned int thread, double start, double end);
+void SetJobTimingHook(JobTimingHook hook);
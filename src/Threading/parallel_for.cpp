@@ -0,0 +1,85 @@
+#include "parallel_for.h"
+#include "job_system.h"
+#include <condition_variable>
+#include <memory>
+
+// Chunks are claimed from a shared index, so the calling thread only ever
+// runs its own chunks and never waits on a worker to pick up a queued job.
+// Jobs that start after every chunk is claimed find nothing left and return,
+// which is why the batch is shared with them instead of living on the stack.
+struct ParallelForBatch
+{
+    const std::function<void(size_t, size_t)>* func;
+    size_t count;
+    size_t chunkSize;
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> numDone{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+// Nobody waits on the queued jobs themselves, only on the batch's chunks
+static JobCounter untracked;
+
+static void RunChunks(ParallelForBatch& batch)
+{
+    while(true)
+    {
+        size_t begin = batch.next.fetch_add(batch.chunkSize, std::memory_order_relaxed);
+        if(begin >= batch.count)
+            return;
+
+        size_t end = begin + batch.chunkSize < batch.count ? begin + batch.chunkSize : batch.count;
+        (*batch.func)(begin, end);
+
+        // Taking the lock makes sure the caller either sees the count or gets the notify
+        if(batch.numDone.fetch_add(end - begin, std::memory_order_acq_rel) + (end - begin) == batch.count)
+        {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.finished.notify_all();
+        }
+    }
+}
+
+unsigned int GetWorkerCount()
+{
+    // The calling thread helps out while it waits
+    return GetJobWorkerCount() + 1;
+}
+
+void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& func, const char* name)
+{
+    if(count == 0)
+        return;
+    if(grainSize == 0)
+        grainSize = 1;
+
+    // A few chunks per thread lets whoever is free even out uneven chunks, but never below the grain size
+    size_t numThreads = GetWorkerCount();
+    size_t chunkSize = (count + numThreads * 4 - 1) / (numThreads * 4);
+    if(chunkSize < grainSize)
+        chunkSize = grainSize;
+
+    // Work that fits in a single chunk isn't worth queueing
+    if(chunkSize >= count)
+    {
+        func(0, count);
+        return;
+    }
+
+    auto batch = std::make_shared<ParallelForBatch>();
+    batch->func = &func;
+    batch->count = count;
+    batch->chunkSize = chunkSize;
+
+    size_t numChunks = (count + chunkSize - 1) / chunkSize;
+    size_t numJobs = numChunks - 1 < numThreads - 1 ? numChunks - 1 : numThreads - 1;
+    for(size_t i = 0; i < numJobs; i++)
+        RunJob(name, [batch] { RunChunks(*batch); }, untracked);
+
+    RunChunks(*batch);
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&] { return batch->numDone.load(std::memory_order_acquire) == count; });
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Splits [0, count) into chunks of at least grainSize elements and runs
+// func(begin, end) on them across the job system's workers. Blocks until
+// done, running chunks on the calling thread meanwhile. The name shows up
+// in the job timing hook.
+void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& func, const char* name = "ParallelFor");
+
+// Threads a ParallelFor spreads over, including the calling one
+unsigned int GetWorkerCount();
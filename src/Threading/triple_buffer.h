@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+
+// Single producer, single consumer handoff of the latest value without locks.
+// The producer fills the back slot and publishes it by swapping it with the
+// shared slot; the consumer swaps the shared slot with its front slot whenever
+// a fresh value is waiting. Neither side ever touches the other's slot.
+template<typename T>
+struct TripleBuffer
+{
+    static const unsigned int FreshBit = 4;
+    static const unsigned int IndexMask = 3;
+
+    T slots[3];
+    unsigned int back = 0;
+    unsigned int front = 1;
+    std::atomic<unsigned int> shared{2};
+};
+
+// Slot the producer writes the next value into
+template<typename T>
+T& TripleBufferBack(TripleBuffer<T>& buffer)
+{
+    return buffer.slots[buffer.back];
+}
+
+template<typename T>
+void TripleBufferPublish(TripleBuffer<T>& buffer)
+{
+    unsigned int previous = buffer.shared.exchange(buffer.back | TripleBuffer<T>::FreshBit, std::memory_order_acq_rel);
+    buffer.back = previous & TripleBuffer<T>::IndexMask;
+}
+
+// Whether a published value hasn't been acquired by the consumer yet
+template<typename T>
+bool TripleBufferHasFresh(const TripleBuffer<T>& buffer)
+{
+    return (buffer.shared.load(std::memory_order_acquire) & TripleBuffer<T>::FreshBit) != 0;
+}
+
+// Moves the latest published value to the front slot, returns false if there was none
+template<typename T>
+bool TripleBufferAcquire(TripleBuffer<T>& buffer)
+{
+    if(!TripleBufferHasFresh(buffer))
+        return false;
+
+    unsigned int previous = buffer.shared.exchange(buffer.front, std::memory_order_acq_rel);
+    buffer.front = previous & TripleBuffer<T>::IndexMask;
+    return true;
+}
+
+// Slot the consumer reads the latest acquired value from
+template<typename T>
+T& TripleBufferFront(TripleBuffer<T>& buffer)
+{
+    return buffer.slots[buffer.front];
+}
@@ -1,24 +1,207 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "AssetManagement/asset_cache.h"
 #include "AssetManagement/asset_loader.h"
+#include "AssetManagement/asset_registry.h"
+#include "AssetManagement/asset_stats.h"
+#include "AssetManagement/async_loader.h"
 #include "Display/display.h"
 #include "Camera/camera.h"
 #include "String/string.h"
+#include "Renderer/staging_buffer.h"
+#include "Renderer/render_thread.h"
+#include "Renderer/thumbnail_atlas.h"
+#include "Scene/transform_hierarchy.h"
+#include "Threading/job_system.h"
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <imgui.h>
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_glfw.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// An entry of the model list. Models still loading show the placeholder until they're ready.
+struct ModelEntry
+{
+    Model* model;
+    AsyncLoad* load;
+    String name;
+
+    // Load holding the model once it's swapped in, freed when the entry is unloaded
+    AsyncLoad* finished;
+};
+
+static ModelEntry QueueModelEntry(const char* path)
+{
+    const char* name = path;
+    for(const char* c = path; *c != '\0'; c++)
+    {
+        if(*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+    return { GetPlaceholderModel(), QueueModelLoad(path), name, nullptr };
+}
+
+// Files dropped on the window, queued for loading at the start of the next frame
+static std::vector<std::string> droppedFiles;
+
+static void DropCallback(GLFWwindow*, int count, const char** paths)
+{
+    for(int i = 0; i < count; i++)
+        droppedFiles.push_back(paths[i]);
+}
+
+// Lights on shells around the origin in varied colors, the same ones for a given count
+static void ScatterLights(std::vector<PointLight>& lights, int count, float radius)
+{
+    lights.clear();
+    unsigned int seed = 1;
+    auto random = [&seed] { seed = seed * 1664525u + 1013904223u; return (float)(seed >> 8) / 16777216.0f; };
+    for(int i = 0; i < count; i++)
+    {
+        float yaw = random() * 6.2831853f;
+        float height = random() * 2.0f - 1.0f;
+        float distance = 1.0f + random() * 2.0f;
+        float ring = sqrtf(1.0f - height * height);
+        glm::vec3 position = glm::vec3(cosf(yaw) * ring, height, sinf(yaw) * ring) * distance;
+        glm::vec3 color(random(), random(), random());
+        color /= std::max(std::max(color.x, color.y), std::max(color.z, 1e-3f));
+        lights.push_back({ position, radius, color });
+    }
+}
+
+static double ToMiB(size_t bytes)
+{
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+static void LoadTimesText(const AssetLoadTimes& times)
+{
+    ImGui::Text("Load: read %.2f, decode %.2f, build %.2f, upload %.2f ms%s", times.read, times.decode, times.build, times.upload,
+                times.cached ? " (cached)" : "");
+}
+
+// Every registered texture and mesh with its memory and load times, largest first
+static void DrawAssetInspector(bool* open)
+{
+    ImGui::SetNextWindowSize(ImVec2(520.0f, 420.0f), ImGuiCond_FirstUseEver);
+    if(!ImGui::Begin("Asset inspector", open))
+    {
+        ImGui::End();
+        return;
+    }
 
-int Texture::GlobalTextureIndex = 0;
+    AssetStats stats = CollectAssetStats();
+    ImGui::Text("Textures: %zu, %.2f MiB", stats.textures.size(), ToMiB(stats.textureMemory));
+    ImGui::Text("Meshes: %zu, %.2f MiB GPU, %.2f MiB CPU", stats.meshes.size(), ToMiB(stats.meshGPUMemory), ToMiB(stats.meshCPUMemory));
+    if(ImGui::Button("Write asset_stats.json"))
+        WriteAssetStats(stats, "asset_stats.json");
 
-int main()
+    if(ImGui::CollapsingHeader("Textures", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        for(auto& texture : stats.textures)
+        {
+            if(!ImGui::TreeNode(texture.name.C_Str(), "%s  %ux%u x%u  %.2f MiB", texture.name.C_Str(), texture.width, texture.height,
+                                texture.channels, ToMiB(texture.memory)))
+                continue;
+            ImGui::Text("References: %u", texture.references);
+            for(size_t level = 0; level < texture.levelMemory.size(); level++)
+                ImGui::Text("Mip %zu: %zu bytes", level, texture.levelMemory[level]);
+            LoadTimesText(texture.loadTimes);
+            ImGui::TreePop();
+        }
+    }
+
+    if(ImGui::CollapsingHeader("Meshes", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        for(auto& mesh : stats.meshes)
+        {
+            if(!ImGui::TreeNode(mesh.name.C_Str(), "%s  %u vertices  %.2f MiB", mesh.name.C_Str(), mesh.numVertices,
+                                ToMiB(mesh.vertexMemory + mesh.indexMemory + mesh.clusterMemory + mesh.bvhMemory)))
+                continue;
+            ImGui::Text("References: %u", mesh.references);
+            ImGui::Text("Indices: %u, %.1f%% reused vertices", mesh.numIndices, mesh.duplicateVertexRatio * 100.0f);
+            ImGui::Text("Vertex buffers: %zu bytes, index buffer: %zu bytes", mesh.vertexMemory, mesh.indexMemory);
+            ImGui::Text("Clusters: %zu bytes, BVH: %zu bytes", mesh.clusterMemory, mesh.bvhMemory);
+            if(mesh.hasBounds)
+            {
+                ImGui::Text("Bounds: (%.3f, %.3f, %.3f) to (%.3f, %.3f, %.3f)", mesh.boundsMin.x, mesh.boundsMin.y, mesh.boundsMin.z,
+                            mesh.boundsMax.x, mesh.boundsMax.y, mesh.boundsMax.z);
+            }
+            LoadTimesText(mesh.loadTimes);
+            ImGui::TreePop();
+        }
+    }
+    ImGui::End();
+}
+
+// Batch mode for asset libraries: model-viewer --thumbnails <output> [--tile-size <pixels>] [--views <count>] <models...>
+static int RunThumbnailBatch(Display& display, int argc, char** argv)
+{
+    ThumbnailSettings settings = { nullptr, 256, 4 };
+    std::vector<std::string> paths;
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if(strcmp(argv[i], "--thumbnails") == 0 && hasValue)
+            settings.outputPath = argv[++i];
+        else if(strcmp(argv[i], "--tile-size") == 0 && hasValue)
+            settings.tileSize = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--views") == 0 && hasValue)
+            settings.views = atoi(argv[++i]);
+        else
+            paths.push_back(argv[i]);
+    }
+    if(settings.outputPath == nullptr || settings.tileSize <= 0 || paths.empty())
+    {
+        printf("Usage: %s --thumbnails <output> [--tile-size <pixels>] [--views <count>] <models...>\n", argv[0]);
+        return -1;
+    }
+
+    // Nothing is shown, tiles go straight into the atlas
+    glfwHideWindow(display.window);
+
+    RenderResources resources = {};
+    resources.pbr = LoadShadersFromFiles("res/shaders/pbr/pbr.vert", "res/shaders/pbr/pbr.frag", "res/shaders/common/lights.glsl");
+    resources.brdfLookup = CreateBRDFLookupTexture();
+    Environment environment = LoadEnvironmentFromFiles("res/cubemaps/Yokohama");
+
+    StartAsyncLoader(display);
+    int failed = RenderThumbnailAtlas(paths, settings, resources, environment);
+    StopAsyncLoader();
+    return failed == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
 {
     const int WIDTH = 1280;
     const int HEIGHT = 720;
 
     Display display = CreateDisplay(WIDTH, HEIGHT, "Model Viewer");
 
+    // Persistently mapped upload memory shared by all loaders
+    InitStaging(64 * 1024 * 1024);
+
+    // Worker pool shared by the loaders, mesh processing and culling
+    InitJobSystem();
+
+    // Imported textures and meshes are cached outside the asset folders, which may be read-only
+    InitAssetCache();
+
+    if(argc > 1 && strncmp(argv[1], "--", 2) == 0)
+    {
+        int result = RunThumbnailBatch(display, argc, argv);
+        ShutdownStaging();
+        ShutdownJobSystem();
+        glfwTerminate();
+        return result;
+    }
+
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -26,53 +209,77 @@ int main()
     ImGui::StyleColorsDark();
     ImGui_ImplGlfw_InitForOpenGL(display.window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
+    // Created up front, the render thread only draws with them
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
 
     // Load shader from file
-    Shader shader = LoadShadersFromFiles("res/shaders/lighting/lighting.vert", "res/shaders/lighting/lighting.frag");
-    UseShader(shader);
+    Shader shader = LoadShadersFromFiles("res/shaders/lighting/lighting.vert", "res/shaders/lighting/lighting.frag", "res/shaders/common/lights.glsl");
+    Shader pbrShader = LoadShadersFromFiles("res/shaders/pbr/pbr.vert", "res/shaders/pbr/pbr.frag", "res/shaders/common/lights.glsl");
 
+    // Textures are decoded in parallel, then uploaded in order
+    TextureRequest textureRequests[]
+    {
+        { "res/textures/lantern-diffuse.png", TextureType::Color },
+        { "res/textures/lantern-normal.png", TextureType::Normal },
+        { "res/textures/lantern-occ-rough-metal.png", TextureType::Data },
+        { "res/textures/sofa-diffuse.png", TextureType::Color },
+        { "res/textures/sofa-normal.png", TextureType::Normal },
+        { "res/textures/sofa-occ-rough-metal.png", TextureType::Data }
+    };
+    TextureHandle textures[IM_ARRAYSIZE(textureRequests)];
+    LoadTextureAssets(textureRequests, IM_ARRAYSIZE(textureRequests), textures);
+
+    // Models hold references to their assets, the last model using one frees it
     std::vector<Model> models;
     models.push_back
     ({
-        LoadMeshFromOBJ("res/models/Lantern_01.obj"),
-        LoadTextureFromFile("res/textures/lantern-diffuse.png"),
-        LoadTextureFromFile("res/textures/lantern-normal.png"),
-        LoadTextureFromFile("res/textures/lantern-occ-rough-metal.png"),
+        "res/models/Lantern_01.obj",
+        LoadMeshAsset("res/models/Lantern_01.obj"),
+        textures[0],
+        textures[1],
+        textures[2],
+        glm::mat4(1.0f),
+        {}
     });
     models.push_back
     ({
-        LoadMeshFromOBJ("res/models/sofa_02.obj"),
-        LoadTextureFromFile("res/textures/sofa-diffuse.png"),
-        LoadTextureFromFile("res/textures/sofa-normal.png"),
-        LoadTextureFromFile("res/textures/sofa-occ-rough-metal.png"),
+        "res/models/sofa_02.obj",
+        LoadMeshAsset("res/models/sofa_02.obj"),
+        textures[3],
+        textures[4],
+        textures[5],
+        glm::mat4(1.0f),
+        {}
     });
-    std::vector<const char*> modelNames;
+    std::vector<ModelEntry> modelEntries;
     for(auto& m : models)
-        modelNames.push_back(m.mesh.name);
-
-    Entity entity = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f) };
+        modelEntries.push_back({ &m, nullptr, m.name, nullptr });
+    std::vector<const char*> modelNames;
 
-    // Load cubemap
-    std::vector<Texture> cubemaps;
-    cubemaps.push_back(LoadCubemapFromFiles("res/cubemaps/Yokohama"));
-    cubemaps.push_back(LoadCubemapFromFiles("res/cubemaps/Lycksele3"));
-    Mesh cubeMapMesh = GenerateInvertedCube();
+    // The selected model hangs off the scene root, its world matrix only changes with the sliders
+    const Entity identity = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f) };
+    TransformHierarchy scene;
+    unsigned int sceneRoot = AddTransform(scene, -1, identity);
+    unsigned int modelNode = AddTransform(scene, (int)sceneRoot, identity);
+
+    // Load cubemaps along with their image based lighting, which is only computed on the first run
+    std::vector<Environment> environments;
+    environments.push_back(LoadEnvironmentFromFiles("res/cubemaps/Yokohama"));
+    environments.push_back(LoadEnvironmentFromFiles("res/cubemaps/Lycksele3"));
+    Texture brdfLookup = CreateBRDFLookupTexture();
     Shader cubeMapShader = LoadShadersFromFiles("res/shaders/cubemap/cubemap.vert", "res/shaders/cubemap/cubemap.frag");
 
     std::vector<const char*> cubemapNames;
-    for(auto& c : cubemaps)
-        cubemapNames.push_back(c.path.C_Str());
-
-    // Load lightcube mesh
-    Mesh lightMesh = GenerateCube();
-    Shader lightShader = LoadShadersFromFiles("res/shaders/lightcube/lightcube.vert", "res/shaders/lightcube/lightcube.frag");
+    for(auto& e : environments)
+        cubemapNames.push_back(e.skybox.path.C_Str());
 
-    // Used for debug axes view
-    Mesh debugAxes = GenerateAxes();
+    // Draws the light cube and debug axes
     Shader debugShader = LoadShadersFromFiles("res/shaders/debug/debug.vert", "res/shaders/debug/debug.frag");
 
+    // Renders the point light's shadow cube
+    Shader shadowShader = LoadShadersFromFiles("res/shaders/shadow/shadow.vert", "res/shaders/shadow/shadow.frag");
+
     glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WIDTH / HEIGHT, 0.1f, 1000.0f);
-    UniformMat4(shader, "projection", projection);
 
     // Camera info
     bool shouldReset = false;
@@ -81,94 +288,160 @@ int main()
     // ImGui state
     bool rotating = false;
     bool axes = false;
+    bool cullClusters = true;
+    bool assetInspector = false;
+    bool imageBasedLighting = true;
+    int shadowQuality = (int)ShadowQuality::Medium;
+    const char* shadowQualityNames[] = { "Off", "Low", "Medium", "High" };
     int currentModel = 0;
     int currentCubemap = 0;
+    const char* pacingNames[] = { "On demand", "Continuous", "Benchmark" };
 
     // Point light info
     glm::vec3 lightPos(3.0f, 0.0f, 3.0f);
 
+    // Extra lights for previewing under many lights, drawn through the light clusters
+    std::vector<PointLight> extraLights;
+    int numExtraLights = 0;
+    float extraLightRadius = 1.0f;
+    size_t maxClusterLights = 0;
+
+    // Right clicks on the model place the ends of a distance measurement
+    glm::vec3 measurePoints[2];
+    int numMeasurePoints = 0;
+    bool wasRightPressed = false;
+    double pickTime = 0.0;
+
+    // Last frame's scene, changes keep on-demand mode drawing whatever caused them
+    glm::mat4 lastView(0.0f);
+    glm::vec3 lastLightPos(0.0f);
+    unsigned int sceneVersion = 0;
+    const Model* lastDrawnModel = nullptr;
+
+    // Everything after startup loads on its own thread. The models above went
+    // through the staging ring, which is the loader's from here on.
+    StartAsyncLoader(display);
+    glfwSetDropCallback(display.window, DropCallback);
+
+    // GL submission moves to its own thread, this one keeps input, UI and scene updates
+    RenderResources resources = { shader, pbrShader, cubeMapShader, debugShader, shadowShader, brdfLookup };
+    StartRenderThread(display.window, resources);
+
+    // Models given on the command line are loaded like dropped ones
+    for(int i = 1; i < argc; i++)
+        droppedFiles.push_back(argv[i]);
+
     while(!glfwWindowShouldClose(display.window))
     {
+        RenderPacket& packet = BeginRenderPacket();
+
         DeltaTimeCalc(display);
         if(!ImGui::GetIO().WantCaptureMouse)
             ProcessInput(display, camera, rotating, shouldReset);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Transform matrix for camera
-        glm::mat4 view = glm::lookAt(camera.position, camera.position + camera.forward, camera.up);
-        glm::mat4 nonTranslatedView = glm::mat4(glm::mat3(view));
-
-        UseShader(shader);
-        UniformVec3(shader, "pointLightPos", lightPos);
-        UniformVec3(shader, "cameraPos", camera.position);
-
-        // Transform matrix for mesh
-        glm::mat4 model(1.0f);
-        model = glm::translate(model, entity.position);
-        model = glm::rotate(model, glm::radians(entity.rotation.x), {1.0f, 0.0f, 0.0f});
-        model = glm::rotate(model, glm::radians(entity.rotation.y), {0.0f, 1.0f, 0.0f});
-        model = glm::rotate(model, glm::radians(entity.rotation.z), {0.0f, 0.0f, 1.0f});
-        model = glm::scale(model, entity.scale);
-        UniformMat4(shader, "model", model);
-        UniformMat4(shader, "view", view);
-
-        // Render the mesh
-        UniformInt(shader, "diffuseMap", models[currentModel].diffuse.index);
-        UniformInt(shader, "normalMap", models[currentModel].normal.index);
-        UniformInt(shader, "specularMap", models[currentModel].specular.index);
-        Draw(models[currentModel].mesh);
-
-        // Switch to light shader for lightcube rendering
-        UseShader(lightShader);
-        model = glm::mat4(1.0);
-        model = glm::translate(model, lightPos);
-        model = glm::scale(model, glm::vec3(0.2f));
-        UniformMat4(lightShader, "model", model);
-        UniformMat4(lightShader, "view", view);
-        UniformMat4(lightShader, "projection", projection);
-        Draw(lightMesh);
-
-        // Draw the cubemap after anything else
-        UseShader(cubeMapShader);
-        UniformMat4(cubeMapShader, "view", nonTranslatedView);
-        UniformMat4(cubeMapShader, "projection", projection);
-        UniformInt(cubeMapShader, "cubemap", cubemaps[currentCubemap].index);
-        Draw(cubeMapMesh);
-
-        if(axes)
+        // New loads get selected right away, showing the placeholder
+        for(auto& path : droppedFiles)
         {
-            glDisable(GL_DEPTH_TEST);
-            UseShader(debugShader);
-
-            glm::mat4 debugModel(1.0f);
-            debugModel = glm::scale(debugModel, { 10.0f, 10.0f, 10.0f });
-
-            glm::mat4 MVP = projection * view * debugModel;
-            UniformMat4(debugShader, "MVP", MVP);
-
-            DrawLines(debugAxes);
+            modelEntries.push_back(QueueModelEntry(path.c_str()));
+            currentModel = (int)modelEntries.size() - 1;
+        }
+        droppedFiles.clear();
 
-            glEnable(GL_DEPTH_TEST);
+        // Swap in finished loads and drop the ones that won't finish
+        for(size_t i = 0; i < modelEntries.size();)
+        {
+            AsyncLoad* load = modelEntries[i].load;
+            AsyncLoadState state = load != nullptr ? load->state.load() : AsyncLoadState::Ready;
+            if(state == AsyncLoadState::Failed || state == AsyncLoadState::Cancelled)
+            {
+                FreeLoad(load);
+                modelEntries.erase(modelEntries.begin() + i);
+                if(currentModel >= (int)i && currentModel > 0)
+                    currentModel--;
+                continue;
+            }
+            if(load != nullptr && state == AsyncLoadState::Ready)
+            {
+                modelEntries[i].model = &load->model;
+                modelEntries[i].load = nullptr;
+                modelEntries[i].finished = load;
+                RequestRedraw();
+            }
+            i++;
         }
 
-        // Start ImGui frame and render the window
-        ImGui_ImplOpenGL3_NewFrame();
+        modelNames.clear();
+        for(auto& entry : modelEntries)
+            modelNames.push_back(entry.name.C_Str());
+
+        // Start ImGui frame and build the window
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
         ImGui::Begin("Main Controls");
         ImGui::Combo("Select Model", &currentModel, modelNames.data(), (int)modelNames.size());
         ImGui::Combo("Select Cubemap", &currentCubemap, cubemapNames.data(), (int)cubemapNames.size());
         ImGui::Checkbox("Show Debug Axes?", &axes);
-        ImGui::Text("Model transform");
-        ImGui::SliderFloat3("Model Translation", &entity.position.x, -1.0f, 1.0f);
-        ImGui::SliderFloat3("Model Rotation", &entity.rotation.x, -360.0f, 360.0f);
-        ImGui::SliderFloat3("Model Scale", &entity.scale.x, 0.0f, 5.0f);
-        if(ImGui::Button("Reset model transform"))
+        ImGui::Checkbox("Cull clusters?", &cullClusters);
+        ImGui::Checkbox("Image based lighting?", &imageBasedLighting);
+        ImGui::Combo("Shadows", &shadowQuality, shadowQualityNames, 4);
+        if(shadowQuality != (int)ShadowQuality::Off)
+            ImGui::Text("Shadow map renders: %u", GetShadowMapRenders());
+        GLStateStats stateStats = GetGLStateStats();
+        ImGui::Text("GL state calls: %zu issued, %zu skipped", stateStats.issued, stateStats.skipped);
+        ImGui::Text("Job workers: %u", GetJobWorkerCount());
+        ClusterCullingStats cullingStats = GetRenderStats();
+        if(cullClusters && cullingStats.totalClusters > 0)
+            ImGui::Text("Clusters: %zu / %zu visible, %zu / %zu triangles", cullingStats.visibleClusters, cullingStats.totalClusters,
+                        cullingStats.visibleTriangles, cullingStats.totalTriangles);
+        size_t textureMemory = GetModelTextureMemory(*modelEntries[currentModel].model);
+        ImGui::Text("Texture memory: %.2f MiB", (double)textureMemory / (1024.0 * 1024.0));
+        AssetRegistryStats assetStats = GetAssetRegistryStats();
+        ImGui::Text("Assets: %zu textures, %zu meshes, %zu references", assetStats.textures, assetStats.meshes, assetStats.references);
+        ImGui::Checkbox("Asset inspector", &assetInspector);
+
+        // Vsync belongs to the render thread's context
+        int pacing = (int)display.pacing;
+        if(ImGui::Combo("Frame pacing", &pacing, pacingNames, 3))
+        {
+            display.pacing = (FramePacing)pacing;
+            int swapInterval = display.pacing == FramePacing::Benchmark ? 0 : 1;
+            EnqueueRenderCommand([swapInterval] { glfwSwapInterval(swapInterval); });
+        }
+        if(display.pacing != FramePacing::Benchmark)
+            ImGui::SliderInt("Frame rate cap", &display.frameRateCap, 0, 240, display.frameRateCap > 0 ? "%d" : "Off");
+
+        // The last entry always stays, something has to be selected
+        Model* unloaded = nullptr;
+        AsyncLoad* unloadedLoad = nullptr;
+        if(modelEntries.size() > 1 && modelEntries[currentModel].load == nullptr && ImGui::Button("Unload model"))
+        {
+            unloaded = modelEntries[currentModel].model;
+            unloadedLoad = modelEntries[currentModel].finished;
+            modelEntries.erase(modelEntries.begin() + currentModel);
+            if(currentModel > 0)
+                currentModel--;
+        }
+        for(auto& entry : modelEntries)
         {
-            entity.position = entity.rotation = glm::vec3(0.0f);
-            entity.scale = glm::vec3(1.0);
+            if(entry.load == nullptr)
+                continue;
+
+            ImGui::PushID(entry.load);
+            ImGui::Text("Loading %s", entry.name.C_Str());
+            ImGui::ProgressBar(entry.load->progress, ImVec2(-80.0f, 0.0f));
+            ImGui::SameLine();
+            if(ImGui::Button("Cancel"))
+                CancelLoad(entry.load);
+            ImGui::PopID();
         }
+        ImGui::Text("Model transform");
+        bool moved = ImGui::SliderFloat3("Model Translation", &scene.positions[modelNode].x, -1.0f, 1.0f);
+        moved |= ImGui::SliderFloat3("Model Rotation", &scene.rotations[modelNode].x, -360.0f, 360.0f);
+        moved |= ImGui::SliderFloat3("Model Scale", &scene.scales[modelNode].x, 0.0f, 5.0f);
+        if(moved)
+            MarkTransformDirty(scene, modelNode);
+        if(ImGui::Button("Reset model transform"))
+            SetTransform(scene, modelNode, identity);
         ImGui::Text("Camera Controls");
         if(ImGui::SliderFloat("Camera distance", &camera.cameraDistance, 1.0f, 10.0f))
         {
@@ -178,17 +451,121 @@ int main()
         ImGui::Checkbox("Rotate camera with mouse?", &rotating);
         ImGui::Text("Point light");
         ImGui::SliderFloat3("Light Position", &lightPos.x, -5.0f, 5.0f);
+        bool lightsChanged = ImGui::SliderInt("Extra lights", &numExtraLights, 0, 1024);
+        lightsChanged |= ImGui::SliderFloat("Extra light radius", &extraLightRadius, 0.1f, 5.0f);
+        if(lightsChanged)
+        {
+            ScatterLights(extraLights, numExtraLights, extraLightRadius);
+            RequestRedraw();
+        }
+        if(numExtraLights > 0)
+            ImGui::Text("Up to %zu lights per cluster", maxClusterLights);
+        ImGui::Text("Measure (right click the model)");
+        if(HasStreamedMeshes(*modelEntries[currentModel].model))
+            ImGui::Text("Streamed meshes can't be picked");
+        if(numMeasurePoints == 2)
+            ImGui::Text("Distance: %.4f", glm::length(measurePoints[1] - measurePoints[0]));
+        else
+            ImGui::Text("Points placed: %d / 2", numMeasurePoints);
+        ImGui::Text("Last pick: %.3f ms", pickTime * 1000.0);
+        if(numMeasurePoints > 0 && ImGui::Button("Clear measurement"))
+            numMeasurePoints = 0;
         ImGui::End();
+        if(assetInspector)
+            DrawAssetInspector(&assetInspector);
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
-        glfwSwapBuffers(display.window);
-        glfwPollEvents();
+        // Only nodes edited this frame and their children are recomputed
+        bool sceneMoved = UpdateTransforms(scene) > 0;
+        const glm::mat4& model = scene.worlds[modelNode];
+
+        // The cached shadow map is rendered again whenever what casts shadows moves or changes
+        if(sceneMoved || unloaded != nullptr || modelEntries[currentModel].model != lastDrawnModel)
+        {
+            sceneVersion++;
+            lastDrawnModel = modelEntries[currentModel].model;
+        }
+
+        glm::mat4 view = glm::lookAt(camera.position, camera.position + camera.forward, camera.up);
+        if(view != lastView || sceneMoved || lightPos != lastLightPos)
+        {
+            RequestRedraw();
+            lastView = view;
+            lastLightPos = lightPos;
+        }
+
+        // Cast a ray through the cursor against the selected model's triangles
+        bool rightPressed = glfwGetMouseButton(display.window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+        if(rightPressed && !wasRightPressed && !ImGui::GetIO().WantCaptureMouse)
+        {
+            double cursorX, cursorY;
+            int width, height;
+            glfwGetCursorPos(display.window, &cursorX, &cursorY);
+            glfwGetWindowSize(display.window, &width, &height);
+            glm::vec4 cursor((float)(cursorX / width) * 2.0f - 1.0f, 1.0f - (float)(cursorY / height) * 2.0f, 1.0f, 1.0f);
+            glm::vec4 farPoint = glm::inverse(projection * view) * cursor;
+            glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - camera.position);
+
+            double pickStart = glfwGetTime();
+            ModelPick pick = { FLT_MAX, {}, {}, nullptr };
+            bool hit = PickModel(*modelEntries[currentModel].model, model, camera.position, direction, pick);
+            pickTime = glfwGetTime() - pickStart;
+            if(hit)
+            {
+                if(numMeasurePoints == 2)
+                    numMeasurePoints = 0;
+                measurePoints[numMeasurePoints++] = pick.position;
+            }
+            RequestRedraw();
+        }
+        wasRightPressed = rightPressed;
+
+        // Hand the frame over to the render thread
+        packet.view = view;
+        packet.projection = projection;
+        packet.cameraPosition = camera.position;
+        packet.lightPosition = lightPos;
+        packet.draws.clear();
+        packet.draws.push_back({ modelEntries[currentModel].model, model });
+        packet.environment = &environments[currentCubemap];
+        packet.imageBasedLighting = imageBasedLighting;
+        packet.cullClusters = cullClusters;
+        packet.shadowQuality = (ShadowQuality)shadowQuality;
+        packet.sceneVersion = sceneVersion;
+        BuildLightClusters(packet.lights, extraLights, view, projection);
+        maxClusterLights = packet.lights.maxLightsPerCluster;
+        ClearDebugDraw(packet.debug);
+        AddDebugBox(packet.debug, lightPos, glm::vec3(0.2f), glm::vec3(1.0f));
+        for(auto& light : extraLights)
+            AddDebugBox(packet.debug, light.position, glm::vec3(0.03f), light.color);
+        if(axes)
+            AddDebugAxes(packet.debug, glm::scale(glm::mat4(1.0f), glm::vec3(10.0f)));
+        for(int i = 0; i < numMeasurePoints; i++)
+            AddDebugBox(packet.debug, measurePoints[i], glm::vec3(0.01f * camera.cameraDistance), glm::vec3(1.0f, 0.8f, 0.0f));
+        if(numMeasurePoints == 2)
+            AddDebugLine(packet.debug, measurePoints[0], measurePoints[1], glm::vec3(1.0f, 0.8f, 0.0f));
+        SubmitRenderPacket(ImGui::GetDrawData());
+
+        // Earlier packets may still draw the unloaded model, the render thread
+        // runs commands once it's done with them and before this frame
+        if(unloaded != nullptr)
+            EnqueueRenderCommand([unloaded, unloadedLoad] { ReleaseModel(*unloaded); FreeLoad(unloadedLoad); });
+
+        // Loads still running redraw at a low rate to keep their progress bars moving
+        bool loading = false;
+        for(auto& entry : modelEntries)
+            loading |= entry.load != nullptr;
+        WaitForNextFrame(display, loading ? 0.1 : 0.0);
     }
 
+    StopRenderThread();
+    StopAsyncLoader();
+
     ImGui_ImplGlfw_Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui::DestroyContext();
+    ShutdownStaging();
+    ShutdownJobSystem();
     glfwTerminate();
 
     return 0;
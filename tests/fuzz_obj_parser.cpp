@@ -0,0 +1,61 @@
+#include "../src/AssetManagement/obj_parser.h"
+#include "../src/Memory/arena.h"
+#include "../src/Threading/job_system.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// libFuzzer entry point for the OBJ parser, built with -DMODEL_VIEWER_FUZZ=ON.
+// The input is parsed in two windows split at a line start, the way the
+// streaming importer does, and every face that survives is checked against
+// the elements defined before it.
+
+static void CheckCorners(const OBJData& data, const OBJCounts& defined)
+{
+    for(size_t i = 0; i < data.counts.triangles * 3; i++)
+    {
+        const OBJCorner& corner = data.corners[i];
+        if(corner.vertex >= defined.vertices)
+            abort();
+        if(corner.uv != OBJMissingIndex && corner.uv >= defined.uvs)
+            abort();
+        if(corner.normal != OBJMissingIndex && corner.normal >= defined.normals)
+            abort();
+    }
+}
+
+// The pool has to be joined before the worker threads are destroyed at exit
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+    InitJobSystem();
+    atexit(ShutdownJobSystem);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    // Files are read with a terminator after them, copied so overreads hit the sanitizer
+    char* text = (char*)malloc(size + 1);
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    const char* split = text + size / 2;
+    while(split > text && split[-1] != '\n')
+        split--;
+
+    Arena arena = CreateArena(size * 6 + 4096);
+    OBJData first = ParseOBJText(text, split, {}, arena);
+    CheckCorners(first, first.counts);
+
+    OBJCounts preceding = first.counts;
+    OBJData second = ParseOBJText(split, text + size, preceding, arena);
+    OBJCounts defined = second.counts;
+    defined.vertices += preceding.vertices;
+    defined.uvs += preceding.uvs;
+    defined.normals += preceding.normals;
+    CheckCorners(second, defined);
+
+    DestroyArena(arena);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "../src/AssetManagement/obj_parser.h"
+#include "../src/Memory/arena.h"
+#include "../src/Threading/job_system.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Parse throughput regression test: obj_parse_throughput [minimum MiB/s]
+// Parses a generated grid with every face form the parser handles and fails
+// if the counts are off, any line is rejected, or the best of a few runs is
+// slower than the minimum.
+
+static const int GridSize = 400;
+static const int Runs = 5;
+
+// Quads, triangles, position-only and position/normal faces, with relative indices in every other row
+static std::string GenerateGrid()
+{
+    std::string text = "# generated grid\no grid\n";
+    char line[128];
+    for(int y = 0; y < GridSize; y++)
+    {
+        for(int x = 0; x < GridSize; x++)
+        {
+            snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.000000 %.6f 1.000000\n",
+                     x * 0.01f, y * 0.01f, (float)((x * 7 + y * 13) % 100) * 0.001f,
+                     (float)x / GridSize, (float)y / GridSize, (float)(x % 10) * 0.1f);
+            text += line;
+        }
+    }
+
+    for(int y = 0; y + 1 < GridSize; y++)
+    {
+        for(int x = 0; x + 1 < GridSize; x++)
+        {
+            int a = y * GridSize + x + 1, b = a + 1, c = a + GridSize + 1, d = a + GridSize;
+            switch((x + y) % 4)
+            {
+                case 0:
+                    snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+                    break;
+                case 1:
+                    snprintf(line, sizeof(line), "f %d/%d %d/%d %d/%d\nf %d/%d %d/%d %d/%d\n", a, a, b, b, c, c, a, a, c, c, d, d);
+                    break;
+                case 2:
+                    snprintf(line, sizeof(line), "f %d %d %d %d\n", a, b, c, d);
+                    break;
+                default:
+                {
+                    // Counting back from the last vertex
+                    int last = GridSize * GridSize + 1;
+                    snprintf(line, sizeof(line), "f %d//%d %d//%d %d//%d %d//%d\n", a - last, a, b - last, b, c - last, c, d - last, d);
+                    break;
+                }
+            }
+            text += line;
+        }
+    }
+    return text;
+}
+
+int main(int argc, char** argv)
+{
+    double minimum = argc > 1 ? atof(argv[1]) : 0.0;
+    InitJobSystem();
+
+    std::string text = GenerateGrid();
+    size_t numVertices = (size_t)GridSize * GridSize;
+    size_t numTriangles = (size_t)(GridSize - 1) * (GridSize - 1) * 2;
+
+    double best = 1e30;
+    bool valid = true;
+    for(int run = 0; run < Runs && valid; run++)
+    {
+        Arena arena = CreateArena(text.size() * 6 + 4096);
+        auto start = std::chrono::steady_clock::now();
+        OBJData data = ParseOBJText(text.c_str(), text.c_str() + text.size(), {}, arena);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = seconds < best ? seconds : best;
+
+        valid = data.counts.vertices == numVertices && data.counts.uvs == numVertices && data.counts.normals == numVertices &&
+                data.counts.triangles == numTriangles && data.numErrors == 0;
+        if(!valid)
+        {
+            printf("Parsed %zu vertices, %zu triangles and %zu errors, expected %zu vertices, %zu triangles and none\n",
+                   data.counts.vertices, data.counts.triangles, data.numErrors, numVertices, numTriangles);
+            PrintOBJErrors(data, "generated grid");
+        }
+        DestroyArena(arena);
+    }
+    ShutdownJobSystem();
+    if(!valid)
+        return 1;
+
+    double throughput = (double)text.size() / (1024.0 * 1024.0) / best;
+    printf("Parsed %.2f MiB in %.2f ms, %.1f MiB/s (minimum %.1f)\n", (double)text.size() / (1024.0 * 1024.0), best * 1000.0, throughput, minimum);
+    return throughput >= minimum ? 0 : 1;
+}